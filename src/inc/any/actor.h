@@ -24,6 +24,17 @@ ANY_API void any_error(aactor_t* a, aerror_t ec, const char* fmt, ...);
 */
 ANY_API aint_t aactor_alloc(aactor_t* self, atype_t type, aint_t sz);
 
+/** Reclaim unreferenced objects, rooted by the stack and the mailbox.
+\note The scheduler may also do this while the actor is waiting or sleeping.
+*/
+ANY_API void aactor_collect(aactor_t* self);
+
+/** Find the new version of the running byte code function.
+\return NULL unless the function belongs to a module replaced before the
+last \ref ascheduler_code_change, and the new module exports it as well.
+*/
+ANY_API aprototype_t* aactor_new_version(aactor_t* self);
+
 /// Push a value onto the stack, should be internal used.
 static AINLINE void aactor_push(aactor_t* self, avalue_t* v)
 {
@@ -97,7 +108,7 @@ ANY_API void any_throw(aactor_t* a, aerror_t ec);
 /// Get the value tag of the value at `idx`.
 static AINLINE avalue_tag_t any_type(aactor_t* a, aint_t idx)
 {
-    return a->stack.v[aactor_absidx(a, idx)].tag;
+    return av_tag(a->stack.v + aactor_absidx(a, idx));
 }
 
 // Stack manipulations.
@@ -158,27 +169,27 @@ static AINLINE void any_push_idx(aactor_t* a, aint_t idx)
 
 static AINLINE int32_t any_to_bool(aactor_t* a, aint_t idx)
 {
-    return a->stack.v[aactor_absidx(a, idx)].v.boolean;
+    return av_to_boolean(a->stack.v + aactor_absidx(a, idx));
 }
 
 static AINLINE aint_t any_to_integer(aactor_t* a, aint_t idx)
 {
-    return a->stack.v[aactor_absidx(a, idx)].v.integer;
+    return av_to_integer(a->stack.v + aactor_absidx(a, idx));
 }
 
 static AINLINE areal_t any_to_real(aactor_t* a, aint_t idx)
 {
-    return a->stack.v[aactor_absidx(a, idx)].v.real;
+    return av_to_real(a->stack.v + aactor_absidx(a, idx));
 }
 
 static AINLINE apid_t any_to_pid(aactor_t* a, aint_t idx)
 {
-    return a->stack.v[aactor_absidx(a, idx)].v.pid;
+    return av_to_pid(a->stack.v + aactor_absidx(a, idx));
 }
 
 static AINLINE anative_func_t any_to_native_func(aactor_t* a, aint_t idx)
 {
-    return a->stack.v[aactor_absidx(a, idx)].v.func;
+    return av_to_native_func(a->stack.v + aactor_absidx(a, idx));
 }
 
 static AINLINE void any_remove(aactor_t* a, aint_t idx)
@@ -213,6 +224,18 @@ static AINLINE aint_t any_count(aactor_t* a)
     return a->stack.sp - a->frame->bp;
 }
 
+/** Replace the key on top of the stack by `collection[key]`.
+\brief The collection at `idx` is either a tuple, an array or a table. Missing
+keys and out of range indices result as a nil value.
+*/
+ANY_API void any_get(aactor_t* a, aint_t idx);
+
+/** Pop a value and next a key, set `collection[key] = value`.
+\brief The collection at `idx` is either a tuple, an array or a table. Setting
+an array at its size appends, setting a table to nil removes the key.
+*/
+ANY_API void any_set(aactor_t* a, aint_t idx);
+
 /** Spawn a new actor.
 \brief This function follow the same protocol as \ref any_call.
 */
@@ -0,0 +1,55 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Initialize as a new allocator, huge pages are disabled.
+ANY_API void aallocator_init(
+    aallocator_t* self, aalloc_t alloc, void* alloc_ud);
+
+/** Release all slabs.
+\note Big blocks which are still in use are not tracked, they must be freed
+before.
+*/
+ANY_API void aallocator_cleanup(aallocator_t* self);
+
+/** Back blocks of at least `threshold` bytes by huge pages, 0 to disable.
+\brief Falls back to transparent huge pages, then to the backing allocator.
+\note Only supported on Linux, this is a no-op elsewhere.
+*/
+ANY_API void aallocator_huge_pages(aallocator_t* self, aint_t threshold);
+
+/** Allocator interface, `ud` must be the allocator itself.
+\brief Please refer \ref aalloc_t.
+*/
+ANY_API void* aallocator_alloc(void* ud, void* old, aint_t sz);
+
+/// Get allocation statistics.
+static AINLINE const aallocator_stats_t* aallocator_stats(
+    const aallocator_t* self)
+{
+    return &self->stats;
+}
+
+/// Initialize as a new empty arena.
+ANY_API void aarena_init(aarena_t* self, aalloc_t alloc, void* alloc_ud);
+
+/// Release all chunks.
+ANY_API void aarena_cleanup(aarena_t* self);
+
+/// Free all blocks at once, the arena can be used again.
+ANY_API void aarena_reset(aarena_t* self);
+
+/** Allocator interface, `ud` must be the arena itself.
+\brief Please refer \ref aalloc_t. Freeing is a no-op, growing the last block
+happens in place if the current chunk has room.
+*/
+ANY_API void* aarena_alloc(void* ud, void* old, aint_t sz);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
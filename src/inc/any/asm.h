@@ -3,6 +3,12 @@
 
 #include <any/types.h>
 
+/** Revision of the chunks produced by the assembler and its optimizer.
+\note Must be bumped whenever the same input is saved differently, so caches
+of assembled chunks are invalidated.
+*/
+#define AASM_REVISION 1
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -21,6 +27,14 @@ ANY_API aerror_t aasm_load(aasm_t* self, const achunk_header_t* input);
 /// Update `self->chunk` to reflect the current state.
 ANY_API void aasm_save(aasm_t* self);
 
+/** Write the current state as a chunk to `write`, part by part.
+\brief Small parts are batched, the whole chunk is never held in memory, and
+`self->chunk` is left untouched. Please refer \ref aasm_write_t.
+\return The first error returned by `write`, which stops writing.
+*/
+ANY_API aerror_t aasm_save_to(
+    aasm_t* self, aasm_write_t write, void* write_ud);
+
 /// Release all internal allocated memory, result as a *fresh* assembler.
 ANY_API void aasm_cleanup(aasm_t* self);
 
@@ -75,10 +89,18 @@ ANY_API aasm_prototype_t* aasm_prototype(aasm_t* self);
 /// Resolve prototype pointers.
 ANY_API aasm_current_t aasm_resolve(aasm_t* self);
 
+/** Optimize the current prototype and all of its nested ones.
+\brief `passes` is a combination of \ref AAOPASSES, which run in turn until
+none of them makes a change. Prototypes with jumps out of range are left as
+they are.
+\return The number of removed instructions.
+*/
+ANY_API aint_t aasm_optimize(aasm_t* self, int32_t passes);
+
 /// Get prototype at `slot`.
 static AINLINE aasm_prototype_t* aasm_prototype_at(aasm_t* self, aint_t slot)
 {
-    return (aasm_prototype_t*)(self->_buff + self->_slots[slot]);
+    return self->_slots[slot];
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,24 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Returns the size in bytes of the bundle packing `chunks`.
+ANY_API aint_t abundle_size(
+    achunk_header_t* const* chunks, const aint_t* chunk_sizes,
+    aint_t num_chunks);
+
+/** Pack `chunks` into `bundle`.
+\note `bundle` must be \ref abundle_size bytes and `ABUNDLE_ALIGN` aligned.
+*/
+ANY_API void abundle_write(
+    abundle_header_t* bundle, achunk_header_t* const* chunks,
+    const aint_t* chunk_sizes, aint_t num_chunks);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -7,5 +7,6 @@ typedef enum {
     AERR_MALFORMED  = -2,
     AERR_UNRESOLVED = -3,
     AERR_RUNTIME    = -4,
-    AERR_TIMEOUT    = -5
+    AERR_TIMEOUT    = -5,
+    AERR_IO         = -6
 } aerror_t;
\ No newline at end of file
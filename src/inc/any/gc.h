@@ -7,32 +7,104 @@
 extern "C" {
 #endif
 
-/// Initialize as a new garbage collector.
+/// Default heap sizing policy, start with `heap_cap` bytes.
+static AINLINE agc_policy_t agc_default_policy(aint_t heap_cap)
+{
+    agc_policy_t p;
+    p.min_heap_cap = heap_cap;
+    p.large_threshold = 4096;
+    p.shrink_percent = 25;
+    p.shrink_cycles = 4;
+    p.grow_percent = 75;
+    return p;
+}
+
+/** Initialize as a new garbage collector.
+\brief Heap sizing policy is \ref agc_default_policy of `heap_cap`.
+*/
 ANY_API aerror_t agc_init(
     agc_t* self, aint_t heap_cap, aalloc_t alloc, void* alloc_ud);
 
 /// Release all dynamic allocated object.
 ANY_API void agc_cleanup(agc_t* self);
 
+/** Allocate large objects by `alloc` instead.
+\brief Allocators rounding sizes up, like \ref aheap_pool_alloc, would make
+the large object space budget understate the memory taken.
+\note Must be called before the first large object is allocated.
+*/
+static AINLINE void agc_large_alloc(agc_t* self, aalloc_t alloc, void* ud)
+{
+    self->large_alloc = alloc;
+    self->large_alloc_ud = ud;
+}
+
 /** Allocate a new collectable object.
 \brief Returns the `heap_idx` of allocated object, negative value if failed.
+Large objects also fail when the large object space exceeds its budget, which
+is reset to twice of the surviving large objects by each collection.
 */
 ANY_API aint_t agc_alloc(agc_t* self, atype_t type, aint_t sz);
 
-/// Ensures that there are `more` bytes in the heap.
+/** Ensures that there are `more` bytes in the heap.
+\brief For a large object, raise the large object space budget instead.
+*/
 ANY_API aerror_t agc_reserve(agc_t* self, aint_t more);
 
 /** Reclaim unreferenced objects.
 \brief `root` must be NULL terminated.
+The heap may be resized afterward, according to `self->policy`.
 */
 ANY_API void agc_collect(agc_t* self, avalue_t** roots, aint_t* num_roots);
 
+/** Release unused heap capacity, should be called right after a collection.
+\brief The heap is halved while live objects take at most half of it, and it
+is still not smaller than `self->policy.min_heap_cap`.
+*/
+ANY_API void agc_shrink(agc_t* self);
+
+/** Replace the heap sizing policy.
+\note Percentages are clamped to [0, 100]. Whatever `shrink_percent` is, the
+heap only shrinks while live objects fit in half of it.
+*/
+static AINLINE void agc_set_policy(agc_t* self, const agc_policy_t* policy)
+{
+    agc_policy_t* const p = &self->policy;
+    *p = *policy;
+    if (p->shrink_percent < 0) p->shrink_percent = 0;
+    if (p->shrink_percent > 100) p->shrink_percent = 100;
+    if (p->grow_percent < 0) p->grow_percent = 0;
+    if (p->grow_percent > 100) p->grow_percent = 100;
+    self->sparse_cycles = 0;
+}
+
+/// Get statistics, the heap size high-water mark also covers current heap.
+static AINLINE const agc_stats_t* agc_stats(agc_t* self)
+{
+    if (self->heap_sz > self->stats.heap_sz_high_water) {
+        self->stats.heap_sz_high_water = self->heap_sz;
+    }
+    return &self->stats;
+}
+
+/** Accumulate `other` into `self`.
+\brief Counters and `heap_cap` are summed, maximums and high-water marks are
+the greater of both.
+*/
+ANY_API void agc_stats_merge(agc_stats_t* self, const agc_stats_t* other);
+
 /// Get current heap size.
 static AINLINE aint_t agc_heap_size(agc_t* self)
 {
     return self->heap_sz;
 }
 
+/// Get current heap capacity.
+static AINLINE aint_t agc_heap_capacity(agc_t* self)
+{
+    return self->heap_cap;
+}
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+#include <any/actor.h>
+#include <any/gc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Push new empty array with capacity of `cap` values onto the stack.
+ANY_API void any_push_array(aactor_t* a, aint_t cap);
+
+/** Set `i`th element of the array at absolute stack index `arr`.
+\brief `value` is also an absolute stack index, both are safe to gc. Setting
+at `i` equals to the array size appends, the array grows if necessary.
+*/
+ANY_API void agc_array_set(aactor_t* a, aint_t arr, aint_t i, aint_t value);
+
+/// Get array values, available until next gc.
+static AINLINE avalue_t* agc_array_values(agc_t* gc, agc_array_t* o)
+{
+    return AGC_CAST(avalue_t, gc, av_heap_idx(&o->buff));
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -27,6 +27,7 @@ static AINLINE aint_t agc_buffer_new(agc_t* gc, aint_t cap, avalue_t* v)
         agc_buffer_t* o = AGC_CAST(agc_buffer_t, gc, oi);
         aint_t bi = agc_fixed_buffer_new(gc, cap, &o->buff);
         if (bi < 0) return bi;
+        o->off = 0;
         o->cap = cap;
         o->sz = 0;
         av_collectable(v, AVT_BUFFER, oi);
@@ -34,13 +35,39 @@ static AINLINE aint_t agc_buffer_new(agc_t* gc, aint_t cap, avalue_t* v)
     }
 }
 
-/// Push new buffer onto the stack.
-static AINLINE void any_push_buffer(aactor_t* a, aint_t cap)
+/// Push new empty buffer with capacity of `cap` bytes onto the stack.
+ANY_API void any_push_buffer(aactor_t* a, aint_t cap);
+
+/** Make sure the buffer at absolute stack index `buf` has room for `more`.
+\brief The capacity at least doubles, appending byte by byte is amortized
+constant. Growing a view copies its bytes into a buffer of its own.
+*/
+ANY_API void agc_buffer_reserve(aactor_t* a, aint_t buf, aint_t more);
+
+/** Append `sz` bytes to the buffer at absolute stack index `buf`.
+\note `data` must not point into the gc heap, use `agc_buffer_append_value`
+to append collectable bytes.
+*/
+ANY_API void agc_buffer_append(
+    aactor_t* a, aint_t buf, const void* data, aint_t sz);
+
+/** Append value at absolute stack index `value` to the buffer `buf`.
+\brief Appends the bytes of a buffer or a string, or a single byte of an
+integer. Both indices are safe to gc.
+*/
+ANY_API void agc_buffer_append_value(aactor_t* a, aint_t buf, aint_t value);
+
+/** Push a view of bytes `[from, to)` of the buffer `buf` onto the stack.
+\brief The view shares the bytes without copying, they are kept alive as long
+as the view is reachable.
+*/
+ANY_API void any_push_buffer_view(
+    aactor_t* a, aint_t buf, aint_t from, aint_t to);
+
+/// Get buffer bytes, available until next gc.
+static AINLINE uint8_t* agc_buffer_data(agc_t* gc, agc_buffer_t* o)
 {
-    avalue_t v;
-    aint_t ec = agc_buffer_new(&a->gc, cap, &v);
-    if (ec != AERR_NONE) any_error(a, (aerror_t)ec, "not enough memory");
-    aactor_push(a, &v);
+    return AGC_CAST(uint8_t, gc, av_heap_idx(&o->buff)) + o->off;
 }
 
 /// Get buffer pointer, available until next gc.
@@ -48,8 +75,15 @@ static AINLINE uint8_t* any_to_buffer(aactor_t* a, aint_t idx)
 {
     agc_buffer_t* b;
     avalue_t* v = aactor_at(a, aactor_absidx(a, idx));
-    b = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
-    return AGC_CAST(uint8_t, &a->gc, b->buff.v.heap_idx);
+    b = AGC_CAST(agc_buffer_t, &a->gc, av_heap_idx(v));
+    return agc_buffer_data(&a->gc, b);
+}
+
+/// Get buffer size in bytes.
+static AINLINE aint_t any_buffer_size(aactor_t* a, aint_t idx)
+{
+    avalue_t* v = aactor_at(a, aactor_absidx(a, idx));
+    return AGC_CAST(agc_buffer_t, &a->gc, av_heap_idx(v))->sz;
 }
 
 #ifdef __cplusplus
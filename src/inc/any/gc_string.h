@@ -40,7 +40,7 @@ static AINLINE void any_push_string(aactor_t* a, const char* s)
 /// Get NULL terminated string pointer, available until next gc.
 static AINLINE const char* agc_string_to_cstr(aactor_t* a, avalue_t* v)
 {
-    agc_string_t* s = AGC_CAST(agc_string_t, &a->gc, v->v.heap_idx);
+    agc_string_t* s = AGC_CAST(agc_string_t, &a->gc, av_heap_idx(v));
     return (const char*)(s + 1);
 }
 
@@ -0,0 +1,35 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+#include <any/actor.h>
+#include <any/gc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Push new empty table which can hold `cap` entries without growing.
+ANY_API void any_push_table(aactor_t* a, aint_t cap);
+
+/** Lookup for `key` in table `t`.
+\return NULL if not found, otherwise the value, available until next gc.
+*/
+ANY_API avalue_t* agc_table_find(
+    aactor_t* a, const avalue_t* t, const avalue_t* key);
+
+/** Set `t[key] = value`, a nil `value` removes the key.
+\brief `t`, `key` and `value` are absolute stack indices, that is safe to gc.
+Nil, NaN and collectable keys other than string are rejected.
+*/
+ANY_API void agc_table_set(aactor_t* a, aint_t t, aint_t key, aint_t value);
+
+/// Get table entries, available until next gc.
+static AINLINE agc_table_entry_t* agc_table_entries(agc_t* gc, agc_table_t* o)
+{
+    return AGC_CAST(agc_table_entry_t, gc, av_heap_idx(&o->buff));
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
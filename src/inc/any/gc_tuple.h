@@ -0,0 +1,27 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+#include <any/actor.h>
+#include <any/gc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Create a new tuple of `sz` nil values.
+ANY_API aint_t agc_tuple_new(aactor_t* a, aint_t sz, avalue_t* v);
+
+/// Pop `sz` values from the stack and push a new tuple of them.
+ANY_API void any_push_tuple(aactor_t* a, aint_t sz);
+
+/// Get tuple values, available until next gc.
+static AINLINE avalue_t* agc_tuple_values(agc_t* gc, agc_tuple_t* o)
+{
+    (void)gc;
+    return (avalue_t*)(o + 1);
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,24 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Initialize as a new empty pool.
+ANY_API void aheap_pool_init(
+    aheap_pool_t* self, aint_t max_retained, aalloc_t alloc, void* alloc_ud);
+
+/// Release all retained segments.
+ANY_API void aheap_pool_cleanup(aheap_pool_t* self);
+
+/** Allocator interface backed by the pool, `ud` must be the pool itself.
+\brief Please refer \ref aalloc_t.
+*/
+ANY_API void* aheap_pool_alloc(void* ud, void* old, aint_t sz);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
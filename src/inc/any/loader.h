@@ -18,16 +18,78 @@ static AINLINE void aloader_on_unresolved(
     aloader_t* self, aon_unresolved_t handler)
 {
     self->on_unresolved = handler;
+}
+
+/** Run linking phases across a worker pool.
+\brief Prototypes of pending chunks are created and their imports resolved by
+`parallel_for`, one iteration per chunk. Errors and rollback are the same as
+linking serially, which is the default if `parallel_for` is NULL.
+*/
+static AINLINE void aloader_parallel(
+    aloader_t* self, aparallel_for_t parallel_for, void* ud)
+{
+    self->parallel_for = parallel_for;
+    self->parallel_for_ud = ud;
+}
+
+/** Resolve imports on first use instead of at linking.
+\brief Linking does not fail on unresolved imports anymore, loading one raises
+`AERR_UNRESOLVED` in the actor instead.
+*/
+static AINLINE void aloader_lazy(aloader_t* self, int32_t lazy)
+{
+    self->lazy = lazy;
+}
+
+/** Map chunk and bundle files read-only instead of reading them.
+\brief Prototypes are built right over the mapping, so processes loading the
+same file share its pages. Where memory mapping is not supported, files are
+still read.
+\note Mapped files must not change as long as their chunks are loaded, replace
+them by an atomic rename only. Writing over a mapped file changes the code
+which actors run without being checked again, and truncating it crashes them.
+*/
+static AINLINE void aloader_map_files(aloader_t* self, int32_t map)
+{
+    self->map_files = map;
 }
 
 /** Add new byte code chunk to `pendings` list.
+\brief Sections, string references and instruction operands are checked to be
+in range, `AERR_MALFORMED` is returned otherwise. The dispatcher trusts loaded
+chunks.
 \note `chunk_alloc` is optional, used to free `chunk` if necessary.
 */
 ANY_API aerror_t aloader_add_chunk(
     aloader_t* self, achunk_header_t* chunk, aint_t chunk_sz,
     aalloc_t chunk_alloc, void* chunk_alloc_ud);
 
-/// Add new native lib module.
+/** Add the chunk stored in file `path` to `pendings` list.
+\brief The file is read into memory allocated by `self`, or mapped if
+\ref aloader_map_files is set.
+\note Returns `AERR_IO` if the file can't be opened, read or mapped.
+*/
+ANY_API aerror_t aloader_add_chunk_file(aloader_t* self, const char* path);
+
+/** Add every chunks of `bundle` to `pendings` list.
+\brief Chunks are used in place, `bundle_alloc` is optional, used to free
+`bundle` along with the last chunk. Either all chunks are added or none.
+\note Link once after adding bundles, to resolve them all in a single pass.
+*/
+ANY_API aerror_t aloader_add_bundle(
+    aloader_t* self, abundle_header_t* bundle, aint_t bundle_sz,
+    aalloc_t bundle_alloc, void* bundle_alloc_ud);
+
+/** Add the bundle stored in file `path`.
+\brief The file is loaded as same as \ref aloader_add_chunk_file.
+*/
+ANY_API aerror_t aloader_add_bundle_file(aloader_t* self, const char* path);
+
+/** Add new native lib module.
+\brief Functions of `lib` are indexed right away, links do not index them
+again.
+\note `lib` must stay alive and unchanged as long as the loader.
+*/
 ANY_API void aloader_add_lib(aloader_t* self, alib_t* lib);
 
 /** Link chunks of byte code together.
@@ -35,10 +97,26 @@ ANY_API void aloader_add_lib(aloader_t* self, alib_t* lib);
 */
 ANY_API aerror_t aloader_link(aloader_t* self, int32_t safe);
 
+/** Resolve import `idx` of `p` which is left as nil by lazy linking.
+\brief `on_unresolved` is called if the symbol can not be found.
+*/
+ANY_API aerror_t aloader_resolve(aloader_t* self, aprototype_t* p, aint_t idx);
+
 /// Free chunks in `garbages` list that are not marked for `retain`.
 ANY_API void aloader_sweep(aloader_t* self);
 
-/// Lookup for a module level symbol.
+/** Free garbage chunks which are older than `epoch` and not marked for `retain`.
+\brief Schedulers pass the oldest `code_epoch` of their actors, please refer
+\ref aloader_t.
+\note Chunks replaced by a failed unsafe link have no epoch, they are only
+freed by \ref aloader_sweep.
+*/
+ANY_API void aloader_reclaim(aloader_t* self, aint_t epoch);
+
+/** Lookup for a module level symbol.
+\brief Native libs are searched first, then `running` chunks, both are indexed
+by a hash table so lookup doesn't depend on the number of modules.
+*/
 ANY_API aerror_t aloader_find(
     aloader_t* self, const char* module, const char* name, avalue_t* value);
 
@@ -33,7 +33,13 @@ typedef enum {
     AOC_SND = 50,
     AOC_RCV = 51,
     AOC_RMV = 52,
-    AOC_RWD = 53
+    AOC_RWD = 53,
+
+    AOC_TUP = 60,
+    AOC_ARR = 61,
+    AOC_TBL = 62,
+    AOC_GET = 63,
+    AOC_SET = 64
 } aopcode_t;
 
 /** Base type.
@@ -314,6 +320,77 @@ typedef struct {
     uint32_t _;
 } ai_rwd_t;
 
+/** Pop `n` values from the stack and push a tuple of them.
+\brief The first pushed value becomes element 0.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_TUP  n
+=======  =======
+\endrst
+*/
+typedef struct {
+    uint32_t _ : 8;
+    int32_t n : 24;
+} ai_tup_t;
+
+/** Push a new empty array with capacity of `cap` elements.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_ARR  cap
+=======  =======
+\endrst
+*/
+typedef struct {
+    uint32_t _ : 8;
+    int32_t cap : 24;
+} ai_arr_t;
+
+/** Push a new empty table with capacity of `cap` entries.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_TBL  cap
+=======  =======
+\endrst
+*/
+typedef struct {
+    uint32_t _ : 8;
+    int32_t cap : 24;
+} ai_tbl_t;
+
+/** Pop a key and next a collection from the stack, push `collection[key]`.
+\brief Please refer \ref any_get.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_GET  _
+=======  =======
+\endrst
+*/
+typedef struct {
+    uint32_t _;
+} ai_get_t;
+
+/** Pop a value and next a key from the stack, set `collection[key] = value`.
+\brief The collection is left on top of the stack, please refer \ref any_set.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_SET  _
+=======  =======
+\endrst
+*/
+typedef struct {
+    uint32_t _;
+} ai_set_t;
+
 /// Variant of instruction types, instruction size is fixed 4 bytes.
 typedef union {
     ai_base_t b;
@@ -335,6 +412,11 @@ typedef union {
     ai_rcv_t rcv;
     ai_rmv_t rmv;
     ai_rwd_t rwd;
+    ai_tup_t tup;
+    ai_arr_t arr;
+    ai_tbl_t tbl;
+    ai_get_t get;
+    ai_set_t set;
 } ainstruction_t;
 
 ASTATIC_ASSERT(sizeof(ainstruction_t) == 4);
@@ -478,6 +560,44 @@ static AINLINE ainstruction_t ai_rwd()
     return i;
 }
 
+static AINLINE ainstruction_t ai_tup(aint_t n)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_TUP;
+    i.tup.n = (int32_t)n;
+    return i;
+}
+
+static AINLINE ainstruction_t ai_arr(aint_t cap)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_ARR;
+    i.arr.cap = (int32_t)cap;
+    return i;
+}
+
+static AINLINE ainstruction_t ai_tbl(aint_t cap)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_TBL;
+    i.tbl.cap = (int32_t)cap;
+    return i;
+}
+
+static AINLINE ainstruction_t ai_get()
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_GET;
+    return i;
+}
+
+static AINLINE ainstruction_t ai_set()
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_SET;
+    return i;
+}
+
 /** Allocator interface.
 \brief
 `old` = 0 to malloc,
@@ -602,6 +722,146 @@ typedef struct {
     int8_t _[2];
 } avalue_tag_t;
 
+#ifdef ANY_NAN_BOXING
+
+/** Tagged value, NaN-boxed into 8 bytes.
+\brief
+Reals are stored as is, NaNs are canonicalized to `AV_NAN`. Other values are
+quiet NaNs with a 4 bits tag, which is `type + 1`, in the sign bit and bits
+48..50, and a 48 bits payload.
+\note Integers are sign extended from 48 bits, pointers must fit in 48 bits.
+*/
+typedef struct {
+    uint64_t bits;
+} avalue_t;
+
+ASTATIC_ASSERT(sizeof(avalue_t) == 8);
+
+#define AV_QNAN ((uint64_t)0x7FF8000000000000ULL)
+#define AV_NAN AV_QNAN
+#define AV_PAYLOAD_MASK ((uint64_t)0x0000FFFFFFFFFFFFULL)
+
+static AINLINE int32_t av_tag_bits(const avalue_t* v)
+{
+    if ((v->bits & AV_QNAN) != AV_QNAN) return 0;
+    return (int32_t)(((v->bits >> 60) & 0x8) | ((v->bits >> 48) & 0x7));
+}
+
+static AINLINE void av_box(avalue_t* v, atype_t type, uint64_t payload)
+{
+    uint64_t tag = (uint64_t)type + 1;
+    v->bits = AV_QNAN | ((tag & 0x8) << 60) | ((tag & 0x7) << 48) |
+        (payload & AV_PAYLOAD_MASK);
+}
+
+static AINLINE uint64_t av_payload(const avalue_t* v)
+{
+    return v->bits & AV_PAYLOAD_MASK;
+}
+
+// Value accessors.
+static AINLINE atype_t av_type(const avalue_t* v)
+{
+    int32_t tag = av_tag_bits(v);
+    return tag == 0 ? AVT_REAL : (atype_t)(tag - 1);
+}
+
+static AINLINE int32_t av_is_collectable(const avalue_t* v)
+{
+    return av_type(v) >= AVT_FIXED_BUFFER;
+}
+
+static AINLINE apid_t av_to_pid(const avalue_t* v)
+{
+    return (apid_t)(uint32_t)av_payload(v);
+}
+
+static AINLINE int32_t av_to_boolean(const avalue_t* v)
+{
+    return (int32_t)av_payload(v);
+}
+
+static AINLINE void* av_to_pointer(const avalue_t* v)
+{
+    return (void*)(size_t)av_payload(v);
+}
+
+static AINLINE aint_t av_to_integer(const avalue_t* v)
+{
+    return ((aint_t)(v->bits << 16)) >> 16;
+}
+
+static AINLINE areal_t av_to_real(const avalue_t* v)
+{
+    areal_t r;
+    memcpy(&r, &v->bits, sizeof(r));
+    return r;
+}
+
+static AINLINE anative_func_t av_to_native_func(const avalue_t* v)
+{
+    return (anative_func_t)(size_t)av_payload(v);
+}
+
+static AINLINE struct aprototype_t* av_to_byte_code_func(const avalue_t* v)
+{
+    return (struct aprototype_t*)(size_t)av_payload(v);
+}
+
+static AINLINE aint_t av_heap_idx(const avalue_t* v)
+{
+    return (aint_t)av_payload(v);
+}
+
+// Value constructors.
+static AINLINE void av_nil(avalue_t* v)
+{
+    av_box(v, AVT_NIL, 0);
+}
+
+static AINLINE void av_pid(avalue_t* v, apid_t pid)
+{
+    av_box(v, AVT_PID, (uint32_t)pid);
+}
+
+static AINLINE void av_boolean(avalue_t* v, int32_t b)
+{
+    av_box(v, AVT_BOOLEAN, (uint32_t)b);
+}
+
+static AINLINE void av_pointer(avalue_t* v, void* p)
+{
+    av_box(v, AVT_POINTER, (uint64_t)(size_t)p);
+}
+
+static AINLINE void av_integer(avalue_t* v, aint_t i)
+{
+    av_box(v, AVT_INTEGER, (uint64_t)i);
+}
+
+static AINLINE void av_real(avalue_t* v, areal_t r)
+{
+    if (r != r) v->bits = AV_NAN;
+    else memcpy(&v->bits, &r, sizeof(r));
+}
+
+static AINLINE void av_native_func(avalue_t* v, anative_func_t f)
+{
+    av_box(v, AVT_NATIVE_FUNC, (uint64_t)(size_t)f);
+}
+
+static AINLINE void av_byte_code_func(avalue_t* v, struct aprototype_t* f)
+{
+    av_box(v, AVT_BYTE_CODE_FUNC, (uint64_t)(size_t)f);
+}
+
+static AINLINE void av_collectable(avalue_t* v, atype_t type, aint_t heap_idx)
+{
+    av_box(v, type, (uint64_t)heap_idx);
+}
+
+#else
+
 /// Tagged value.
 typedef struct {
     avalue_tag_t tag;
@@ -625,6 +885,57 @@ typedef struct {
     } v;
 } avalue_t;
 
+// Value accessors.
+static AINLINE atype_t av_type(const avalue_t* v)
+{
+    return (atype_t)v->tag.type;
+}
+
+static AINLINE int32_t av_is_collectable(const avalue_t* v)
+{
+    return v->tag.collectable;
+}
+
+static AINLINE apid_t av_to_pid(const avalue_t* v)
+{
+    return v->v.pid;
+}
+
+static AINLINE int32_t av_to_boolean(const avalue_t* v)
+{
+    return v->v.boolean;
+}
+
+static AINLINE void* av_to_pointer(const avalue_t* v)
+{
+    return v->v.ptr;
+}
+
+static AINLINE aint_t av_to_integer(const avalue_t* v)
+{
+    return v->v.integer;
+}
+
+static AINLINE areal_t av_to_real(const avalue_t* v)
+{
+    return v->v.real;
+}
+
+static AINLINE anative_func_t av_to_native_func(const avalue_t* v)
+{
+    return v->v.func;
+}
+
+static AINLINE struct aprototype_t* av_to_byte_code_func(const avalue_t* v)
+{
+    return v->v.avm_func;
+}
+
+static AINLINE aint_t av_heap_idx(const avalue_t* v)
+{
+    return v->v.heap_idx;
+}
+
 // Value constructors.
 static AINLINE void av_nil(avalue_t* v)
 {
@@ -688,30 +999,193 @@ static AINLINE void av_collectable(avalue_t* v, atype_t type, aint_t heap_idx)
     v->v.heap_idx = heap_idx;
 }
 
-/// Garbage collector.
+#endif // ANY_NAN_BOXING
+
+/// Get the value tag, which is synthesized in NaN-boxing builds.
+static AINLINE avalue_tag_t av_tag(const avalue_t* v)
+{
+    avalue_tag_t t;
+    t.type = (int8_t)av_type(v);
+    t.collectable = (int8_t)av_is_collectable(v);
+    t._[0] = t._[1] = 0;
+    return t;
+}
+
+/** Garbage collector heap sizing policy.
+\brief
+Evaluated after each collection. The heap grows proactively if live objects
+occupy more than `grow_percent` of the capacity, that means the next collection
+would come too soon. And it shrinks by half if the live objects stay below
+`shrink_percent` for `shrink_cycles` consecutive collections.
+Objects of at least `large_threshold` bytes are not placed in the heap, please
+refer \ref agc_large_t.
+\note Set `shrink_percent` to 0 to disable shrinking, `grow_percent` to 100 to
+disable proactive growing, `large_threshold` to 0 to disable large objects.
+*/
+typedef struct {
+    /// Initial capacity, the heap never shrinks below this.
+    aint_t min_heap_cap;
+    aint_t large_threshold;
+    int32_t shrink_percent;
+    int32_t shrink_cycles;
+    int32_t grow_percent;
+} agc_policy_t;
+
+enum { AHEAP_POOL_NUM_CLASSES = 48 };
+
+/** Pool of heap segments, shared by actors of the same scheduler.
+\brief
+Segments are rounded up to power of two size classes. Released segments are
+kept in per class free lists, up to `max_retained` bytes in total. Therefore,
+actors which are spawned then exit, or resize their heaps, reuse segments
+instead of going through the backing allocator.
+*/
+typedef struct {
+    aalloc_t alloc;
+    void* alloc_ud;
+    void* free_lists[AHEAP_POOL_NUM_CLASSES];
+    aint_t retained;
+    aint_t max_retained;
+} aheap_pool_t;
+
+enum { AALLOCATOR_NUM_CLASSES = 8 };
+
+/** Allocator statistics.
+\brief `in_use` counts usable bytes of live blocks, the `*_bytes` counters are
+bytes currently obtained for slabs, big blocks and huge pages.
+*/
+typedef struct {
+    aint_t allocs;
+    aint_t frees;
+    aint_t in_use;
+    aint_t in_use_high_water;
+    aint_t slab_bytes;
+    aint_t large_bytes;
+    aint_t huge_bytes;
+} aallocator_stats_t;
+
+/** Size class allocator, implements \ref aalloc_t on top of another one.
+\brief
+Blocks up to 2 KiB are rounded up to power of two classes and carved out of
+64 KiB slabs, freed blocks go to per class free lists and are never given back
+before cleanup. Bigger blocks go to the backing allocator, or to huge pages if
+they are at least `huge_threshold` bytes.
+\note Not thread safe, each scheduler thread should own its allocator.
+*/
+typedef struct {
+    aalloc_t alloc;
+    void* alloc_ud;
+    void* free_lists[AALLOCATOR_NUM_CLASSES];
+    void* slabs;
+    uint8_t* slab_cur;
+    uint8_t* slab_end;
+    aint_t huge_threshold;
+    aallocator_stats_t stats;
+} aallocator_t;
+
+/** Bump pointer arena, implements \ref aalloc_t on top of another one.
+\brief
+Blocks are never freed individually, \ref aarena_reset releases all of them at
+once. Good for short-lived scopes which allocate a lot, like assembling or
+loading a chunk.
+*/
+typedef struct {
+    aalloc_t alloc;
+    void* alloc_ud;
+    void* chunks;
+    uint8_t* cur;
+    uint8_t* end;
+    uint8_t* last;
+    aint_t reserved;
+} aarena_t;
+
+enum { AGC_PAUSE_BUCKETS = 32 };
+
+/** Garbage collector statistics.
+\brief
+Counters are accumulated since the collector was initialized. A collection that
+took `n` nanoseconds is counted in `pause_histogram[floor(log2(n))]`, the last
+bucket also counts all longer pauses. `bytes_copied` is the total of surviving
+bytes, which are copied to the other semispace by collections.
+*/
+typedef struct {
+    aint_t collections;
+    aint_t pause_total_nsecs;
+    aint_t pause_max_nsecs;
+    aint_t pause_histogram[AGC_PAUSE_BUCKETS];
+    aint_t bytes_copied;
+    aint_t grows;
+    aint_t shrinks;
+    aint_t heap_cap;
+    aint_t heap_cap_high_water;
+    aint_t heap_sz_high_water;
+} agc_stats_t;
+
+/** Large object space slot.
+\brief
+Large objects are allocated individually and never moved by the collector, they
+are referred by `AGC_LARGE_BIT | slot` instead of a heap offset. Collections
+only mark reachable large objects, then free the others. `next` links free slots
+together, or marked objects which are not yet scanned during a collection.
+*/
+typedef struct {
+    struct agc_header_t* obj;
+    aint_t next;
+} agc_large_t;
+
+/** Garbage collector.
+\note `code_epoch` is lowered to the oldest garbage chunk epoch of byte code
+functions which are copied by a collection. Large objects are allocated by
+`large_alloc`, which is `alloc` unless \ref agc_large_alloc is called.
+*/
 typedef struct {
     aalloc_t alloc;
     void* alloc_ud;
+    aalloc_t large_alloc;
+    void* large_alloc_ud;
     uint8_t* cur_heap;
     uint8_t* new_heap;
     aint_t heap_cap;
     aint_t heap_sz;
     aint_t scan;
+    agc_policy_t policy;
+    int32_t sparse_cycles;
+    agc_stats_t stats;
+    agc_large_t* los;
+    aint_t los_cap;
+    aint_t los_free;
+    aint_t los_gray;
+    aint_t los_sz;
+    aint_t los_budget;
+    aint_t code_epoch;
 } agc_t;
 
 /// Collectable value header.
-typedef struct {
+typedef struct agc_header_t {
     atype_t type;
     aint_t sz;
     aint_t forwared;
 } agc_header_t;
 
+/// Tag of references to \ref agc_large_t slots.
+#define AGC_LARGE_BIT ((aint_t)1 << 47)
+
+#define AGC_HEADER(gc, idx) \
+    (((idx) & AGC_LARGE_BIT) \
+        ? (gc)->los[(idx) ^ AGC_LARGE_BIT].obj \
+        : (agc_header_t*)((gc)->cur_heap + (idx)))
+
 #define AGC_CAST(T, gc, idx) \
-    ((T*)((gc)->cur_heap + idx + sizeof(agc_header_t)))
+    ((T*)(AGC_HEADER(gc, idx) + 1))
 
-/// Collectable buffer.
+/** Collectable buffer.
+\brief Bytes `[off, off + sz)` of the fixed buffer `buff` are in use, `cap`
+counts from `off`. Views share `buff` with their origin and have `cap == sz`,
+so appending to a view copies it first.
+*/
 typedef struct {
     avalue_t buff;
+    aint_t off;
     aint_t cap;
     aint_t sz;
 } agc_buffer_t;
@@ -727,24 +1201,36 @@ typedef struct {
     ahash_and_length_t hal;
 } agc_string_t;
 
-/// Collectable tuple.
+/// Collectable tuple, `sz` values are stored right after this header.
 typedef struct {
     aint_t sz;
 } agc_tuple_t;
 
-/// Collectable array.
+/// Collectable array, values are stored contiguously in `buff`.
 typedef struct {
     avalue_t buff;
     aint_t cap;
     aint_t sz;
 } agc_array_t;
 
-/// Collectable map.
+/// Table entry, an empty slot has a nil key.
+typedef struct {
+    avalue_t key;
+    avalue_t value;
+} agc_table_entry_t;
+
+/** Collectable table.
+\brief
+Open addressing with linear probing, `buff` is a power of two `cap` sized array
+of \ref agc_table_entry_t. String keys are placed by their cached hash. Removed
+entries are back shifted, so there is no tombstone and probing always stops at
+the first empty slot.
+*/
 typedef struct {
     avalue_t buff;
     aint_t cap;
     aint_t sz;
-} agc_map_t;
+} agc_table_t;
 
 #pragma pack(push, 1)
 
@@ -790,6 +1276,44 @@ typedef struct APACKED {
 
 ASTATIC_ASSERT(sizeof(achunk_header_t) == 12);
 
+#define ABUNDLE_ALIGN 16
+
+/** Module bundle.
+\brief Layout: [`header`] [`entries`] [`strings`] [`chunks`].
+Bundle packs many byte code chunks in a single blob, so a large application can
+be mapped at once and linked in one pass. Each entry of the table of contents
+refers to a chunk and its module name in the shared `strings` pool. Chunks are
+regular byte code chunks, which start at a `ABUNDLE_ALIGN` bytes boundary.
+\par Header format.
+\rst
+=====  ===================  ===================
+bytes  description          value
+=====  ===================  ===================
+4      signature            0x41 0x6E 0x79 0x42
+4      num of chunks        _
+4      num of string bytes  _
+4      _                    _
+=====  ===================  ===================
+\endrst
+*/
+typedef struct {
+    uint8_t signature[4];
+    uint32_t num_chunks;
+    uint32_t strings_sz;
+    uint32_t _;
+} abundle_header_t;
+
+/// Bundle entry, `offset` is relative to the bundle header.
+typedef struct {
+    uint32_t name;
+    uint32_t _;
+    uint64_t offset;
+    uint64_t size;
+} abundle_entry_t;
+
+ASTATIC_ASSERT(sizeof(abundle_header_t) == 16);
+ASTATIC_ASSERT(sizeof(abundle_entry_t) == 24);
+
 /// Function import.
 typedef struct {
     aint_t module;
@@ -882,20 +1406,64 @@ typedef struct aprototype_t {
     avalue_t* import_values;
 } aprototype_t;
 
-/// Runtime byte code chunk.
+/** Import slot which is bound to a byte code function.
+\brief The slot is linked into `dependents` of the exporting chunk, so reloading
+that chunk only re-resolves its own importers.
+*/
+typedef struct {
+    aprototype_t* proto;
+    aint_t idx;
+    alist_node_t node;
+} aimport_link_t;
+
+/** Runtime byte code chunk.
+\note `links` are parallel to `imports`, `epoch` is the loader epoch at which
+the chunk became garbage, 0 otherwise.
+*/
 typedef struct achunk_t {
     achunk_header_t* header;
     aalloc_t alloc;
     void* alloc_ud;
     avalue_t* imports;
+    aimport_link_t* links;
+    aint_t num_imports;
     aprototype_t* prototypes;
+    alist_t dependents;
     alist_node_t node;
     int32_t retain;
+    aint_t epoch;
 } achunk_t;
 
 /// On linking failed handler.
 typedef void(*aon_unresolved_t)(const char* m, const char* n);
 
+/// Parallel task, `i` is the index of the iteration.
+typedef void(*aparallel_task_t)(void* ud, aint_t i);
+
+/** Run `task` for every `i` in [0, `n`) and return when all are done.
+\note Iterations may run concurrently and in any order.
+*/
+typedef void(*aparallel_for_t)(
+    void* ud, aint_t n, aparallel_task_t task, void* task_ud);
+
+/** Loader symbol, keyed by module and name.
+\note `module` is NULL for empty slots.
+*/
+typedef struct {
+    uint32_t module_hash;
+    uint32_t name_hash;
+    const char* module;
+    const char* name;
+    avalue_t value;
+} asymbol_t;
+
+/// Open addressing symbol table, `cap` is 0 or a power of two.
+typedef struct {
+    asymbol_t* slots;
+    aint_t num;
+    aint_t cap;
+} asymbol_table_t;
+
 /** Byte code loader.
 \brief
 AVM byte code loading and linking is done by `aloader_t`, with heavily focused
@@ -908,6 +1476,20 @@ latest chunks are stored, `aloader_find` will try to search in there. The last
 state is `garbage`, as the name suggested, is out-of-date but still be there so
 already referenced may continue to work. `aloader_sweep` could be used to free
 these chunks.
+
+Every link which replaces chunks starts a new `epoch`, replaced chunks are
+stamped with it. Actors keep the oldest epoch of garbage they may still refer
+to, so `aloader_reclaim` frees old code once no actor goes back that far.
+
+Symbols exported by native libs are indexed once in `natives` as libs are
+added, symbols of `running` chunks are indexed in `symbols` which is rebuilt
+by every link. Native symbols take over byte code ones.
+
+In `lazy` mode, imports of newly linked chunks are left as nil and resolved by
+the first \ref AOC_IMP which loads them, unresolved imports are reported then.
+
+Chunk and bundle files are read into memory unless `map_files` is set, please
+refer \ref aloader_map_files.
 */
 typedef struct {
     aalloc_t alloc;
@@ -917,6 +1499,13 @@ typedef struct {
     alist_t garbages;
     alist_t libs;
     aon_unresolved_t on_unresolved;
+    aparallel_for_t parallel_for;
+    void* parallel_for_ud;
+    asymbol_table_t natives;
+    asymbol_table_t symbols;
+    aint_t epoch;
+    int32_t lazy;
+    int32_t map_files;
 } aloader_t;
 
 /// Value stack.
@@ -1005,7 +1594,11 @@ typedef struct {
     atask_t task;
 } aprocess_task_t;
 
-/// Light-weight process.
+/** Light-weight process.
+\note `code_scanned` is the loader epoch at which the waiting process was last
+collected to find out the old code it still refers to. `hibernate_in` counts
+down to the hibernation of a process waiting for messages, negative if none.
+*/
 typedef struct {
     int32_t dead;
     apid_t pid;
@@ -1013,11 +1606,31 @@ typedef struct {
     aprocess_task_t ptask;
     aint_t wait_for;
     int32_t msg_wake;
+    aint_t collected_sz;
+    aint_t code_scanned;
+    aint_t hibernate_in;
 } aprocess_t;
 
 /// Fatal error handler.
 typedef void(*aon_panic_t)(struct aactor_t*);
 
+/** Scheduler driven garbage collection.
+\brief
+Actors parked in the waiting list are collected by the scheduler, either once
+each time it runs out of runnable actors and `idle` is set, or as soon as their
+heap occupancy reaches `watermark_percent` when they start waiting or receive a
+message while sleeping. Besides, an actor hibernates, that is a collection
+followed by \ref agc_shrink, once it has been waiting for incoming messages for
+`hibernate_nsecs`, busy actors which keep receiving never do.
+\note Set `watermark_percent` to 0 to disable watermark collection, and
+`hibernate_nsecs` to a negative value to disable hibernation.
+*/
+typedef struct {
+    int32_t idle;
+    int32_t watermark_percent;
+    aint_t hibernate_nsecs;
+} aidle_gc_t;
+
 /** Process scheduler.
 \brief
 AVM is designed to be resumable, that sounds tricky and non-portable at first.
@@ -1026,6 +1639,12 @@ about whether C stack is resumable or not, and if not then what happen. Yielding
 native function and across native function is just mandatory use cases in AVM.
 A new \ref atask_t is required for each new actor. That allows AVM to save the
 context of a actor and comeback later, in native side.
+\note `code_change` is the loader epoch up to which replaced code is left at
+the next receive, please refer \ref ascheduler_code_change. `idle_swept` and
+`swept_epoch` tell whether waiting actors have been swept since the scheduler
+last went idle and since code was last replaced. `oldest_code` caches the
+oldest `code_epoch` of the actors as of loader epoch `oldest_code_at`, which is
+reset whenever an actor exits or a collection changes its `code_epoch`.
 */
 typedef struct ascheduler_t {
     aalloc_t alloc;
@@ -1043,4 +1662,13 @@ typedef struct ascheduler_t {
     atimer_t timer;
     int32_t first_run;
     aon_panic_t on_panic;
+    agc_policy_t gc_policy;
+    aheap_pool_t heap_pool;
+    aidle_gc_t idle_gc;
+    agc_stats_t dead_gc_stats;
+    aint_t code_change;
+    int32_t idle_swept;
+    aint_t swept_epoch;
+    aint_t oldest_code;
+    aint_t oldest_code_at;
 } ascheduler_t;
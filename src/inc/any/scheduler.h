@@ -26,6 +26,40 @@ static AINLINE void ascheduler_on_panic(ascheduler_t* self, aon_panic_t handler)
     self->on_panic = handler;
 }
 
+/** Configure heap sizing policy of actors.
+\brief `policy->min_heap_cap` is also the initial heap capacity.
+\note Only affects actors created after this call.
+*/
+static AINLINE void ascheduler_gc_policy(
+    ascheduler_t* self, const agc_policy_t* policy)
+{
+    self->gc_policy = *policy;
+}
+
+/// Configure scheduler driven garbage collection.
+static AINLINE void ascheduler_idle_gc(
+    ascheduler_t* self, const aidle_gc_t* idle_gc)
+{
+    self->idle_gc = *idle_gc;
+}
+
+/** Limit the total size of unused heap segments retained for reuse.
+\brief Actor heaps and stacks are borrowed from the scheduler heap pool, and
+returned to it on exit or shrink. Segments beyond this limit are released to
+the allocator immediately.
+*/
+static AINLINE void ascheduler_heap_pool_retain(
+    ascheduler_t* self, aint_t max_retained)
+{
+    self->heap_pool.max_retained = max_retained;
+}
+
+/** Aggregate garbage collector statistics of all actors.
+\brief Please refer \ref agc_stats_merge, dead actors are also counted except
+their heap capacity.
+*/
+ANY_API void ascheduler_gc_stats(ascheduler_t* self, agc_stats_t* stats);
+
 /// Release all processes.
 ANY_API void ascheduler_cleanup(ascheduler_t* self);
 
@@ -80,10 +114,22 @@ ANY_API void ascheduler_yield(ascheduler_t* self, aactor_t* a);
 ANY_API void ascheduler_sleep(ascheduler_t* self, aactor_t* a, aint_t nsecs);
 
 /** Wait for incoming message in `nsecs`.
+\brief The actor may hibernate, please refer \ref aidle_gc_t.
 \warning Suspends NOT running actor is undefined.
 */
 ANY_API void ascheduler_wait(ascheduler_t* self, aactor_t* a, aint_t nsecs);
 
+/** Move actors to the code of the last \ref aloader_link.
+\brief Actors running a module function which has been replaced re-enter its
+new version at their next receive, with the same arguments. Actors already
+waiting for messages in such functions are woken up, so that all of them move
+within the next \ref ascheduler_run_once. The new version is found by name,
+functions which are no longer exported keep running the old code.
+\note Locals of the function are dropped, the state to keep must be held by
+the arguments.
+*/
+ANY_API void ascheduler_code_change(ascheduler_t* self);
+
 /// Wake-up this actor if its waiting for incoming message.
 ANY_API void ascheduler_got_new_message(ascheduler_t* self, aactor_t* a);
 
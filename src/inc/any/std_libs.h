@@ -10,6 +10,18 @@ extern "C" {
 ANY_API void astd_lib_add_io(
     aloader_t* l, void(*out)(void*, const char*), void* ud);
 
+/** Add `gc` module, which exposes garbage collector statistics as tables.
+\brief `stats/0` for the calling actor, `total_stats/0` for all actors of its
+scheduler, and `collect/0` to force a collection.
+*/
+ANY_API void astd_lib_add_gc(aloader_t* l);
+
+/** Add `buffer` module, which builds byte buffers.
+\brief `new/1`, `append/2` of a buffer, a string or a byte, `size/1`,
+`slice/3` which shares bytes without copying, and `get/2` of a byte.
+*/
+ANY_API void astd_lib_add_buffer(aloader_t* l);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
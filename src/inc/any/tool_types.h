@@ -64,6 +64,36 @@ typedef struct {
     aint_t max_imports;
 } aasm_prototype_t;
 
+/** Byte code assembler optimization passes.
+\brief Please refer \ref aasm_optimize.
+- `AAOP_THREAD_JUMPS` retargets jumps to JMP at the final destination, and
+turns JMP to the next instruction into NOP.
+- `AAOP_FOLD_LOADS` drops a LDK, NIL, LDB, LSI or LLV followed by POP, which
+pops one less value.
+- `AAOP_DEAD_CODE` turns unreachable instructions into NOP.
+- `AAOP_STRIP_NOPS` removes NOPs and fixes jump displacements up.
+*/
+typedef enum {
+    AAOP_THREAD_JUMPS = 1 << 0,
+    AAOP_FOLD_LOADS = 1 << 1,
+    AAOP_DEAD_CODE = 1 << 2,
+    AAOP_STRIP_NOPS = 1 << 3,
+    AAOP_ALL = 0xF
+} AAOPASSES;
+
+/** Byte code assembler pool entry.
+\brief Indexes a constant or an import of the prototype at `slot` by its
+content. `kind` is the constant type, or -1 for imports, `slot` is -1 for
+empty entries.
+*/
+typedef struct {
+    aint_t slot;
+    aint_t kind;
+    uint64_t a;
+    uint64_t b;
+    aint_t idx;
+} aasm_pool_entry_t;
+
 /// Byte code assembler context.
 typedef struct {
     aint_t slot;
@@ -86,6 +116,11 @@ typedef struct {
     aint_t* nesteds;
 } aasm_current_t;
 
+/** Chunk sink, called by \ref aasm_save_to with consecutive parts of chunk.
+\return AERR_NONE to go on, anything else stops writing.
+*/
+typedef aerror_t (*aasm_write_t)(void* ud, const void* data, aint_t sz);
+
 /** Byte code assembler.
 
 \warning
@@ -99,6 +134,8 @@ functions, use it at your own risk:
 - \ref aasm_reserve
 - \ref aasm_push
 
+Only the current prototype is relocated, the others stay in place.
+
 \brief
 The assembler is context sensitive, which can be used to authoring multiple
 prototypes with just only single instance, in nested manner. Generally, for
@@ -109,6 +146,9 @@ stack, which can be restored later by a corresponding \ref aasm_pop.
 This struct itself is not POD, then must rely on \ref achunk_header_t as the
 portable format for exchanges. That format enable assembler as a **framework**
 to working with byte code between optimization passes.
+
+Constants and imports are deduplicated, adding the same one twice to a
+prototype gives back the index of the first. Chunks are loaded as they are.
 */
 typedef struct {
     // allocator.
@@ -116,16 +156,17 @@ typedef struct {
     void* alloc_ud;
     // common string table.
     astring_table_t* st;
-    // prototype buffers.
-    aint_t* _slots;
+    // prototypes, each one is allocated on its own.
+    aasm_prototype_t** _slots;
     aint_t _num_slots;
     aint_t _max_slots;
-    uint8_t* _buff;
-    aint_t _buff_size;
-    aint_t _buff_capacity;
     // contexts, limited nested level.
     aasm_ctx_t _context[24];
     aint_t _nested_level;
+    // constants and imports by content, open addressing.
+    aasm_pool_entry_t* _pool;
+    aint_t _pool_size;
+    aint_t _pool_capacity;
     // output binary chunk.
     achunk_header_t* chunk;
     aint_t chunk_size;
@@ -5,10 +5,12 @@
 #include <any/scheduler.h>
 #include <any/gc.h>
 #include <any/gc_string.h>
+#include <any/gc_tuple.h>
+#include <any/gc_array.h>
+#include <any/gc_table.h>
 
 #define INIT_STACK_SZ 64
 #define INIT_MSBOX_SZ 32
-#define INIT_HEAP_SZ 512
 
 void actor_dispatch(aactor_t* a);
 
@@ -46,7 +48,7 @@ void ASTDCALL actor_entry(void* ud)
 {
     aframe_t frame;
     aactor_t* a = (aactor_t*)ud;
-    aint_t nargs = a->stack.v[--a->stack.sp].v.integer;
+    aint_t nargs = av_to_integer(a->stack.v + --a->stack.sp);
     memset(&frame, 0, sizeof(aframe_t));
     frame.bp = 1; // start from stack[0] (nil)
     frame.nargs = 0;
@@ -75,8 +77,12 @@ aerror_t aactor_init(
     any_push_nil(self); // stack[0] is nil
     ec = astack_init(&self->msbox, INIT_MSBOX_SZ, alloc, alloc_ud);
     if (ec != AERR_NONE) goto failed;
-    ec = agc_init(&self->gc, INIT_HEAP_SZ, alloc, alloc_ud);
+    ec = agc_init(
+        &self->gc, owner->gc_policy.min_heap_cap, alloc, alloc_ud);
     if (ec != AERR_NONE) goto failed;
+    agc_set_policy(&self->gc, &owner->gc_policy);
+    // fresh actors can only get code from running chunks
+    self->gc.code_epoch = owner->loader.epoch + 1;
     return ec;
 failed:
     astack_cleanup(&self->stack);
@@ -109,21 +115,23 @@ void any_call(aactor_t* a, aint_t nargs)
         any_error(a, AERR_RUNTIME, "no function to call");
     }
 
-    if (f->tag.type != AVT_NATIVE_FUNC && f->tag.type != AVT_BYTE_CODE_FUNC) {
+    if (av_type(f) != AVT_NATIVE_FUNC && av_type(f) != AVT_BYTE_CODE_FUNC) {
         any_error(a, AERR_RUNTIME, "attempt to call a non-function");
     }
 
     memset(&frame, 0, sizeof(aframe_t));
     save_ctx(a, &frame, nargs);
 
-    switch (f->tag.type) {
+    switch (av_type(f)) {
     case AVT_NATIVE_FUNC:
-        f->v.func(a);
+        av_to_native_func(f)(a);
         break;
     case AVT_BYTE_CODE_FUNC:
-        frame.pt = f->v.avm_func;
+        frame.pt = av_to_byte_code_func(f);
         actor_dispatch(a);
         break;
+    default:
+        break;
     }
 
     load_ctx(a);
@@ -152,15 +160,15 @@ void any_mbox_send(aactor_t* a)
     any_pop(a, 2);
     pid = a->stack.v + a->stack.sp;
     msg = a->stack.v + a->stack.sp + 1;
-    if (pid->tag.type != AVT_PID) {
+    if (av_type(pid) != AVT_PID) {
         any_error(a, AERR_RUNTIME, "target must be a pid");
     }
-    ta = ascheduler_actor(a->owner, pid->v.pid);
+    ta = ascheduler_actor(a->owner, av_to_pid(pid));
     if (!ta) return;
     if (astack_reserve(&ta->msbox, 1) != AERR_NONE) {
         any_error(a, AERR_RUNTIME, "out of memory");
     }
-    switch (msg->tag.type) {
+    switch (av_type(msg)) {
     case AVT_NIL:
     case AVT_PID:
     case AVT_BOOLEAN:
@@ -258,7 +266,7 @@ aerror_t any_try(aactor_t* a, void(*f)(aactor_t*, void*), void* ud)
         a->stack.sp = sp;
         a->frame = frame;
     } else {
-        ev.tag.type = AVT_NIL;
+        av_nil(&ev);
     }
     aactor_push(a, &ev);
     a->error_jmp = c.prev;
@@ -283,22 +291,60 @@ void any_error(aactor_t* a, aerror_t ec, const char* fmt, ...)
     any_throw(a, ec);
 }
 
+void aactor_collect(aactor_t* self)
+{
+    avalue_t* roots[] = {
+        self->stack.v,
+        self->msbox.v,
+        NULL
+    };
+    aint_t num_roots[] = {
+        self->stack.sp,
+        self->msbox.sp
+    };
+    aframe_t* f;
+    const aint_t code_epoch = self->gc.code_epoch;
+    self->gc.code_epoch = self->owner->loader.epoch + 1;
+    agc_collect(&self->gc, roots, num_roots);
+    // functions being executed are not on the stack
+    for (f = self->frame; f; f = f->prev) {
+        if (f->pt == NULL || f->pt->chunk->epoch == 0) continue;
+        if (f->pt->chunk->epoch < self->gc.code_epoch) {
+            self->gc.code_epoch = f->pt->chunk->epoch;
+        }
+    }
+    // the scheduler recomputes its oldest code epoch
+    if (self->gc.code_epoch != code_epoch) self->owner->oldest_code_at = -1;
+}
+
+aprototype_t* aactor_new_version(aactor_t* self)
+{
+    aprototype_t* const pt = self->frame ? self->frame->pt : NULL;
+    aprototype_t* m;
+    avalue_t v;
+    if (pt == NULL || pt->chunk->epoch == 0) return NULL;
+    if (pt->chunk->epoch > self->owner->code_change) return NULL;
+    // only module functions can be found by name
+    m = pt->chunk->prototypes;
+    if (pt < m->nesteds || pt >= m->nesteds + m->header->num_nesteds) {
+        return NULL;
+    }
+    if (aloader_find(&self->owner->loader,
+        m->strings + m->header->symbol,
+        pt->strings + pt->header->symbol, &v) != AERR_NONE) {
+        return NULL;
+    }
+    if (av_type(&v) != AVT_BYTE_CODE_FUNC) return NULL;
+    return av_to_byte_code_func(&v);
+}
+
 aint_t aactor_alloc(aactor_t* self, atype_t type, aint_t sz)
 {
     agc_t* gc = &self->gc;
     aint_t i = agc_alloc(gc, type, sz);
     if (i >= 0) return i;
     else {
-        avalue_t* roots[] = {
-            self->stack.v,
-            self->msbox.v,
-            NULL
-        };
-        aint_t num_roots[] = {
-            self->stack.sp,
-            self->msbox.sp
-        };
-        agc_collect(gc, roots, num_roots);
+        aactor_collect(self);
         i = agc_alloc(gc, type, sz);
         if (i >= 0) return i;
         agc_reserve(gc, sz);
@@ -306,6 +352,86 @@ aint_t aactor_alloc(aactor_t* self, atype_t type, aint_t sz)
     }
 }
 
+void any_get(aactor_t* a, aint_t idx)
+{
+    avalue_t* c = a->stack.v + aactor_absidx(a, idx);
+    avalue_t* k;
+    avalue_t* v = NULL;
+    if (a->stack.sp <= a->frame->bp) {
+        any_error(a, AERR_RUNTIME, "no key to get");
+    }
+    k = a->stack.v + a->stack.sp - 1;
+    switch (av_type(c)) {
+    case AVT_TUPLE: {
+        agc_tuple_t* o = AGC_CAST(agc_tuple_t, &a->gc, av_heap_idx(c));
+        if (av_type(k) != AVT_INTEGER) {
+            any_error(a, AERR_RUNTIME, "index must be integer");
+        }
+        if (av_to_integer(k) >= 0 && av_to_integer(k) < o->sz) {
+            v = agc_tuple_values(&a->gc, o) + av_to_integer(k);
+        }
+        break;
+    }
+    case AVT_ARRAY: {
+        agc_array_t* o = AGC_CAST(agc_array_t, &a->gc, av_heap_idx(c));
+        if (av_type(k) != AVT_INTEGER) {
+            any_error(a, AERR_RUNTIME, "index must be integer");
+        }
+        if (av_to_integer(k) >= 0 && av_to_integer(k) < o->sz) {
+            v = agc_array_values(&a->gc, o) + av_to_integer(k);
+        }
+        break;
+    }
+    case AVT_TABLE:
+        v = agc_table_find(a, c, k);
+        break;
+    default:
+        any_error(a, AERR_RUNTIME, "attempt to index a non-collection");
+        break;
+    }
+    if (v) *k = *v;
+    else av_nil(k);
+}
+
+void any_set(aactor_t* a, aint_t idx)
+{
+    aint_t c = aactor_absidx(a, idx);
+    aint_t v = a->stack.sp - 1;
+    aint_t k = v - 1;
+    avalue_t* col = a->stack.v + c;
+    avalue_t* key = a->stack.v + k;
+    if (k < a->frame->bp) {
+        any_error(a, AERR_RUNTIME, "no key and value to set");
+    }
+    switch (av_type(col)) {
+    case AVT_TUPLE: {
+        agc_tuple_t* o = AGC_CAST(agc_tuple_t, &a->gc, av_heap_idx(col));
+        if (av_type(key) != AVT_INTEGER) {
+            any_error(a, AERR_RUNTIME, "index must be integer");
+        }
+        if (av_to_integer(key) < 0 || av_to_integer(key) >= o->sz) {
+            any_error(a, AERR_RUNTIME,
+                "index %d out of range", (int32_t)av_to_integer(key));
+        }
+        agc_tuple_values(&a->gc, o)[av_to_integer(key)] = a->stack.v[v];
+        break;
+    }
+    case AVT_ARRAY:
+        if (av_type(key) != AVT_INTEGER) {
+            any_error(a, AERR_RUNTIME, "index must be integer");
+        }
+        agc_array_set(a, c, av_to_integer(key), v);
+        break;
+    case AVT_TABLE:
+        agc_table_set(a, c, k, v);
+        break;
+    default:
+        any_error(a, AERR_RUNTIME, "attempt to index a non-collection");
+        break;
+    }
+    a->stack.sp -= 2;
+}
+
 aerror_t any_spawn(aactor_t* a, aint_t cstack_sz, aint_t nargs, apid_t* pid)
 {
     aactor_t* na;
@@ -314,7 +440,7 @@ aerror_t any_spawn(aactor_t* a, aint_t cstack_sz, aint_t nargs, apid_t* pid)
     if (ec != AERR_NONE) return ec;
     for (i = 0; i < nargs + 1; ++i) {
         avalue_t* v = a->stack.v + a->stack.sp - nargs - 1 + i;
-        switch (v->tag.type) {
+        switch (av_type(v)) {
         case AVT_NIL:
         case AVT_PID:
         case AVT_BOOLEAN:
@@ -330,6 +456,10 @@ aerror_t any_spawn(aactor_t* a, aint_t cstack_sz, aint_t nargs, apid_t* pid)
         }
     }
     any_pop(a, nargs + 1);
+    // arguments may refer to the same old code as the parent
+    if (a->gc.code_epoch < na->gc.code_epoch) {
+        na->gc.code_epoch = a->gc.code_epoch;
+    }
     ascheduler_start(a->owner, na, nargs);
     *pid = ascheduler_pid(na->owner, na);
     return AERR_NONE;
@@ -0,0 +1,283 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/allocator.h>
+
+#ifdef ALINUX
+#include <sys/mman.h>
+#endif
+
+#define MIN_CLASS 4
+#define SLAB_SZ (64*1024)
+#define HUGE_PAGE_SZ (2*1024*1024)
+#define ARENA_CHUNK_SZ (64*1024)
+
+#define CLASS_LARGE -1
+#define CLASS_HUGE -2
+
+// Every block is prefixed by a header, which also keeps the payload aligned.
+typedef struct {
+    int32_t cls;
+    int32_t _;
+    aint_t sz;
+} header_t;
+
+ASTATIC_ASSERT(sizeof(header_t) == 16);
+
+static AINLINE void* aalloc(aalloc_t alloc, void* ud, void* old, aint_t sz)
+{
+    return alloc(ud, old, sz);
+}
+
+static AINLINE header_t* header_of(void* p)
+{
+    return ((header_t*)p) - 1;
+}
+
+static AINLINE aint_t usable_size(header_t* h)
+{
+    return h->cls >= 0 ? (aint_t)1 << (h->cls + MIN_CLASS) : h->sz;
+}
+
+static AINLINE int32_t class_of(aint_t sz)
+{
+    int32_t c = 0;
+    while (((aint_t)1 << (c + MIN_CLASS)) < sz) ++c;
+    return c;
+}
+
+static AINLINE void on_alloc(aallocator_t* self, aint_t sz)
+{
+    ++self->stats.allocs;
+    self->stats.in_use += sz;
+    if (self->stats.in_use_high_water < self->stats.in_use) {
+        self->stats.in_use_high_water = self->stats.in_use;
+    }
+}
+
+static void* alloc_small(aallocator_t* self, int32_t c)
+{
+    aint_t blk = (aint_t)sizeof(header_t) + ((aint_t)1 << (c + MIN_CLASS));
+    header_t* h = (header_t*)self->free_lists[c];
+    if (h) {
+        self->free_lists[c] = *(void**)(h + 1);
+    } else {
+        if (self->slab_end - self->slab_cur < blk) {
+            uint8_t* s = (uint8_t*)aalloc(
+                self->alloc, self->alloc_ud, NULL, SLAB_SZ);
+            if (!s) return NULL;
+            // the first header sized block links slabs together
+            *(void**)s = self->slabs;
+            self->slabs = s;
+            self->slab_cur = s + sizeof(header_t);
+            self->slab_end = s + SLAB_SZ;
+            self->stats.slab_bytes += SLAB_SZ;
+        }
+        h = (header_t*)self->slab_cur;
+        self->slab_cur += blk;
+        h->cls = c;
+        h->sz = 0;
+    }
+    return h + 1;
+}
+
+static void* alloc_huge(aallocator_t* self, aint_t sz)
+{
+#ifdef ALINUX
+    size_t len = (size_t)(
+        (sz + sizeof(header_t) + HUGE_PAGE_SZ - 1) & ~(HUGE_PAGE_SZ - 1));
+    header_t* h = (header_t*)MAP_FAILED;
+#ifdef MAP_HUGETLB
+    h = (header_t*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (h == MAP_FAILED) {
+        // no reserved huge pages, ask for transparent ones instead
+        h = (header_t*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (h == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(h, len, MADV_HUGEPAGE);
+#endif
+    }
+    h->cls = CLASS_HUGE;
+    h->sz = (aint_t)len - (aint_t)sizeof(header_t);
+    self->stats.huge_bytes += (aint_t)len;
+    return h + 1;
+#else
+    AUNUSED(self);
+    AUNUSED(sz);
+    return NULL;
+#endif
+}
+
+static void* alloc_large(aallocator_t* self, aint_t sz)
+{
+    header_t* h;
+    if (self->huge_threshold > 0 && sz >= self->huge_threshold) {
+        void* p = alloc_huge(self, sz);
+        if (p) return p;
+    }
+    h = (header_t*)aalloc(
+        self->alloc, self->alloc_ud, NULL, sz + (aint_t)sizeof(header_t));
+    if (!h) return NULL;
+    h->cls = CLASS_LARGE;
+    h->sz = sz;
+    self->stats.large_bytes += sz;
+    return h + 1;
+}
+
+static void* alloc_block(aallocator_t* self, aint_t sz)
+{
+    int32_t c = class_of(sz);
+    void* p = c < AALLOCATOR_NUM_CLASSES
+        ? alloc_small(self, c)
+        : alloc_large(self, sz);
+    if (p) on_alloc(self, usable_size(header_of(p)));
+    return p;
+}
+
+static void free_block(aallocator_t* self, void* p)
+{
+    header_t* h = header_of(p);
+    ++self->stats.frees;
+    self->stats.in_use -= usable_size(h);
+    switch (h->cls) {
+    case CLASS_LARGE:
+        self->stats.large_bytes -= h->sz;
+        aalloc(self->alloc, self->alloc_ud, h, 0);
+        break;
+    case CLASS_HUGE:
+#ifdef ALINUX
+        self->stats.huge_bytes -= h->sz + (aint_t)sizeof(header_t);
+        munmap(h, (size_t)(h->sz + (aint_t)sizeof(header_t)));
+#endif
+        break;
+    default:
+        *(void**)p = self->free_lists[h->cls];
+        self->free_lists[h->cls] = h;
+        break;
+    }
+}
+
+void aallocator_init(aallocator_t* self, aalloc_t alloc, void* alloc_ud)
+{
+    memset(self, 0, sizeof(aallocator_t));
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+}
+
+void aallocator_cleanup(aallocator_t* self)
+{
+    void* s = self->slabs;
+    while (s) {
+        void* next = *(void**)s;
+        aalloc(self->alloc, self->alloc_ud, s, 0);
+        s = next;
+    }
+    self->slabs = NULL;
+    self->slab_cur = self->slab_end = NULL;
+    memset(self->free_lists, 0, sizeof(self->free_lists));
+    self->stats.slab_bytes = 0;
+}
+
+void aallocator_huge_pages(aallocator_t* self, aint_t threshold)
+{
+    self->huge_threshold = threshold;
+}
+
+void* aallocator_alloc(void* ud, void* old, aint_t sz)
+{
+    aallocator_t* self = (aallocator_t*)ud;
+    header_t* h;
+    aint_t old_sz;
+    int32_t c;
+    void* p;
+    if (sz == 0) {
+        if (old) free_block(self, old);
+        return NULL;
+    }
+    if (!old) return alloc_block(self, sz);
+    h = header_of(old);
+    old_sz = usable_size(h);
+    c = class_of(sz);
+    if (c >= AALLOCATOR_NUM_CLASSES) c = CLASS_LARGE;
+    // blocks shrink in place as long as they stay in the same class
+    if (old_sz >= sz && (h->cls == c || (h->cls < 0 && c < 0))) return old;
+    p = alloc_block(self, sz);
+    if (!p) return NULL;
+    memcpy(p, old, (size_t)(old_sz < sz ? old_sz : sz));
+    free_block(self, old);
+    return p;
+}
+
+void aarena_init(aarena_t* self, aalloc_t alloc, void* alloc_ud)
+{
+    memset(self, 0, sizeof(aarena_t));
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+}
+
+void aarena_cleanup(aarena_t* self)
+{
+    aarena_reset(self);
+}
+
+void aarena_reset(aarena_t* self)
+{
+    void* c = self->chunks;
+    while (c) {
+        void* next = *(void**)c;
+        aalloc(self->alloc, self->alloc_ud, c, 0);
+        c = next;
+    }
+    self->chunks = NULL;
+    self->cur = self->end = self->last = NULL;
+    self->reserved = 0;
+}
+
+static void* arena_take(aarena_t* self, aint_t sz)
+{
+    aint_t need = (aint_t)sizeof(header_t) + ((sz + 15) & ~(aint_t)15);
+    header_t* h;
+    if (self->end - self->cur < need) {
+        aint_t chunk_sz = (aint_t)sizeof(header_t) + need;
+        uint8_t* c;
+        if (chunk_sz < ARENA_CHUNK_SZ) chunk_sz = ARENA_CHUNK_SZ;
+        c = (uint8_t*)aalloc(self->alloc, self->alloc_ud, NULL, chunk_sz);
+        if (!c) return NULL;
+        *(void**)c = self->chunks;
+        self->chunks = c;
+        self->cur = c + sizeof(header_t);
+        self->end = c + chunk_sz;
+        self->reserved += chunk_sz;
+    }
+    h = (header_t*)self->cur;
+    h->cls = CLASS_LARGE;
+    h->sz = need - (aint_t)sizeof(header_t);
+    self->last = self->cur;
+    self->cur += need;
+    return h + 1;
+}
+
+void* aarena_alloc(void* ud, void* old, aint_t sz)
+{
+    aarena_t* self = (aarena_t*)ud;
+    header_t* h;
+    void* p;
+    if (sz == 0) return NULL;
+    if (!old) return arena_take(self, sz);
+    h = header_of(old);
+    if (h->sz >= sz) return old;
+    if ((uint8_t*)h == self->last) {
+        // the last block grows in place
+        aint_t more = ((sz + 15) & ~(aint_t)15) - h->sz;
+        if (self->end - self->cur >= more) {
+            self->cur += more;
+            h->sz += more;
+            return old;
+        }
+    }
+    p = arena_take(self, sz);
+    if (!p) return NULL;
+    memcpy(p, old, (size_t)h->sz);
+    return p;
+}
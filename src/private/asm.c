@@ -11,6 +11,9 @@
 #define INIT_MAX_CONSTANTS 16
 #define INIT_MAX_IMPORTS 16
 #define INIT_MAX_NESTEDS 16
+#define INIT_POOL_CAPACITY 64
+#define INIT_CHUNK_CAPACITY 1024
+#define WRITE_BUFF_SZ 4096
 
 extern const achunk_header_t CHUNK_HEADER;
 
@@ -41,16 +44,6 @@ static AINLINE aint_t required_size(const aasm_reserve_t* sz)
         sz->max_nesteds * sizeof(aint_t);
 }
 
-static AINLINE aint_t prototype_size(const aasm_prototype_t* p)
-{
-    aasm_reserve_t sz;
-    sz.max_instructions = p->max_instructions;
-    sz.max_constants = p->max_constants;
-    sz.max_imports = p->max_imports;
-    sz.max_nesteds = p->max_nesteds;
-    return required_size(&sz);
-}
-
 static AINLINE ainstruction_t* instructions_of(aasm_prototype_t* p)
 {
     return (ainstruction_t*)(p + 1);
@@ -103,73 +96,121 @@ static AINLINE aasm_current_t resolve(aasm_prototype_t* p)
     return c;
 }
 
-static void gc(
-    aasm_t* self, uint8_t* new_buff, aint_t* offset, const aint_t parent)
+static AINLINE uint64_t mix(uint64_t h, uint64_t v)
 {
-    aint_t i;
-
-    // copy referenced prototypes
-    aasm_prototype_t* p = aasm_prototype_at(self, parent);
-    aint_t p_sz = prototype_size(p);
-    memcpy(new_buff + *offset, p, (size_t)p_sz);
+    h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+    return h;
+}
 
-    // safe to update parent slot here
-    // there are no more dereferences to that during gc
-    self->_slots[parent] = *offset;
-    *offset += p_sz;
+static AINLINE uint64_t pool_hash(const aasm_pool_entry_t* e)
+{
+    uint64_t h = mix((uint64_t)e->slot, (uint64_t)e->kind);
+    return mix(mix(h, e->a), e->b) * 0x9E3779B97F4A7C15ULL;
+}
 
-    // recursive for children
-    for (i = 0; i < p->num_nesteds; ++i) {
-        aint_t n = nesteds_of(p)[i];
-        gc(self, new_buff, offset, n);
+static aasm_pool_entry_t* pool_lookup(
+    aasm_pool_entry_t* pool, aint_t cap, const aasm_pool_entry_t* key)
+{
+    const uint64_t mask = (uint64_t)cap - 1;
+    uint64_t i = (pool_hash(key) >> 16) & mask;
+    for (;; i = (i + 1) & mask) {
+        aasm_pool_entry_t* const e = pool + i;
+        if (e->slot < 0) return e;
+        if (e->slot == key->slot && e->kind == key->kind &&
+            e->a == key->a && e->b == key->b) return e;
     }
 }
 
-static void grow_buff(aasm_t* self, aint_t expected)
+static void pool_grow(aasm_t* self)
 {
-    uint8_t* new_buff = NULL;
+    aint_t i;
+    const aint_t old_cap = self->_pool_capacity;
+    aasm_pool_entry_t* const old = self->_pool;
+    const aint_t new_cap = old_cap ? old_cap*GROW_FACTOR : INIT_POOL_CAPACITY;
+    self->_pool = (aasm_pool_entry_t*)aalloc(
+        self, NULL, new_cap * sizeof(aasm_pool_entry_t));
+    self->_pool_capacity = new_cap;
+    for (i = 0; i < new_cap; ++i) self->_pool[i].slot = -1;
+    for (i = 0; i < old_cap; ++i) {
+        if (old[i].slot < 0) continue;
+        *pool_lookup(self->_pool, new_cap, old + i) = old[i];
+    }
+    aalloc(self, old, 0);
+}
 
-    expected += self->_buff_size;
-    if (expected <= self->_buff_capacity) return;
+// Index of `key` if found, or `idx` which is then indexed.
+static aint_t pool_find_or_add(
+    aasm_t* self, const aasm_pool_entry_t* key, aint_t idx)
+{
+    aasm_pool_entry_t* e;
+    // keep the load factor under 1/2
+    if ((self->_pool_size + 1)*2 > self->_pool_capacity) pool_grow(self);
+    e = pool_lookup(self->_pool, self->_pool_capacity, key);
+    if (e->slot >= 0) return e->idx;
+    *e = *key;
+    e->idx = idx;
+    ++self->_pool_size;
+    return idx;
+}
 
-    assert(self->_num_slots > 0 && "don't grow for root");
-    while (self->_buff_capacity < expected) self->_buff_capacity *= GROW_FACTOR;
-    new_buff = (uint8_t*)aalloc(self, NULL, self->_buff_capacity);
+static AINLINE aasm_pool_entry_t constant_key(aint_t slot, const aconstant_t* c)
+{
+    aasm_pool_entry_t k;
+    memset(&k, 0, sizeof(k));
+    k.slot = slot;
+    k.kind = c->type;
+    switch (c->type) {
+    case ACT_INTEGER:
+        k.a = (uint64_t)c->integer;
+        break;
+    case ACT_STRING:
+        k.a = (uint64_t)c->string;
+        break;
+    default:
+        // bitwise, -0.0 and 0.0 are different constants
+        memcpy(&k.a, &c->real, sizeof(areal_t));
+        break;
+    }
+    return k;
+}
 
-    self->_buff_size = 0;
-    gc(self, new_buff, &self->_buff_size, 0);
-    aalloc(self, self->_buff, 0);
-    self->_buff = new_buff;
+static AINLINE aasm_pool_entry_t import_key(aint_t slot, const aimport_t* i)
+{
+    aasm_pool_entry_t k;
+    memset(&k, 0, sizeof(k));
+    k.slot = slot;
+    k.kind = -1;
+    k.a = (uint64_t)i->module;
+    k.b = (uint64_t)i->name;
+    return k;
 }
 
-// returns a new prototype offset,
-// and guarantee that at least 1 free slot is available.
-static aint_t new_prototype(aasm_t* self, const aasm_reserve_t* sz)
+// Prototypes are allocated one by one, growing one never moves the others.
+static aasm_prototype_t* new_prototype(aasm_t* self, const aasm_reserve_t* sz)
 {
-    aint_t poff;
-    aasm_prototype_t* p = NULL;
     const aint_t rsz = required_size(sz);
-    grow_buff(self, rsz);
-    poff = self->_buff_size;
-
-    if (self->_num_slots == self->_max_slots) {
-        self->_max_slots *= GROW_FACTOR;
-        self->_slots = aalloc(
-            self, self->_slots, self->_max_slots * sizeof(aint_t));
-    }
-
-    p = (aasm_prototype_t*)(self->_buff + poff);
+    aasm_prototype_t* const p = (aasm_prototype_t*)aalloc(self, NULL, rsz);
     memset(p, 0, (size_t)rsz);
     p->max_instructions = sz->max_instructions;
     p->max_constants = sz->max_constants;
     p->max_imports = sz->max_imports;
     p->max_nesteds = sz->max_nesteds;
-    self->_buff_size += rsz;
+    return p;
+}
 
-    return poff;
+// returns a new slot for `p`.
+static aint_t new_slot(aasm_t* self, aasm_prototype_t* p)
+{
+    if (self->_num_slots == self->_max_slots) {
+        self->_max_slots *= GROW_FACTOR;
+        self->_slots = (aasm_prototype_t**)aalloc(self, self->_slots,
+            self->_max_slots * (aint_t)sizeof(aasm_prototype_t*));
+    }
+    self->_slots[self->_num_slots] = p;
+    return self->_num_slots++;
 }
 
-static AINLINE aint_t new_prototype_default_size(aasm_t* self)
+static AINLINE aasm_prototype_t* new_prototype_default_size(aasm_t* self)
 {
     return new_prototype(self, &DEFAULT_PROTO_SZ);
 }
@@ -179,57 +220,6 @@ static AINLINE aasm_ctx_t* ctx(aasm_t* self)
     return self->_context + self->_nested_level;
 }
 
-// compute the required size for strings.
-static aint_t compute_strings_sz(
-    const astring_table_t* st,
-    const aasm_prototype_t* p,
-    const aconstant_t* constants,
-    const aimport_t* imports)
-{
-    aint_t i;
-    aint_t sz;
-
-    sz  = (aint_t)sizeof(uint32_t) + 1 +
-        (aint_t)strlen(astring_table_to_string(st, p->source));
-    sz += (aint_t)sizeof(uint32_t) + 1 +
-        (aint_t)strlen(astring_table_to_string(st, p->symbol));
-
-    for (i = 0; i < p->num_constants; ++i) {
-        if (constants[i].type != ACT_STRING) continue;
-        sz += (aint_t)sizeof(uint32_t) + 1 +
-            (aint_t)strlen(astring_table_to_string(st, constants[i].string));
-    }
-
-    for (i = 0; i < p->num_imports; ++i) {
-        sz += (aint_t)sizeof(uint32_t) + 1 +
-            (aint_t)strlen(
-                astring_table_to_string(st, imports[i].module));
-        sz += (aint_t)sizeof(uint32_t) + 1 +
-            (aint_t)strlen(astring_table_to_string(st, imports[i].name));
-    }
-
-    return sz;
-}
-
-static void compute_chunk_body_size(
-    const aasm_t* self, aint_t parent, aint_t* psz)
-{
-    aint_t i;
-
-    aasm_prototype_t* const p = aasm_prototype_at((aasm_t*)self, parent);
-    const aasm_current_t c = resolve(p);
-
-    *psz += sizeof(aprototype_header_t) +
-        compute_strings_sz(self->st, p, c.constants, c.imports) +
-        p->num_instructions * sizeof(ainstruction_t) +
-        p->num_constants * sizeof(aconstant_t) +
-        p->num_imports * sizeof(aimport_t);
-
-    for (i = 0; i < p->num_nesteds; ++i) {
-        compute_chunk_body_size(self, nesteds_of(p)[i], psz);
-    }
-}
-
 static AINLINE resolved_proto_t rp_resolve(
     const aprototype_header_t* p, aint_t strings_sz)
 {
@@ -240,99 +230,164 @@ static AINLINE resolved_proto_t rp_resolve(
     return c;
 }
 
-static aint_t chunk_add_str(
-    const aasm_t* self, aprototype_header_t* header, aint_t string)
+// A string of the prototype being written, in chunk order.
+typedef struct {
+    aint_t ref;
+    aint_t length;
+} chunk_str_t;
+
+// Batches small writes, big ones go straight to the sink.
+typedef struct {
+    aasm_t* self;
+    aasm_write_t write;
+    void* write_ud;
+    aerror_t ec;
+    chunk_str_t* strs;
+    aint_t max_strs;
+    aint_t size;
+    uint8_t buff[WRITE_BUFF_SZ];
+} writer_t;
+
+static void flush(writer_t* w)
+{
+    if (w->size > 0 && w->ec == AERR_NONE) {
+        w->ec = w->write(w->write_ud, w->buff, w->size);
+    }
+    w->size = 0;
+}
+
+static void put(writer_t* w, const void* data, aint_t sz)
 {
-    const uint32_t hash = astring_table_to_hash(self->st, string);
-    const char* const str = astring_table_to_string(self->st, string);
-    const aint_t length = (aint_t)strlen(str);
-    const aint_t off = header->strings_sz;
-    uint8_t* const b = ((uint8_t*)header) + sizeof(aprototype_header_t) + off;
-    memcpy(b, &hash, sizeof(uint32_t));
-    memcpy(b + sizeof(uint32_t), str, (size_t)length + 1);
-    header->strings_sz += sizeof(uint32_t) + length + 1;
-    return off + sizeof(uint32_t);
+    if (w->size + sz > WRITE_BUFF_SZ) flush(w);
+    if (sz >= WRITE_BUFF_SZ) {
+        if (w->ec == AERR_NONE) w->ec = w->write(w->write_ud, data, sz);
+    } else {
+        memcpy(w->buff + w->size, data, (size_t)sz);
+        w->size += sz;
+    }
 }
 
-// set header fields
-static void set_headers(
-    const aasm_t* self, aprototype_header_t* header, const aasm_prototype_t* p)
+static AINLINE void add_str(writer_t* w, aint_t* n, aint_t ref)
 {
-    memset(header, 0, sizeof(*header));
-    header->num_instructions = p->num_instructions;
-    header->num_nesteds = p->num_nesteds;
-    header->num_constants = p->num_constants;
-    header->num_imports = p->num_imports;
-    header->source = chunk_add_str(self, header, p->source);
-    header->symbol = chunk_add_str(self, header, p->symbol);
+    w->strs[*n].ref = ref;
+    w->strs[*n].length =
+        (aint_t)strlen(astring_table_to_string(w->self->st, ref));
+    ++*n;
 }
 
-static AINLINE aconstant_t to_chunk(
-    aconstant_t c, aasm_t* self, aprototype_header_t* header)
+// Measure strings of `p` once, returns the number of them.
+static aint_t collect_strs(
+    writer_t* w, const aasm_prototype_t* p, const aasm_current_t* c)
 {
-    aconstant_t v = c;
-    if (c.type == ACT_STRING) {
-        v.string = chunk_add_str(self, header, c.string);
+    const aint_t max = 2 + p->num_constants + 2*p->num_imports;
+    aint_t n = 0;
+    aint_t i;
+
+    if (w->max_strs < max) {
+        w->strs = (chunk_str_t*)aalloc(
+            w->self, w->strs, max * (aint_t)sizeof(chunk_str_t));
+        w->max_strs = max;
+    }
+
+    add_str(w, &n, p->source);
+    add_str(w, &n, p->symbol);
+    for (i = 0; i < p->num_constants; ++i) {
+        if (c->constants[i].type == ACT_STRING) {
+            add_str(w, &n, c->constants[i].string);
+        }
+    }
+    for (i = 0; i < p->num_imports; ++i) {
+        add_str(w, &n, c->imports[i].module);
+        add_str(w, &n, c->imports[i].name);
     }
-    return v;
+    return n;
 }
 
-static void save_chunk(aasm_t* self, aint_t parent);
+// Chunk offset of the `k`th string, `off` is where that string begins.
+static AINLINE aint_t next_str(const writer_t* w, aint_t* k, aint_t* off)
+{
+    const aint_t s = *off + (aint_t)sizeof(uint32_t);
+    *off = s + w->strs[*k].length + 1;
+    ++*k;
+    return s;
+}
 
-static void copy_prototype(
-    aasm_t* self,
-    const aasm_prototype_t* p,
-    const aasm_current_t* c,
-    aprototype_header_t* header,
-    aint_t strings_sz)
+static void write_prototype(writer_t* w, aint_t slot)
 {
-    aint_t i;
-    const resolved_proto_t rp = rp_resolve(header, strings_sz);
+    const astring_table_t* const st = w->self->st;
+    aasm_prototype_t* const p = aasm_prototype_at(w->self, slot);
+    const aasm_current_t c = resolve(p);
+    aprototype_header_t header;
+    aint_t num_strs, i, k, off;
+
+    if (w->ec != AERR_NONE) return;
+    num_strs = collect_strs(w, p, &c);
+
+    memset(&header, 0, sizeof(header));
+    header.num_instructions = p->num_instructions;
+    header.num_nesteds = p->num_nesteds;
+    header.num_constants = p->num_constants;
+    header.num_imports = p->num_imports;
+    k = off = 0;
+    header.source = next_str(w, &k, &off);
+    header.symbol = next_str(w, &k, &off);
+    for (i = k; i < num_strs; ++i) {
+        header.strings_sz += sizeof(uint32_t) + w->strs[i].length + 1;
+    }
+    header.strings_sz += off;
+    put(w, &header, sizeof(header));
+
+    for (i = 0; i < num_strs; ++i) {
+        const uint32_t hash = astring_table_to_hash(st, w->strs[i].ref);
+        put(w, &hash, sizeof(uint32_t));
+        put(w, astring_table_to_string(st, w->strs[i].ref),
+            w->strs[i].length + 1);
+    }
 
-    // add instructions
-    memcpy(
-        rp.instructions,
-        c->instructions,
-        (size_t)p->num_instructions * sizeof(ainstruction_t));
+    put(w, c.instructions,
+        p->num_instructions * (aint_t)sizeof(ainstruction_t));
 
-    // add constants
+    // string offsets follow the order strings were written in
     for (i = 0; i < p->num_constants; ++i) {
-        rp.constants[i] = to_chunk(c->constants[i], self, header);
+        aconstant_t v = c.constants[i];
+        if (v.type == ACT_STRING) v.string = next_str(w, &k, &off);
+        put(w, &v, sizeof(aconstant_t));
     }
 
-    // add imports
     for (i = 0; i < p->num_imports; ++i) {
-        rp.imports[i].module = chunk_add_str(
-            self, header, c->imports[i].module);
-        rp.imports[i].name = chunk_add_str(
-            self, header, c->imports[i].name);
+        aimport_t imp;
+        imp.module = next_str(w, &k, &off);
+        imp.name = next_str(w, &k, &off);
+        put(w, &imp, sizeof(aimport_t));
     }
 
-    assert(header->strings_sz == strings_sz);
+    assert(off == header.strings_sz);
 
-    // add nesteds
     for (i = 0; i < p->num_nesteds; ++i) {
-        save_chunk(self, c->nesteds[i]);
+        write_prototype(w, c.nesteds[i]);
     }
 }
 
-static void save_chunk(aasm_t* self, aint_t parent)
+// Sink which appends to `self->chunk`.
+static aerror_t write_chunk(void* ud, const void* data, aint_t sz)
 {
-    const aasm_prototype_t* const p = aasm_prototype_at(self, parent);
-    const aasm_current_t c = resolve((aasm_prototype_t*)p);
-    aint_t str_sz = compute_strings_sz(self->st, p, c.constants, c.imports);
-    aint_t psz = sizeof(aprototype_header_t) +
-        str_sz +
-        p->num_instructions * sizeof(ainstruction_t) +
-        p->num_constants * sizeof(aconstant_t) +
-        p->num_imports * sizeof(aimport_t);
-    aprototype_header_t* const header = (aprototype_header_t*)(
-        ((uint8_t*)self->chunk) + self->chunk_size);
-    set_headers(self, header, p);
-    self->chunk_size += psz;
-    copy_prototype(self, p, &c, header, str_sz);
+    aasm_t* const self = (aasm_t*)ud;
+    const aint_t need = self->chunk_size + sz;
+    if (self->_chunk_capacity < need) {
+        aint_t cap = self->_chunk_capacity
+            ? self->_chunk_capacity : INIT_CHUNK_CAPACITY;
+        while (cap < need) cap *= GROW_FACTOR;
+        self->chunk = (achunk_header_t*)aalloc(self, self->chunk, cap);
+        self->_chunk_capacity = cap;
+    }
+    memcpy(((uint8_t*)self->chunk) + self->chunk_size, data, (size_t)sz);
+    self->chunk_size = need;
+    return AERR_NONE;
 }
 
+static aint_t append_constant(aasm_t* self, aconstant_t constant);
+static aint_t append_import(aasm_t* self, aimport_t import);
+
 static AINLINE const char* rp_string(
     const aprototype_header_t* p, aint_t string)
 {
@@ -377,14 +432,20 @@ static aerror_t load_chunk(
         (size_t)p->num_instructions * sizeof(ainstruction_t));
     ap->num_instructions = p->num_instructions;
 
+    // keep duplicates, instructions refer to them by index
     for (i = 0; i < p->num_constants; ++i) {
-        aasm_add_constant(self, from_chunk(rp.constants[i], self, p));
+        const aconstant_t c = from_chunk(rp.constants[i], self, p);
+        const aasm_pool_entry_t k = constant_key(ctx(self)->slot, &c);
+        pool_find_or_add(self, &k, append_constant(self, c));
     }
 
     for (i = 0; i < p->num_imports; ++i) {
-        aimport_t imp = rp.imports[i];
-        aasm_add_import(
-            self, rp_string(p, imp.module), rp_string(p, imp.name));
+        aimport_t imp;
+        aasm_pool_entry_t k;
+        imp.module = aasm_string_to_ref(self, rp_string(p, rp.imports[i].module));
+        imp.name = aasm_string_to_ref(self, rp_string(p, rp.imports[i].name));
+        k = import_key(ctx(self)->slot, &imp);
+        pool_find_or_add(self, &k, append_import(self, imp));
     }
 
     *offset +=
@@ -406,11 +467,9 @@ static aerror_t load_chunk(
 
 static aint_t push_unsafe(aasm_t* self)
 {
-    const aint_t np_off = new_prototype_default_size(self);
-    const aint_t np = self->_num_slots++;
+    const aint_t np = new_slot(self, new_prototype_default_size(self));
     aasm_prototype_t* const p = aasm_prototype(self);
 
-    self->_slots[np] = np_off;
     assert(p->num_nesteds < p->max_nesteds);
     nesteds_of(p)[p->num_nesteds] = np;
 
@@ -437,14 +496,9 @@ aerror_t aasm_load(aasm_t* self, const achunk_header_t* input)
     astring_table_init(self->st, INIT_ST_BYTES, INIT_ST_SSIZE);
 
     self->_max_slots = INIT_SLOT_COUNT;
-    self->_slots = (aint_t*)aalloc(
-        self, NULL, self->_max_slots * sizeof(aint_t));
-
-    self->_buff_capacity = self->_max_slots * required_size(&DEFAULT_PROTO_SZ);
-    self->_buff = (uint8_t*)aalloc(self, NULL, self->_buff_capacity);
-
-    self->_slots[self->_num_slots] = new_prototype_default_size(self);
-    self->_num_slots = 1;
+    self->_slots = (aasm_prototype_t**)aalloc(
+        self, NULL, self->_max_slots * (aint_t)sizeof(aasm_prototype_t*));
+    new_slot(self, new_prototype_default_size(self));
 
     if (!input) return AERR_NONE;
     if (memcmp(&CHUNK_HEADER, input, sizeof(achunk_header_t)) == 0) {
@@ -458,42 +512,50 @@ aerror_t aasm_load(aasm_t* self, const achunk_header_t* input)
 
 void aasm_save(aasm_t* self)
 {
-    aint_t sz = 0;
     if (self->_num_slots == 0) return;
-    compute_chunk_body_size(self, 0, &sz);
-    sz += sizeof(achunk_header_t);
     self->chunk_size = 0;
-    if (self->_chunk_capacity < sz) {
-        aalloc(self, self->chunk, 0);
-        self->chunk = (achunk_header_t*)aalloc(self, NULL, sz);
-        self->_chunk_capacity = sz;
-    }
-
-    memcpy(self->chunk, &CHUNK_HEADER, sizeof(achunk_header_t));
-    self->chunk_size += sizeof(achunk_header_t);
+    aasm_save_to(self, &write_chunk, self);
+}
 
-    save_chunk(self, 0);
-    assert(self->chunk_size == sz);
+aerror_t aasm_save_to(aasm_t* self, aasm_write_t write, void* write_ud)
+{
+    writer_t w;
+    if (self->_num_slots == 0) return AERR_NONE;
+    w.self = self;
+    w.write = write;
+    w.write_ud = write_ud;
+    w.ec = AERR_NONE;
+    w.strs = NULL;
+    w.max_strs = 0;
+    w.size = 0;
+    put(&w, &CHUNK_HEADER, sizeof(achunk_header_t));
+    write_prototype(&w, 0);
+    flush(&w);
+    aalloc(self, w.strs, 0);
+    return w.ec;
 }
 
 void aasm_cleanup(aasm_t* self)
 {
+    aint_t i;
+
     aalloc(self, self->st, 0);
     self->st = NULL;
 
+    for (i = 0; i < self->_num_slots; ++i) aalloc(self, self->_slots[i], 0);
     aalloc(self, self->_slots, 0);
     self->_slots = NULL;
     self->_num_slots = 0;
     self->_max_slots = 0;
 
-    aalloc(self, self->_buff, 0);
-    self->_buff = NULL;
-    self->_buff_size = 0;
-    self->_buff_capacity = 0;
-
     memset(self->_context, 0, sizeof(self->_context));
     self->_nested_level = 0;
 
+    aalloc(self, self->_pool, 0);
+    self->_pool = NULL;
+    self->_pool_size = 0;
+    self->_pool_capacity = 0;
+
     aalloc(self, self->chunk, 0);
     self->chunk_size = 0;
     self->_chunk_capacity = 0;
@@ -519,7 +581,7 @@ aint_t aasm_emit(aasm_t* self, ainstruction_t instruction)
     return p->num_instructions++;
 }
 
-aint_t aasm_add_constant(aasm_t* self, aconstant_t constant)
+static aint_t append_constant(aasm_t* self, aconstant_t constant)
 {
     aasm_prototype_t* p = aasm_prototype(self);
     aasm_reserve_t sz;
@@ -539,15 +601,18 @@ aint_t aasm_add_constant(aasm_t* self, aconstant_t constant)
     return p->num_constants++;
 }
 
-aint_t aasm_add_import(aasm_t* self, const char* module, const char* name)
+aint_t aasm_add_constant(aasm_t* self, aconstant_t constant)
 {
-    aimport_t import;
-    aasm_prototype_t* p;
-    aasm_reserve_t sz;
+    const aasm_pool_entry_t k = constant_key(ctx(self)->slot, &constant);
+    const aint_t n = aasm_prototype(self)->num_constants;
+    const aint_t idx = pool_find_or_add(self, &k, n);
+    return idx != n ? idx : append_constant(self, constant);
+}
 
-    import.module = aasm_string_to_ref(self, module);
-    import.name = aasm_string_to_ref(self, name);
-    p = aasm_prototype(self);
+static aint_t append_import(aasm_t* self, aimport_t import)
+{
+    aasm_prototype_t* p = aasm_prototype(self);
+    aasm_reserve_t sz;
 
     sz.max_instructions = p->max_instructions;
     sz.max_constants = p->max_constants;
@@ -564,6 +629,19 @@ aint_t aasm_add_import(aasm_t* self, const char* module, const char* name)
     return p->num_imports++;
 }
 
+aint_t aasm_add_import(aasm_t* self, const char* module, const char* name)
+{
+    aimport_t import;
+    aasm_pool_entry_t k;
+    aint_t n, idx;
+    import.module = aasm_string_to_ref(self, module);
+    import.name = aasm_string_to_ref(self, name);
+    k = import_key(ctx(self)->slot, &import);
+    n = aasm_prototype(self)->num_imports;
+    idx = pool_find_or_add(self, &k, n);
+    return idx != n ? idx : append_import(self, import);
+}
+
 aint_t aasm_module_push(aasm_t* self, const char* name)
 {
     aasm_prototype_t* p;
@@ -578,19 +656,16 @@ aint_t aasm_module_push(aasm_t* self, const char* name)
 
 aint_t aasm_push(aasm_t* self)
 {
-    const aasm_prototype_t* p = aasm_prototype(self);
-    aasm_reserve_t sz;
-
-    sz.max_instructions = p->max_instructions;
-    sz.max_constants = p->max_constants;
-    sz.max_imports = p->max_imports;
-    sz.max_nesteds = p->max_nesteds * GROW_FACTOR;
-
+    const aasm_prototype_t* const p = aasm_prototype(self);
+    // push_unsafe looks the prototype up again after reserving
     if (p->num_nesteds == p->max_nesteds) {
+        aasm_reserve_t sz;
+        sz.max_instructions = p->max_instructions;
+        sz.max_constants = p->max_constants;
+        sz.max_imports = p->max_imports;
+        sz.max_nesteds = p->max_nesteds * GROW_FACTOR;
         aasm_reserve(self, &sz);
-        p = NULL;
     }
-
     return push_unsafe(self);
 }
 
@@ -639,9 +714,8 @@ void aasm_reserve(aasm_t* self, const aasm_reserve_t* sz)
             p->max_nesteds >= sz->max_nesteds) return;
     }
     {
-        const aint_t np_off = new_prototype(self, sz);
-        aasm_prototype_t* const np = (aasm_prototype_t*)(self->_buff + np_off);
-        const aasm_prototype_t* const cp = aasm_prototype(self);
+        aasm_prototype_t* const np = new_prototype(self, sz);
+        aasm_prototype_t* const cp = aasm_prototype(self);
 
         np->source = cp->source;
         np->symbol = cp->symbol;
@@ -667,7 +741,8 @@ void aasm_reserve(aasm_t* self, const aasm_reserve_t* sz)
             nesteds_of_const(cp),
             (size_t)cp->num_nesteds * sizeof(aint_t));
 
-        self->_slots[ctx(self)->slot] = np_off;
+        self->_slots[ctx(self)->slot] = np;
+        aalloc(self, cp, 0);
     }
 }
 
@@ -0,0 +1,224 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/asm.h>
+
+// Per prototype working memory, indexed by instruction.
+typedef struct {
+    aint_t* stack;
+    aint_t* remap;
+    uint8_t* marks;
+} scratch_t;
+
+static AINLINE void* aalloc(aasm_t* self, void* old, const aint_t sz)
+{
+    return self->alloc(self->alloc_ud, old, sz);
+}
+
+static AINLINE int32_t is_jump(const ainstruction_t* i)
+{
+    return i->b.opcode == AOC_JMP ||
+        i->b.opcode == AOC_JIN ||
+        i->b.opcode == AOC_RCV;
+}
+
+// Jump displacements are relative to the next instruction.
+static AINLINE aint_t target_of(const ainstruction_t* is, aint_t ip)
+{
+    return ip + 1 + is[ip].jmp.displacement;
+}
+
+static AINLINE void set_target(ainstruction_t* is, aint_t ip, aint_t target)
+{
+    is[ip].jmp.displacement = (int32_t)(target - ip - 1);
+}
+
+// Loads which can be dropped along with the pop discarding them.
+static AINLINE int32_t is_pure_load(const ainstruction_t* i)
+{
+    switch (i->b.opcode) {
+    case AOC_LDK:
+    case AOC_NIL:
+    case AOC_LDB:
+    case AOC_LSI:
+    case AOC_LLV:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static aint_t thread_jumps(ainstruction_t* is, aint_t n)
+{
+    aint_t changes = 0;
+    aint_t ip;
+    for (ip = 0; ip < n; ++ip) {
+        aint_t t, steps;
+        if (!is_jump(is + ip)) continue;
+        t = target_of(is, ip);
+        for (steps = 0; steps < n && is[t].b.opcode == AOC_JMP; ++steps) {
+            t = target_of(is, t);
+        }
+        // jumps which only lead to each other are left as they are
+        if (is[t].b.opcode == AOC_JMP) continue;
+        if (t != target_of(is, ip)) {
+            set_target(is, ip, t);
+            ++changes;
+        }
+        if (is[ip].b.opcode == AOC_JMP && t == ip + 1) {
+            is[ip] = ai_nop();
+            ++changes;
+        }
+    }
+    return changes;
+}
+
+static aint_t fold_loads(ainstruction_t* is, aint_t n, uint8_t* targets)
+{
+    aint_t changes = 0;
+    aint_t ip;
+    if (n == 0) return 0;
+    memset(targets, 0, (size_t)n);
+    for (ip = 0; ip < n; ++ip) {
+        if (is_jump(is + ip)) targets[target_of(is, ip)] = TRUE;
+    }
+    for (ip = 0; ip + 1 < n; ++ip) {
+        ainstruction_t* const pop = is + ip + 1;
+        if (!is_pure_load(is + ip) || pop->b.opcode != AOC_POP) continue;
+        // jumping to the pop expects one more value to discard
+        if (targets[ip + 1] || pop->pop.n <= 0) continue;
+        is[ip] = ai_nop();
+        *pop = pop->pop.n == 1 ? ai_nop() : ai_pop(pop->pop.n - 1);
+        ++changes;
+    }
+    return changes;
+}
+
+static aint_t remove_dead_code(
+    ainstruction_t* is, aint_t n, aint_t* stack, uint8_t* reached)
+{
+    aint_t changes = 0;
+    aint_t sp = 0;
+    aint_t ip;
+    if (n == 0) return 0;
+    memset(reached, 0, (size_t)n);
+    reached[0] = TRUE;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const aint_t from = stack[--sp];
+        const ainstruction_t* const i = is + from;
+        aint_t next[2];
+        aint_t num_nexts = 0;
+        aint_t k;
+        if (is_jump(i)) next[num_nexts++] = target_of(is, from);
+        if (i->b.opcode != AOC_JMP && i->b.opcode != AOC_RET &&
+            from + 1 < n) {
+            next[num_nexts++] = from + 1;
+        }
+        for (k = 0; k < num_nexts; ++k) {
+            if (reached[next[k]]) continue;
+            reached[next[k]] = TRUE;
+            stack[sp++] = next[k];
+        }
+    }
+    for (ip = 0; ip < n; ++ip) {
+        if (reached[ip] || is[ip].b.opcode == AOC_NOP) continue;
+        is[ip] = ai_nop();
+        ++changes;
+    }
+    return changes;
+}
+
+/** Remove NOPs and fix jump displacements up.
+\brief Jumps to a removed NOP land on the next kept instruction. If there is
+none, as jumps lead to trailing NOPs, the last NOP is kept.
+*/
+static aint_t strip_nops(ainstruction_t* is, aint_t n, aint_t* remap)
+{
+    aint_t tail = n;
+    aint_t last = -1;
+    aint_t kept = 0;
+    aint_t ip;
+    while (tail > 0 && is[tail - 1].b.opcode == AOC_NOP) --tail;
+    for (ip = 0; ip < n; ++ip) {
+        if (is_jump(is + ip) && target_of(is, ip) >= tail) last = n - 1;
+    }
+    for (ip = 0; ip < n; ++ip) {
+        remap[ip] = kept;
+        if (is[ip].b.opcode != AOC_NOP || ip == last) ++kept;
+    }
+    if (kept == n) return 0;
+    for (ip = 0; ip < n; ++ip) {
+        if (is_jump(is + ip)) {
+            set_target(is, ip, remap[target_of(is, ip)] + ip - remap[ip]);
+        }
+    }
+    for (ip = 0; ip < n; ++ip) {
+        if (is[ip].b.opcode != AOC_NOP || ip == last) is[remap[ip]] = is[ip];
+    }
+    return n - kept;
+}
+
+static int32_t valid_jumps(const ainstruction_t* is, aint_t n)
+{
+    aint_t ip;
+    for (ip = 0; ip < n; ++ip) {
+        if (!is_jump(is + ip)) continue;
+        if (target_of(is, ip) < 0 || target_of(is, ip) >= n) return FALSE;
+    }
+    return TRUE;
+}
+
+static aint_t optimize(
+    aasm_t* self, int32_t passes, scratch_t* s, aint_t* cap)
+{
+    aasm_prototype_t* const p = aasm_prototype(self);
+    const aint_t num_nesteds = p->num_nesteds;
+    ainstruction_t* const is = aasm_resolve(self).instructions;
+    aint_t n = p->num_instructions;
+    aint_t removed = 0;
+    aint_t i;
+
+    if (*cap < n) {
+        aalloc(self, s->stack, 0);
+        s->stack = (aint_t*)aalloc(
+            self, NULL, n * (aint_t)(2*sizeof(aint_t) + sizeof(uint8_t)));
+        s->remap = s->stack + n;
+        s->marks = (uint8_t*)(s->remap + n);
+        *cap = n;
+    }
+
+    // passes open up chances for each other, run them until nothing changes
+    while (valid_jumps(is, n)) {
+        aint_t changes = 0;
+        if (passes & AAOP_THREAD_JUMPS) changes += thread_jumps(is, n);
+        if (passes & AAOP_FOLD_LOADS) changes += fold_loads(is, n, s->marks);
+        if (passes & AAOP_DEAD_CODE) {
+            changes += remove_dead_code(is, n, s->stack, s->marks);
+        }
+        if (passes & AAOP_STRIP_NOPS) {
+            const aint_t stripped = strip_nops(is, n, s->remap);
+            n -= stripped;
+            changes += stripped;
+        }
+        if (changes == 0) break;
+    }
+    removed = p->num_instructions - n;
+    p->num_instructions = n;
+
+    for (i = 0; i < num_nesteds; ++i) {
+        aasm_open(self, i);
+        removed += optimize(self, passes, s, cap);
+        aasm_pop(self);
+    }
+    return removed;
+}
+
+aint_t aasm_optimize(aasm_t* self, int32_t passes)
+{
+    scratch_t s;
+    aint_t cap = 0;
+    aint_t removed;
+    memset(&s, 0, sizeof(s));
+    removed = optimize(self, passes, &s, &cap);
+    aalloc(self, s.stack, 0);
+    return removed;
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/bundle.h>
+
+extern const uint8_t BUNDLE_SIGNATURE[4];
+
+static AINLINE aint_t align(aint_t sz)
+{
+    return (sz + ABUNDLE_ALIGN - 1) & ~(aint_t)(ABUNDLE_ALIGN - 1);
+}
+
+// Module name is the symbol of the module prototype.
+static AINLINE const char* module_name(achunk_header_t* chunk)
+{
+    const aprototype_header_t* p = (const aprototype_header_t*)(chunk + 1);
+    return ((const char*)(p + 1)) + p->symbol;
+}
+
+static aint_t strings_size(achunk_header_t* const* chunks, aint_t num_chunks)
+{
+    aint_t i;
+    aint_t sz = 0;
+    for (i = 0; i < num_chunks; ++i) {
+        sz += (aint_t)strlen(module_name(chunks[i])) + 1;
+    }
+    return sz;
+}
+
+aint_t abundle_size(
+    achunk_header_t* const* chunks, const aint_t* chunk_sizes,
+    aint_t num_chunks)
+{
+    aint_t i;
+    aint_t sz = align(
+        sizeof(abundle_header_t) +
+        num_chunks * sizeof(abundle_entry_t) +
+        strings_size(chunks, num_chunks));
+    for (i = 0; i < num_chunks; ++i) sz += align(chunk_sizes[i]);
+    return sz;
+}
+
+void abundle_write(
+    abundle_header_t* bundle, achunk_header_t* const* chunks,
+    const aint_t* chunk_sizes, aint_t num_chunks)
+{
+    aint_t i;
+    abundle_entry_t* const entries = (abundle_entry_t*)(bundle + 1);
+    char* const strings = (char*)(entries + num_chunks);
+    const aint_t strings_sz = strings_size(chunks, num_chunks);
+    aint_t str_off = 0;
+    aint_t off = align((uint8_t*)(strings + strings_sz) - (uint8_t*)bundle);
+
+    memcpy(bundle->signature, BUNDLE_SIGNATURE, sizeof(bundle->signature));
+    bundle->num_chunks = (uint32_t)num_chunks;
+    bundle->strings_sz = (uint32_t)strings_sz;
+    bundle->_ = 0;
+    memset(strings + strings_sz, 0,
+        (size_t)(off - ((uint8_t*)(strings + strings_sz) - (uint8_t*)bundle)));
+
+    for (i = 0; i < num_chunks; ++i) {
+        const char* const name = module_name(chunks[i]);
+        const aint_t len = (aint_t)strlen(name);
+        const aint_t sz = chunk_sizes[i];
+        abundle_entry_t* const e = entries + i;
+        e->name = (uint32_t)str_off;
+        e->_ = 0;
+        e->offset = (uint64_t)off;
+        e->size = (uint64_t)sz;
+        memcpy(strings + str_off, name, (size_t)len + 1);
+        str_off += len + 1;
+        memcpy(((uint8_t*)bundle) + off, chunks[i], (size_t)sz);
+        memset(((uint8_t*)bundle) + off + sz, 0, (size_t)(align(sz) - sz));
+        off += align(sz);
+    }
+}
@@ -1,7 +1,22 @@
 /* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
 #include <any/actor.h>
 
+#include <any/loader.h>
 #include <any/gc_string.h>
+#include <any/gc_tuple.h>
+#include <any/gc_array.h>
+#include <any/gc_table.h>
+
+// Restart `frame` with `npt`, arguments are kept and locals are dropped.
+// The mailbox is rewound, messages skipped by the old code are seen again.
+static void reenter(aactor_t* a, aframe_t* frame, aprototype_t* npt)
+{
+    av_byte_code_func(a->stack.v + frame->bp - frame->nargs - 1, npt);
+    a->stack.sp = frame->bp;
+    frame->pt = npt;
+    frame->ip = -1;
+    any_mbox_rewind(a);
+}
 
 void actor_dispatch(aactor_t* a)
 {
@@ -10,6 +25,7 @@ void actor_dispatch(aactor_t* a)
     aprototype_header_t* pth = pt->header;
     for (; frame->ip < pth->num_instructions; ++frame->ip) {
         ainstruction_t* i = pt->instructions + frame->ip;
+        // operands are proven in range when the chunk is loaded
         switch (i->b.opcode) {
         case AOC_NOP:
             break;
@@ -18,11 +34,7 @@ void actor_dispatch(aactor_t* a)
             break;
         case AOC_LDK: {
             aconstant_t* c = pt->constants + i->ldk.idx;
-            if (i->ldk.idx < 0 || i->ldk.idx >= pth->num_constants) {
-                any_error(a, AERR_RUNTIME,
-                    "bad constant index %d", i->ldk.idx);
-            }
-            switch (pt->constants[i->ldk.idx].type) {
+            switch (c->type) {
             case ACT_INTEGER:
                 any_push_integer(a, c->integer);
                 break;
@@ -32,9 +44,6 @@ void actor_dispatch(aactor_t* a)
             case ACT_REAL:
                 any_push_real(a, c->real);
                 break;
-            default:
-                any_error(a, AERR_RUNTIME, "bad constant type");
-                break;
             }
             break;
         }
@@ -53,40 +62,36 @@ void actor_dispatch(aactor_t* a)
         case AOC_SLV:
             any_insert(a, i->slv.idx);
             break;
-        case AOC_IMP:
-            if (i->imp.idx < 0 || i->imp.idx >= pth->num_imports) {
-                any_error(a, AERR_RUNTIME, "bad import index %d", i->imp.idx);
-            } else {
-                aactor_push(a, pt->import_values + i->imp.idx);
+        case AOC_IMP: {
+            avalue_t* const v = pt->import_values + i->imp.idx;
+            // lazy linking leaves imports as nil until the first use
+            if (av_type(v) == AVT_NIL && aloader_resolve(
+                &a->owner->loader, pt, i->imp.idx) != AERR_NONE) {
+                aimport_t* const imp = pt->imports + i->imp.idx;
+                any_error(a, AERR_UNRESOLVED, "unresolved import %s:%s",
+                    pt->strings + imp->module, pt->strings + imp->name);
             }
+            aactor_push(a, v);
             break;
-        case AOC_CLS:
-            if (i->cls.idx < 0 || i->cls.idx >= pth->num_nesteds) {
-                any_error(a, AERR_RUNTIME, "bad nested index %d", i->cls.idx);
-            } else {
-                avalue_t v;
-                av_byte_code_func(&v, pt->nesteds + i->cls.idx);
-                aactor_push(a, &v);
-            }
+        }
+        case AOC_CLS: {
+            avalue_t v;
+            av_byte_code_func(&v, pt->nesteds + i->cls.idx);
+            aactor_push(a, &v);
             break;
+        }
 jmp:
-        case AOC_JMP: {
-            aint_t nip = frame->ip + i->jmp.displacement + 1;
-            if (nip < 0 || nip >= pth->num_instructions) {
-                any_error(a, AERR_RUNTIME, "bad jump");
-            } else {
-                frame->ip = nip - 1;
-            }
+        case AOC_JMP:
+            frame->ip += i->jmp.displacement;
             break;
-        }
         case AOC_JIN: {
             avalue_t v;
             any_pop(a, 1);
             v = a->stack.v[a->stack.sp];
-            if (v.tag.type != AVT_BOOLEAN && v.tag.type != AVT_NIL) {
+            if (av_type(&v) != AVT_BOOLEAN && av_type(&v) != AVT_NIL) {
                 any_error(a, AERR_RUNTIME, "condition must be boolean or nil");
             }
-            if (v.tag.type != AVT_NIL && v.v.boolean) continue;
+            if (av_type(&v) != AVT_NIL && av_to_boolean(&v)) continue;
             goto jmp;
         }
         case AOC_IVK:
@@ -99,13 +104,23 @@ jmp:
             break;
         case AOC_RCV: {
             avalue_t timeout = a->stack.v[a->stack.sp - 1];
-            if (timeout.tag.type != AVT_INTEGER) {
+            aprototype_t* npt;
+            if (av_type(&timeout) != AVT_INTEGER) {
                 any_error(a, AERR_RUNTIME, "timeout must be integer");
-            } else {
-                if (any_mbox_recv(a, timeout.v.integer) == AERR_TIMEOUT) {
-                    goto jmp;
+            }
+            // receives are the safe points to move to new code, waiting
+            // actors are woken up by the scheduler to do so
+            npt = aactor_new_version(a);
+            if (npt == NULL) {
+                if (any_mbox_recv(a, av_to_integer(&timeout)) == AERR_NONE) {
+                    break;
                 }
+                npt = aactor_new_version(a);
+                if (npt == NULL) goto jmp;
             }
+            reenter(a, frame, npt);
+            pt = npt;
+            pth = pt->header;
             break;
         }
         case AOC_RMV:
@@ -114,6 +129,28 @@ jmp:
         case AOC_RWD:
             any_mbox_rewind(a);
             break;
+        case AOC_TUP:
+            any_push_tuple(a, i->tup.n);
+            break;
+        case AOC_ARR:
+            any_push_array(a, i->arr.cap);
+            break;
+        case AOC_TBL:
+            any_push_table(a, i->tbl.cap);
+            break;
+        case AOC_GET:
+            if (any_count(a) < 2) {
+                any_error(a, AERR_RUNTIME, "not enough values to get");
+            }
+            any_get(a, any_count(a) - 2);
+            any_insert(a, any_count(a) - 2);
+            break;
+        case AOC_SET:
+            if (any_count(a) < 3) {
+                any_error(a, AERR_RUNTIME, "not enough values to set");
+            }
+            any_set(a, any_count(a) - 3);
+            break;
         default:
             any_error(a, AERR_RUNTIME, "bad instruction %u", i->b.opcode);
             break;
@@ -3,12 +3,20 @@
 
 #define GROW_FACTOR 2
 #define NOT_FORWARED -1
+#define LARGE_MARKED -2
+#define MIN_LOS_CAP 8
+#define LOS_MIN_OBJECTS 4
 
 static AINLINE void* aalloc(agc_t* self, void* old, const aint_t sz)
 {
     return self->alloc(self->alloc_ud, old, sz);
 }
 
+static AINLINE void* alloc_los(agc_t* self, void* old, const aint_t sz)
+{
+    return self->large_alloc(self->large_alloc_ud, old, sz);
+}
+
 static AINLINE uint8_t* low_heap(agc_t* self)
 {
     return self->cur_heap < self->new_heap ? self->cur_heap : self->new_heap;
@@ -21,23 +29,54 @@ static AINLINE void swap(agc_t* self)
     self->new_heap = tmp;
 }
 
+// Header of an object which is already copied or marked.
+static AINLINE agc_header_t* new_header(agc_t* self, aint_t idx)
+{
+    return (idx & AGC_LARGE_BIT)
+        ? self->los[idx ^ AGC_LARGE_BIT].obj
+        : (agc_header_t*)(self->new_heap + idx);
+}
+
+static AINLINE void mark(agc_t* self, aint_t idx)
+{
+    aint_t slot = idx ^ AGC_LARGE_BIT;
+    agc_large_t* l = self->los + slot;
+    if (l->obj->forwared != NOT_FORWARED) return;
+    l->obj->forwared = LARGE_MARKED;
+    l->next = self->los_gray;
+    self->los_gray = slot;
+}
+
 static AINLINE void copy(agc_t* self, avalue_t* v)
 {
     agc_header_t* ogch;
     agc_header_t* ngch;
-    if (v->tag.collectable == FALSE) return;
-    ogch = (agc_header_t*)(self->cur_heap + v->v.heap_idx);
+    if (av_is_collectable(v) == FALSE) {
+        if (av_type(v) == AVT_BYTE_CODE_FUNC) {
+            const aint_t epoch = av_to_byte_code_func(v)->chunk->epoch;
+            if (epoch > 0 && epoch < self->code_epoch) {
+                self->code_epoch = epoch;
+            }
+        }
+        return;
+    }
+    if (av_heap_idx(v) & AGC_LARGE_BIT) {
+        mark(self, av_heap_idx(v));
+        return;
+    }
+    ogch = (agc_header_t*)(self->cur_heap + av_heap_idx(v));
     ngch = (agc_header_t*)(self->new_heap + self->heap_sz);
     if (ogch->forwared == NOT_FORWARED) {
         memcpy(ngch, ogch, (size_t)ogch->sz);
         ogch->forwared = self->heap_sz;
         self->heap_sz += ogch->sz;
     }
-    v->v.heap_idx = ogch->forwared;
+    av_collectable(v, av_type(v), ogch->forwared);
 }
 
 static AINLINE void scan(agc_t* self, agc_header_t* gch)
 {
+    aint_t i;
     switch (gch->type) {
     case AVT_NIL:
     case AVT_PID:
@@ -54,29 +93,192 @@ static AINLINE void scan(agc_t* self, agc_header_t* gch)
     case AVT_BUFFER:
         copy(self, &((agc_buffer_t*)(gch + 1))->buff);
         break;
-    case AVT_TUPLE:
-    case AVT_ARRAY:
-    case AVT_TABLE:
-        assert(!"TODO");
+    case AVT_TUPLE: {
+        agc_tuple_t* o = (agc_tuple_t*)(gch + 1);
+        avalue_t* vs = (avalue_t*)(o + 1);
+        for (i = 0; i < o->sz; ++i) copy(self, vs + i);
+        break;
+    }
+    case AVT_ARRAY: {
+        // values are traced here, the fixed buffer itself is opaque
+        agc_array_t* o = (agc_array_t*)(gch + 1);
+        avalue_t* vs;
+        copy(self, &o->buff);
+        vs = (avalue_t*)(new_header(self, av_heap_idx(&o->buff)) + 1);
+        for (i = 0; i < o->sz; ++i) copy(self, vs + i);
         break;
+    }
+    case AVT_TABLE: {
+        agc_table_t* o = (agc_table_t*)(gch + 1);
+        agc_table_entry_t* es;
+        copy(self, &o->buff);
+        es = (agc_table_entry_t*)(new_header(self, av_heap_idx(&o->buff)) + 1);
+        for (i = 0; i < o->cap; ++i) {
+            copy(self, &es[i].key);
+            copy(self, &es[i].value);
+        }
+        break;
+    }
     default: assert(!"bad value type");
     }
 }
 
+static aerror_t resize(agc_t* self, aint_t new_cap)
+{
+    agc_stats_t* const st = &self->stats;
+    uint8_t* nh = (uint8_t*)aalloc(self, NULL, new_cap * 2);
+    if (!nh) return AERR_FULL;
+    memcpy(nh, self->cur_heap, (size_t)self->heap_sz);
+    aalloc(self, low_heap(self), 0);
+    if (new_cap > self->heap_cap) ++st->grows;
+    else ++st->shrinks;
+    self->cur_heap = nh;
+    self->new_heap = nh + new_cap;
+    self->heap_cap = new_cap;
+    st->heap_cap = new_cap;
+    if (new_cap > st->heap_cap_high_water) st->heap_cap_high_water = new_cap;
+    return AERR_NONE;
+}
+
+static void record_pause(agc_stats_t* st, aint_t nsecs)
+{
+    int32_t bucket = 0;
+    while (bucket < AGC_PAUSE_BUCKETS - 1 && (nsecs >> (bucket + 1)) != 0) {
+        ++bucket;
+    }
+    ++st->pause_histogram[bucket];
+    st->pause_total_nsecs += nsecs;
+    if (nsecs > st->pause_max_nsecs) st->pause_max_nsecs = nsecs;
+}
+
+static aerror_t grow_los(agc_t* self)
+{
+    aint_t i;
+    aint_t new_cap = self->los_cap ? self->los_cap * GROW_FACTOR : MIN_LOS_CAP;
+    agc_large_t* los = (agc_large_t*)aalloc(
+        self, self->los, new_cap * (aint_t)sizeof(agc_large_t));
+    if (!los) return AERR_FULL;
+    for (i = new_cap - 1; i >= self->los_cap; --i) {
+        los[i].obj = NULL;
+        los[i].next = self->los_free;
+        self->los_free = i;
+    }
+    self->los = los;
+    self->los_cap = new_cap;
+    return AERR_NONE;
+}
+
+// The budget never drops below a few objects of the large threshold size.
+static AINLINE aint_t los_floor(agc_t* self)
+{
+    const aint_t sz = LOS_MIN_OBJECTS *
+        (self->policy.large_threshold + (aint_t)sizeof(agc_header_t));
+    return sz > self->heap_cap ? sz : self->heap_cap;
+}
+
+static aint_t alloc_large(agc_t* self, atype_t type, aint_t sz)
+{
+    agc_header_t* gch;
+    aint_t slot;
+    aint_t more = sz + sizeof(agc_header_t);
+    // the policy may have been changed since the last sweep
+    if (self->los_budget < los_floor(self)) self->los_budget = los_floor(self);
+    if (self->los_sz + more > self->los_budget) return AERR_FULL;
+    if (self->los_free < 0 && grow_los(self) != AERR_NONE) return AERR_FULL;
+    gch = (agc_header_t*)alloc_los(self, NULL, more);
+    if (!gch) return AERR_FULL;
+    slot = self->los_free;
+    self->los_free = self->los[slot].next;
+    self->los[slot].obj = gch;
+    gch->type = type;
+    gch->forwared = NOT_FORWARED;
+    gch->sz = more;
+    self->los_sz += more;
+    return AGC_LARGE_BIT | slot;
+}
+
+// Free unmarked large objects, the budget is twice of the survivors.
+static void sweep(agc_t* self)
+{
+    aint_t i;
+    for (i = 0; i < self->los_cap; ++i) {
+        agc_large_t* l = self->los + i;
+        if (!l->obj) continue;
+        if (l->obj->forwared == LARGE_MARKED) {
+            l->obj->forwared = NOT_FORWARED;
+            continue;
+        }
+        self->los_sz -= l->obj->sz;
+        alloc_los(self, l->obj, 0);
+        l->obj = NULL;
+        l->next = self->los_free;
+        self->los_free = i;
+    }
+    self->los_budget = self->los_sz * GROW_FACTOR;
+    if (self->los_budget < los_floor(self)) self->los_budget = los_floor(self);
+}
+
+static AINLINE int32_t is_large(agc_t* self, aint_t sz)
+{
+    return self->policy.large_threshold > 0 &&
+        sz >= self->policy.large_threshold;
+}
+
+static void adapt(agc_t* self)
+{
+    const agc_policy_t* const p = &self->policy;
+    const aint_t cap = self->heap_cap;
+    if (self->heap_sz * 100 > cap * p->grow_percent) {
+        // failed to grow is fine, there are still free space
+        self->sparse_cycles = 0;
+        resize(self, cap * GROW_FACTOR);
+    } else if (self->heap_sz * 100 >= cap * p->shrink_percent ||
+        self->heap_sz > cap / GROW_FACTOR ||
+        cap / GROW_FACTOR < p->min_heap_cap) {
+        self->sparse_cycles = 0;
+    } else if (++self->sparse_cycles >= p->shrink_cycles) {
+        self->sparse_cycles = 0;
+        resize(self, cap / GROW_FACTOR);
+    }
+}
+
 aerror_t agc_init(agc_t* self, aint_t heap_cap, aalloc_t alloc, void* alloc_ud)
 {
     self->alloc = alloc;
     self->alloc_ud = alloc_ud;
+    self->large_alloc = alloc;
+    self->large_alloc_ud = alloc_ud;
     self->cur_heap = (uint8_t*)aalloc(self, NULL, heap_cap*2);
     if (!self->cur_heap) return AERR_FULL;
     self->new_heap = self->cur_heap + heap_cap;
     self->heap_cap = heap_cap;
     self->heap_sz = 0;
+    self->policy = agc_default_policy(heap_cap);
+    self->sparse_cycles = 0;
+    memset(&self->stats, 0, sizeof(agc_stats_t));
+    self->stats.heap_cap = heap_cap;
+    self->stats.heap_cap_high_water = heap_cap;
+    self->los = NULL;
+    self->los_cap = 0;
+    self->los_free = -1;
+    self->los_gray = -1;
+    self->los_sz = 0;
+    self->los_budget = los_floor(self);
+    self->code_epoch = 0;
     return AERR_NONE;
 }
 
 void agc_cleanup(agc_t* self)
 {
+    aint_t i;
+    for (i = 0; i < self->los_cap; ++i) {
+        if (self->los[i].obj) alloc_los(self, self->los[i].obj, 0);
+    }
+    if (self->los) aalloc(self, self->los, 0);
+    self->los = NULL;
+    self->los_cap = 0;
+    self->los_free = -1;
+    self->los_sz = 0;
     aalloc(self, low_heap(self), 0);
     self->new_heap = NULL;
     self->cur_heap = NULL;
@@ -90,6 +292,7 @@ aint_t agc_alloc(agc_t* self, atype_t type, aint_t sz)
     aint_t more = sz + sizeof(agc_header_t);
     aint_t new_heap_sz = self->heap_sz + more;
     aint_t heap_idx = self->heap_sz;
+    if (is_large(self, sz)) return alloc_large(self, type, sz);
     if (new_heap_sz > self->heap_cap) return AERR_FULL;
     self->heap_sz = new_heap_sz;
     gch = ((agc_header_t*)(self->cur_heap + heap_idx));
@@ -101,23 +304,28 @@ aint_t agc_alloc(agc_t* self, atype_t type, aint_t sz)
 
 aerror_t agc_reserve(agc_t* self, aint_t more)
 {
-    uint8_t* nh;
     aint_t new_cap = self->heap_cap;
+    if (is_large(self, more)) {
+        more += sizeof(agc_header_t);
+        if (self->los_budget < self->los_sz + more) {
+            self->los_budget = (self->los_sz + more) * GROW_FACTOR;
+        }
+        return AERR_NONE;
+    }
     more += sizeof(agc_header_t);
     while (new_cap < self->heap_sz + more) new_cap *= GROW_FACTOR;
-    nh = (uint8_t*)aalloc(self, NULL, new_cap * 2);
-    if (!nh) return AERR_FULL;
-    memcpy(nh, self->cur_heap, (size_t)self->heap_sz);
-    aalloc(self, low_heap(self), 0);
-    self->cur_heap = nh;
-    self->new_heap = nh + new_cap;
-    self->heap_cap = new_cap;
-    return AERR_NONE;
+    return resize(self, new_cap);
 }
 
 void agc_collect(agc_t* self, avalue_t** roots, aint_t* num_roots)
 {
+    agc_stats_t* const st = &self->stats;
+    atimer_t timer;
     aint_t i;
+    atimer_start(&timer);
+    if (self->heap_sz > st->heap_sz_high_water) {
+        st->heap_sz_high_water = self->heap_sz;
+    }
     self->heap_sz = 0;
     self->scan = 0;
     for (; *roots; ++roots, ++num_roots) {
@@ -125,10 +333,56 @@ void agc_collect(agc_t* self, avalue_t** roots, aint_t* num_roots)
             copy(self, *roots + i);
         }
     }
-    while (self->scan != self->heap_sz) {
-        agc_header_t* header = (agc_header_t*)(self->new_heap + self->scan);
-        scan(self, header);
-        self->scan += header->sz;
+    for (;;) {
+        while (self->scan != self->heap_sz) {
+            agc_header_t* header = (agc_header_t*)(self->new_heap + self->scan);
+            scan(self, header);
+            self->scan += header->sz;
+        }
+        // large objects are scanned in place, that may copy more objects
+        if (self->los_gray < 0) break;
+        i = self->los_gray;
+        self->los_gray = self->los[i].next;
+        scan(self, self->los[i].obj);
     }
     swap(self);
+    ++st->collections;
+    st->bytes_copied += self->heap_sz;
+    adapt(self);
+    sweep(self);
+    record_pause(st, atimer_delta_nsecs(&timer));
+}
+
+void agc_stats_merge(agc_stats_t* self, const agc_stats_t* other)
+{
+    int32_t i;
+    self->collections += other->collections;
+    self->pause_total_nsecs += other->pause_total_nsecs;
+    if (other->pause_max_nsecs > self->pause_max_nsecs) {
+        self->pause_max_nsecs = other->pause_max_nsecs;
+    }
+    for (i = 0; i < AGC_PAUSE_BUCKETS; ++i) {
+        self->pause_histogram[i] += other->pause_histogram[i];
+    }
+    self->bytes_copied += other->bytes_copied;
+    self->grows += other->grows;
+    self->shrinks += other->shrinks;
+    self->heap_cap += other->heap_cap;
+    if (other->heap_cap_high_water > self->heap_cap_high_water) {
+        self->heap_cap_high_water = other->heap_cap_high_water;
+    }
+    if (other->heap_sz_high_water > self->heap_sz_high_water) {
+        self->heap_sz_high_water = other->heap_sz_high_water;
+    }
+}
+
+void agc_shrink(agc_t* self)
+{
+    aint_t new_cap = self->heap_cap;
+    while (new_cap / GROW_FACTOR >= self->policy.min_heap_cap &&
+        self->heap_sz * 2 <= new_cap / GROW_FACTOR) {
+        new_cap /= GROW_FACTOR;
+    }
+    self->sparse_cycles = 0;
+    if (new_cap != self->heap_cap) resize(self, new_cap);
 }
\ No newline at end of file
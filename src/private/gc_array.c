@@ -0,0 +1,65 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/gc_array.h>
+
+#define MIN_CAP 4
+#define GROW_FACTOR 2
+
+static AINLINE agc_array_t* array_at(aactor_t* a, aint_t idx)
+{
+    return AGC_CAST(agc_array_t, &a->gc, av_heap_idx(a->stack.v + idx));
+}
+
+// Push a fixed buffer of `cap` values, the buffer is rooted by the stack.
+static void push_values(aactor_t* a, aint_t cap)
+{
+    avalue_t v;
+    aint_t oi = aactor_alloc(a, AVT_FIXED_BUFFER, cap*sizeof(avalue_t));
+    if (oi < 0) any_error(a, (aerror_t)oi, "out of memory");
+    av_collectable(&v, AVT_FIXED_BUFFER, oi);
+    aactor_push(a, &v);
+}
+
+static void grow(aactor_t* a, aint_t arr)
+{
+    agc_array_t* o = array_at(a, arr);
+    aint_t new_cap = o->cap < MIN_CAP ? MIN_CAP : o->cap*GROW_FACTOR;
+    avalue_t* nb;
+    push_values(a, new_cap);
+    o = array_at(a, arr);
+    nb = AGC_CAST(avalue_t, &a->gc, av_heap_idx(a->stack.v + a->stack.sp - 1));
+    memcpy(nb, agc_array_values(&a->gc, o), sizeof(avalue_t)*(size_t)o->sz);
+    o->buff = a->stack.v[a->stack.sp - 1];
+    o->cap = new_cap;
+    --a->stack.sp;
+}
+
+void any_push_array(aactor_t* a, aint_t cap)
+{
+    agc_array_t* o;
+    aint_t oi;
+    if (cap < 0) {
+        any_error(a, AERR_RUNTIME, "bad array capacity %d", (int32_t)cap);
+    }
+    push_values(a, cap);
+    oi = aactor_alloc(a, AVT_ARRAY, sizeof(agc_array_t));
+    if (oi < 0) any_error(a, (aerror_t)oi, "out of memory");
+    o = AGC_CAST(agc_array_t, &a->gc, oi);
+    o->buff = a->stack.v[a->stack.sp - 1];
+    o->cap = cap;
+    o->sz = 0;
+    av_collectable(a->stack.v + a->stack.sp - 1, AVT_ARRAY, oi);
+}
+
+void agc_array_set(aactor_t* a, aint_t arr, aint_t i, aint_t value)
+{
+    agc_array_t* o = array_at(a, arr);
+    if (i < 0 || i > o->sz) {
+        any_error(a, AERR_RUNTIME, "index %d out of range", (int32_t)i);
+    }
+    if (i == o->cap) {
+        grow(a, arr);
+        o = array_at(a, arr);
+    }
+    agc_array_values(&a->gc, o)[i] = a->stack.v[value];
+    if (i == o->sz) ++o->sz;
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/gc_buffer.h>
+
+#define MIN_CAP 16
+#define GROW_FACTOR 2
+
+static AINLINE agc_buffer_t* buffer_at(aactor_t* a, aint_t idx)
+{
+    return AGC_CAST(agc_buffer_t, &a->gc, av_heap_idx(a->stack.v + idx));
+}
+
+// Push a fixed buffer of `cap` bytes, the buffer is rooted by the stack.
+static void push_bytes(aactor_t* a, aint_t cap)
+{
+    avalue_t v;
+    aint_t oi = aactor_alloc(a, AVT_FIXED_BUFFER, cap);
+    if (oi < 0) any_error(a, (aerror_t)oi, "out of memory");
+    av_collectable(&v, AVT_FIXED_BUFFER, oi);
+    aactor_push(a, &v);
+}
+
+// Push a buffer object over the fixed buffer on top of the stack, which is
+// replaced by the new buffer.
+static agc_buffer_t* wrap(aactor_t* a, aint_t off, aint_t cap, aint_t sz)
+{
+    agc_buffer_t* o;
+    aint_t oi = aactor_alloc(a, AVT_BUFFER, sizeof(agc_buffer_t));
+    if (oi < 0) any_error(a, (aerror_t)oi, "out of memory");
+    o = AGC_CAST(agc_buffer_t, &a->gc, oi);
+    o->buff = a->stack.v[a->stack.sp - 1];
+    o->off = off;
+    o->cap = cap;
+    o->sz = sz;
+    av_collectable(a->stack.v + a->stack.sp - 1, AVT_BUFFER, oi);
+    return o;
+}
+
+void any_push_buffer(aactor_t* a, aint_t cap)
+{
+    if (cap < 0) {
+        any_error(a, AERR_RUNTIME, "bad buffer capacity %d", (int32_t)cap);
+    }
+    push_bytes(a, cap);
+    wrap(a, 0, cap, 0);
+}
+
+void agc_buffer_reserve(aactor_t* a, aint_t buf, aint_t more)
+{
+    agc_buffer_t* o = buffer_at(a, buf);
+    aint_t new_cap;
+    if (more < 0) {
+        any_error(a, AERR_RUNTIME, "bad buffer size %d", (int32_t)more);
+    }
+    if (o->cap - o->sz >= more) return;
+    new_cap = o->cap < MIN_CAP ? MIN_CAP : o->cap*GROW_FACTOR;
+    if (new_cap < o->sz + more) new_cap = o->sz + more;
+    push_bytes(a, new_cap);
+    o = buffer_at(a, buf);
+    memcpy(AGC_CAST(uint8_t, &a->gc, av_heap_idx(a->stack.v + a->stack.sp - 1)),
+        agc_buffer_data(&a->gc, o), (size_t)o->sz);
+    o->buff = a->stack.v[a->stack.sp - 1];
+    o->off = 0;
+    o->cap = new_cap;
+    --a->stack.sp;
+}
+
+void agc_buffer_append(aactor_t* a, aint_t buf, const void* data, aint_t sz)
+{
+    agc_buffer_t* o;
+    agc_buffer_reserve(a, buf, sz);
+    o = buffer_at(a, buf);
+    memcpy(agc_buffer_data(&a->gc, o) + o->sz, data, (size_t)sz);
+    o->sz += sz;
+}
+
+void agc_buffer_append_value(aactor_t* a, aint_t buf, aint_t value)
+{
+    avalue_t* v = a->stack.v + value;
+    agc_buffer_t* o;
+    uint8_t byte;
+    switch (av_type(v)) {
+    case AVT_INTEGER:
+        if (av_to_integer(v) < 0 || av_to_integer(v) > 0xFF) {
+            any_error(a, AERR_RUNTIME, "byte %d out of range",
+                (int32_t)av_to_integer(v));
+        }
+        byte = (uint8_t)av_to_integer(v);
+        agc_buffer_append(a, buf, &byte, 1);
+        break;
+    case AVT_STRING: {
+        agc_string_t* s = AGC_CAST(agc_string_t, &a->gc, av_heap_idx(v));
+        aint_t sz = s->hal.length;
+        agc_buffer_reserve(a, buf, sz);
+        // reserve may collect, look the string up again
+        s = AGC_CAST(agc_string_t, &a->gc, av_heap_idx(a->stack.v + value));
+        o = buffer_at(a, buf);
+        memcpy(agc_buffer_data(&a->gc, o) + o->sz, s + 1, (size_t)sz);
+        o->sz += sz;
+        break;
+    }
+    case AVT_BUFFER: {
+        aint_t sz = buffer_at(a, value)->sz;
+        agc_buffer_reserve(a, buf, sz);
+        // appending a buffer to itself reads the bytes being extended
+        o = buffer_at(a, buf);
+        memmove(agc_buffer_data(&a->gc, o) + o->sz,
+            agc_buffer_data(&a->gc, buffer_at(a, value)), (size_t)sz);
+        o->sz += sz;
+        break;
+    }
+    default:
+        any_error(a, AERR_RUNTIME, "cannot append to buffer");
+        break;
+    }
+}
+
+void any_push_buffer_view(aactor_t* a, aint_t buf, aint_t from, aint_t to)
+{
+    agc_buffer_t* o = buffer_at(a, buf);
+    if (from < 0 || to < from || to > o->sz) {
+        any_error(a, AERR_RUNTIME, "bad view [%d, %d) of buffer size %d",
+            (int32_t)from, (int32_t)to, (int32_t)o->sz);
+    }
+    aactor_push(a, &o->buff);
+    wrap(a, o->off + from, to - from, to - from);
+}
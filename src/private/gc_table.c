@@ -0,0 +1,239 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/gc_table.h>
+
+#include <any/gc_string.h>
+
+#define MIN_CAP 4
+#define GROW_FACTOR 2
+
+// Maximum load factor is 3/4.
+#define IS_OVERLOADED(sz, cap) ((sz)*4 > (cap)*3)
+
+static AINLINE agc_table_t* table_at(aactor_t* a, aint_t idx)
+{
+    return AGC_CAST(agc_table_t, &a->gc, av_heap_idx(a->stack.v + idx));
+}
+
+static AINLINE uint32_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+static AINLINE uint32_t hash_of(aactor_t* a, const avalue_t* k)
+{
+    switch (av_type(k)) {
+    case AVT_STRING:
+        return AGC_CAST(agc_string_t, &a->gc, av_heap_idx(k))->hal.hash;
+    case AVT_PID:
+        return mix(av_to_pid(k));
+    case AVT_BOOLEAN:
+        return (uint32_t)av_to_boolean(k);
+    case AVT_INTEGER:
+        return mix((uint64_t)av_to_integer(k));
+    case AVT_REAL: {
+        // +0.0 and -0.0 are equal, they must have the same hash
+        areal_t r = av_to_real(k);
+        uint64_t bits = 0;
+        if (r != 0) memcpy(&bits, &r, sizeof(r));
+        return mix(bits);
+    }
+    case AVT_POINTER:
+        return mix((uint64_t)(size_t)av_to_pointer(k));
+    case AVT_NATIVE_FUNC:
+        return mix((uint64_t)(size_t)av_to_native_func(k));
+    case AVT_BYTE_CODE_FUNC:
+        return mix((uint64_t)(size_t)av_to_byte_code_func(k));
+    default:
+        assert(!"bad key type");
+        return 0;
+    }
+}
+
+static AINLINE int32_t equals(
+    aactor_t* a, const avalue_t* x, const avalue_t* y)
+{
+    if (av_type(x) != av_type(y)) return FALSE;
+    switch (av_type(x)) {
+    case AVT_STRING: {
+        agc_string_t* xs;
+        agc_string_t* ys;
+        if (av_heap_idx(x) == av_heap_idx(y)) return TRUE;
+        xs = AGC_CAST(agc_string_t, &a->gc, av_heap_idx(x));
+        ys = AGC_CAST(agc_string_t, &a->gc, av_heap_idx(y));
+        return
+            xs->hal.hash == ys->hal.hash &&
+            xs->hal.length == ys->hal.length &&
+            memcmp(xs + 1, ys + 1, (size_t)xs->hal.length) == 0;
+    }
+    case AVT_PID:
+        return av_to_pid(x) == av_to_pid(y);
+    case AVT_BOOLEAN:
+        return av_to_boolean(x) == av_to_boolean(y);
+    case AVT_INTEGER:
+        return av_to_integer(x) == av_to_integer(y);
+    case AVT_REAL:
+        return av_to_real(x) == av_to_real(y);
+    case AVT_POINTER:
+        return av_to_pointer(x) == av_to_pointer(y);
+    case AVT_NATIVE_FUNC:
+        return av_to_native_func(x) == av_to_native_func(y);
+    case AVT_BYTE_CODE_FUNC:
+        return av_to_byte_code_func(x) == av_to_byte_code_func(y);
+    default:
+        return FALSE;
+    }
+}
+
+static void check_key(aactor_t* a, const avalue_t* k)
+{
+    if (av_type(k) == AVT_NIL) {
+        any_error(a, AERR_RUNTIME, "table key must not be nil");
+    }
+    if (av_type(k) == AVT_REAL && av_to_real(k) != av_to_real(k)) {
+        any_error(a, AERR_RUNTIME, "table key must not be NaN");
+    }
+    if (av_is_collectable(k) && av_type(k) != AVT_STRING) {
+        any_error(a, AERR_RUNTIME, "not supported key type");
+    }
+}
+
+// Returns the slot of `key` if found, otherwise the first empty slot.
+static AINLINE aint_t probe(
+    aactor_t* a, agc_table_t* t, const avalue_t* key, uint32_t hash)
+{
+    agc_table_entry_t* e = agc_table_entries(&a->gc, t);
+    aint_t mask = t->cap - 1;
+    aint_t i = (aint_t)hash & mask;
+    while (av_type(&e[i].key) != AVT_NIL) {
+        if (equals(a, &e[i].key, key)) return i;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Push a fixed buffer of `cap` empty entries, rooted by the stack.
+static void push_entries(aactor_t* a, aint_t cap)
+{
+    avalue_t v;
+    agc_table_entry_t* e;
+    aint_t i;
+    aint_t oi = aactor_alloc(
+        a, AVT_FIXED_BUFFER, cap*sizeof(agc_table_entry_t));
+    if (oi < 0) any_error(a, (aerror_t)oi, "out of memory");
+    e = AGC_CAST(agc_table_entry_t, &a->gc, oi);
+    for (i = 0; i < cap; ++i) {
+        av_nil(&e[i].key);
+        av_nil(&e[i].value);
+    }
+    av_collectable(&v, AVT_FIXED_BUFFER, oi);
+    aactor_push(a, &v);
+}
+
+static void grow(aactor_t* a, aint_t t)
+{
+    agc_table_t* o = table_at(a, t);
+    agc_table_entry_t* oe;
+    agc_table_entry_t* ne;
+    aint_t new_cap = o->cap*GROW_FACTOR;
+    aint_t mask = new_cap - 1;
+    aint_t i;
+    push_entries(a, new_cap);
+    o = table_at(a, t);
+    oe = agc_table_entries(&a->gc, o);
+    ne = AGC_CAST(
+        agc_table_entry_t, &a->gc,
+        av_heap_idx(a->stack.v + a->stack.sp - 1));
+    for (i = 0; i < o->cap; ++i) {
+        aint_t j;
+        if (av_type(&oe[i].key) == AVT_NIL) continue;
+        j = (aint_t)hash_of(a, &oe[i].key) & mask;
+        while (av_type(&ne[j].key) != AVT_NIL) j = (j + 1) & mask;
+        ne[j] = oe[i];
+    }
+    o->buff = a->stack.v[a->stack.sp - 1];
+    o->cap = new_cap;
+    --a->stack.sp;
+}
+
+// Backward shift deletion, keeps the probing sequences unbroken.
+static void erase(aactor_t* a, agc_table_t* t, aint_t i)
+{
+    agc_table_entry_t* e = agc_table_entries(&a->gc, t);
+    aint_t mask = t->cap - 1;
+    aint_t j = i;
+    for (;;) {
+        aint_t k;
+        j = (j + 1) & mask;
+        if (av_type(&e[j].key) == AVT_NIL) break;
+        k = (aint_t)hash_of(a, &e[j].key) & mask;
+        // the entry at `j` must stay if its home `k` is cyclically in (i, j]
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        e[i] = e[j];
+        i = j;
+    }
+    av_nil(&e[i].key);
+    av_nil(&e[i].value);
+    --t->sz;
+}
+
+void any_push_table(aactor_t* a, aint_t cap)
+{
+    agc_table_t* o;
+    aint_t oi;
+    aint_t n = MIN_CAP;
+    if (cap < 0) {
+        any_error(a, AERR_RUNTIME, "bad table capacity %d", (int32_t)cap);
+    }
+    while (IS_OVERLOADED(cap, n)) n *= GROW_FACTOR;
+    push_entries(a, n);
+    oi = aactor_alloc(a, AVT_TABLE, sizeof(agc_table_t));
+    if (oi < 0) any_error(a, (aerror_t)oi, "out of memory");
+    o = AGC_CAST(agc_table_t, &a->gc, oi);
+    o->buff = a->stack.v[a->stack.sp - 1];
+    o->cap = n;
+    o->sz = 0;
+    av_collectable(a->stack.v + a->stack.sp - 1, AVT_TABLE, oi);
+}
+
+avalue_t* agc_table_find(aactor_t* a, const avalue_t* t, const avalue_t* key)
+{
+    agc_table_t* o = AGC_CAST(agc_table_t, &a->gc, av_heap_idx(t));
+    agc_table_entry_t* e;
+    if (av_type(key) == AVT_NIL) return NULL;
+    if (av_is_collectable(key) && av_type(key) != AVT_STRING) return NULL;
+    if (av_type(key) == AVT_REAL && av_to_real(key) != av_to_real(key)) {
+        return NULL;
+    }
+    e = agc_table_entries(&a->gc, o) + probe(a, o, key, hash_of(a, key));
+    return av_type(&e->key) == AVT_NIL ? NULL : &e->value;
+}
+
+void agc_table_set(aactor_t* a, aint_t t, aint_t key, aint_t value)
+{
+    agc_table_t* o = table_at(a, t);
+    agc_table_entry_t* e;
+    uint32_t hash;
+    aint_t i;
+    check_key(a, a->stack.v + key);
+    hash = hash_of(a, a->stack.v + key);
+    i = probe(a, o, a->stack.v + key, hash);
+    e = agc_table_entries(&a->gc, o);
+    if (av_type(&e[i].key) != AVT_NIL) {
+        if (av_type(a->stack.v + value) == AVT_NIL) erase(a, o, i);
+        else e[i].value = a->stack.v[value];
+        return;
+    }
+    if (av_type(a->stack.v + value) == AVT_NIL) return;
+    if (IS_OVERLOADED(o->sz + 1, o->cap)) {
+        grow(a, t);
+        o = table_at(a, t);
+        i = probe(a, o, a->stack.v + key, hash);
+        e = agc_table_entries(&a->gc, o);
+    }
+    e[i].key = a->stack.v[key];
+    e[i].value = a->stack.v[value];
+    ++o->sz;
+}
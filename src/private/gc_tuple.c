@@ -0,0 +1,36 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/gc_tuple.h>
+
+aint_t agc_tuple_new(aactor_t* a, aint_t sz, avalue_t* v)
+{
+    aint_t oi = aactor_alloc(
+        a, AVT_TUPLE, sizeof(agc_tuple_t) + sz*sizeof(avalue_t));
+    if (oi < 0) return oi;
+    else {
+        aint_t i;
+        agc_tuple_t* o = AGC_CAST(agc_tuple_t, &a->gc, oi);
+        avalue_t* vs = agc_tuple_values(&a->gc, o);
+        o->sz = sz;
+        for (i = 0; i < sz; ++i) av_nil(vs + i);
+        av_collectable(v, AVT_TUPLE, oi);
+        return AERR_NONE;
+    }
+}
+
+void any_push_tuple(aactor_t* a, aint_t sz)
+{
+    avalue_t v;
+    aint_t ec;
+    if (sz < 0 || sz > any_count(a)) {
+        any_error(a, AERR_RUNTIME, "bad tuple size %d", (int32_t)sz);
+    }
+    ec = agc_tuple_new(a, sz, &v);
+    if (ec != AERR_NONE) any_error(a, (aerror_t)ec, "out of memory");
+    memcpy(
+        agc_tuple_values(
+            &a->gc, AGC_CAST(agc_tuple_t, &a->gc, av_heap_idx(&v))),
+        a->stack.v + a->stack.sp - sz,
+        sizeof(avalue_t)*(size_t)sz);
+    a->stack.sp -= sz;
+    aactor_push(a, &v);
+}
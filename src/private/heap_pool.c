@@ -0,0 +1,95 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/heap_pool.h>
+
+#define MIN_CLASS 6
+
+// Segment header holds the size class, also keeps the payload aligned.
+#define HEADER_SZ 16
+
+static AINLINE void* aalloc(aheap_pool_t* self, void* old, const aint_t sz)
+{
+    return self->alloc(self->alloc_ud, old, sz);
+}
+
+static AINLINE int32_t class_of(aint_t sz)
+{
+    int32_t c = MIN_CLASS;
+    while (((aint_t)1 << c) < sz) ++c;
+    return c;
+}
+
+static AINLINE int32_t* header_of(void* p)
+{
+    return (int32_t*)((uint8_t*)p - HEADER_SZ);
+}
+
+static void* take(aheap_pool_t* self, aint_t sz)
+{
+    int32_t c = class_of(sz);
+    uint8_t* p;
+    if (c >= AHEAP_POOL_NUM_CLASSES) return NULL;
+    p = (uint8_t*)self->free_lists[c];
+    if (p) {
+        self->free_lists[c] = *(void**)p;
+        self->retained -= (aint_t)1 << c;
+        return p;
+    }
+    p = (uint8_t*)aalloc(self, NULL, ((aint_t)1 << c) + HEADER_SZ);
+    if (!p) return NULL;
+    *(int32_t*)p = c;
+    return p + HEADER_SZ;
+}
+
+static void give_back(aheap_pool_t* self, void* p)
+{
+    int32_t c = *header_of(p);
+    aint_t sz = (aint_t)1 << c;
+    if (self->retained + sz > self->max_retained) {
+        aalloc(self, header_of(p), 0);
+    } else {
+        *(void**)p = self->free_lists[c];
+        self->free_lists[c] = p;
+        self->retained += sz;
+    }
+}
+
+void aheap_pool_init(
+    aheap_pool_t* self, aint_t max_retained, aalloc_t alloc, void* alloc_ud)
+{
+    memset(self, 0, sizeof(aheap_pool_t));
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+    self->max_retained = max_retained;
+}
+
+void aheap_pool_cleanup(aheap_pool_t* self)
+{
+    int32_t c;
+    for (c = 0; c < AHEAP_POOL_NUM_CLASSES; ++c) {
+        void* p = self->free_lists[c];
+        while (p) {
+            void* next = *(void**)p;
+            aalloc(self, header_of(p), 0);
+            p = next;
+        }
+        self->free_lists[c] = NULL;
+    }
+    self->retained = 0;
+}
+
+void* aheap_pool_alloc(void* ud, void* old, aint_t sz)
+{
+    aheap_pool_t* self = (aheap_pool_t*)ud;
+    void* p;
+    if (sz == 0) {
+        if (old) give_back(self, old);
+        return NULL;
+    }
+    if (old && ((aint_t)1 << *header_of(old)) >= sz) return old;
+    p = take(self, sz);
+    if (p && old) {
+        memcpy(p, old, (size_t)1 << *header_of(old));
+        give_back(self, old);
+    }
+    return p;
+}
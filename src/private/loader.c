@@ -3,6 +3,18 @@
 
 #include <any/version.h>
 #include <any/list.h>
+#include <any/gc_string.h>
+#include <stdio.h>
+
+#if defined(ALINUX) || defined(AAPPLE)
+#define ANY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MIN_SYMBOLS 64
 
 const achunk_header_t CHUNK_HEADER = {
     { 0x41, 0x6E, 0x79, 0x00 },
@@ -15,27 +27,192 @@ const achunk_header_t CHUNK_HEADER = {
     { 0, 0 }
 };
 
-static aint_t calc_sizes(
-    int8_t* b, aint_t sz, aint_t* off, aint_t* num_imps, aint_t* num_protos)
+const uint8_t BUNDLE_SIGNATURE[4] = { 0x41, 0x6E, 0x79, 0x42 };
+
+// The string area ends with a NUL byte, any reference after a hash prefix is
+// terminated in bounds.
+static AINLINE int32_t valid_string(const aprototype_header_t* p, aint_t s)
 {
-    aint_t i;
-    aprototype_header_t* const p = (aprototype_header_t*)(b + *off);
+    return s >= (aint_t)sizeof(uint32_t) && s < p->strings_sz;
+}
 
-    *num_imps += p->num_imports; *num_protos += p->num_nesteds;
-    *off += sizeof(aprototype_header_t) + p->strings_sz +
-        sizeof(ainstruction_t) * p->num_instructions +
-        sizeof(aconstant_t) * p->num_constants +
-        sizeof(aimport_t) * p->num_imports;
-    if (*off > sz) return AERR_MALFORMED;
+static AINLINE int32_t valid_jump(
+    const aprototype_header_t* p, aint_t ip, aint_t displacement)
+{
+    const aint_t nip = ip + displacement + 1;
+    return nip >= 0 && nip < p->num_instructions;
+}
 
-    for (i = 0; i < p->num_nesteds; ++i) {
-        aerror_t ec = calc_sizes(b, sz, off, num_imps, num_protos);
-        if (ec != AERR_NONE) return ec;
+static int32_t valid_instructions(
+    const aprototype_header_t* p, const ainstruction_t* ins)
+{
+    aint_t ip;
+    for (ip = 0; ip < p->num_instructions; ++ip) {
+        const ainstruction_t* const i = ins + ip;
+        switch (i->b.opcode) {
+        case AOC_NOP:
+        case AOC_POP:
+        case AOC_NIL:
+        case AOC_LDB:
+        case AOC_LSI:
+        case AOC_LLV:
+        case AOC_SLV:
+        case AOC_IVK:
+        case AOC_RET:
+        case AOC_SND:
+        case AOC_RMV:
+        case AOC_RWD:
+        case AOC_TUP:
+        case AOC_ARR:
+        case AOC_TBL:
+        case AOC_GET:
+        case AOC_SET:
+            break;
+        case AOC_LDK:
+            if (i->ldk.idx < 0 || i->ldk.idx >= p->num_constants) return FALSE;
+            break;
+        case AOC_IMP:
+            if (i->imp.idx < 0 || i->imp.idx >= p->num_imports) return FALSE;
+            break;
+        case AOC_CLS:
+            if (i->cls.idx < 0 || i->cls.idx >= p->num_nesteds) return FALSE;
+            break;
+        case AOC_JMP:
+        case AOC_JIN:
+        case AOC_RCV:
+            if (!valid_jump(p, ip, i->jmp.displacement)) return FALSE;
+            break;
+        default:
+            return FALSE;
+        }
     }
+    return TRUE;
+}
 
+/** Prove every section, string reference and instruction operand in range.
+\brief Prototypes are laid out in pre-order, so they are checked in a single
+pass without recursion nor allocation. Counts of imports and prototypes are
+returned on success.
+*/
+static aerror_t validate(
+    const int8_t* b, aint_t sz, aint_t* num_imps, aint_t* num_protos)
+{
+    aint_t off = sizeof(achunk_header_t);
+    aint_t remain = 1; // the module prototype
+    *num_imps = 0;
+    *num_protos = 0;
+    while (remain > 0) {
+        const aprototype_header_t* p;
+        const uint8_t* strings;
+        const ainstruction_t* ins;
+        const aconstant_t* ks;
+        const aimport_t* imps;
+        aint_t left = sz - off;
+        aint_t i;
+
+        if (left < (aint_t)sizeof(aprototype_header_t)) return AERR_MALFORMED;
+        p = (const aprototype_header_t*)(b + off);
+        left -= sizeof(aprototype_header_t);
+        if (p->strings_sz <= 0 || p->strings_sz > left) return AERR_MALFORMED;
+        left -= p->strings_sz;
+        if (p->num_instructions < 0 ||
+            p->num_instructions > left / (aint_t)sizeof(ainstruction_t))
+            return AERR_MALFORMED;
+        left -= p->num_instructions * sizeof(ainstruction_t);
+        if (p->num_constants < 0 ||
+            p->num_constants > left / (aint_t)sizeof(aconstant_t))
+            return AERR_MALFORMED;
+        left -= p->num_constants * sizeof(aconstant_t);
+        if (p->num_imports < 0 ||
+            p->num_imports > left / (aint_t)sizeof(aimport_t))
+            return AERR_MALFORMED;
+        left -= p->num_imports * sizeof(aimport_t);
+        // every nested takes a header at least, that bounds `remain`
+        if (p->num_nesteds < 0 ||
+            p->num_nesteds > left / (aint_t)sizeof(aprototype_header_t))
+            return AERR_MALFORMED;
+
+        strings = (const uint8_t*)(p + 1);
+        if (strings[p->strings_sz - 1] != 0) return AERR_MALFORMED;
+        if (!valid_string(p, p->source) || !valid_string(p, p->symbol))
+            return AERR_MALFORMED;
+        ins = (const ainstruction_t*)(strings + p->strings_sz);
+        ks = (const aconstant_t*)(ins + p->num_instructions);
+        imps = (const aimport_t*)(ks + p->num_constants);
+        for (i = 0; i < p->num_constants; ++i) {
+            switch (ks[i].type) {
+            case ACT_INTEGER:
+            case ACT_REAL:
+                break;
+            case ACT_STRING:
+                if (!valid_string(p, ks[i].string)) return AERR_MALFORMED;
+                break;
+            default:
+                return AERR_MALFORMED;
+            }
+        }
+        for (i = 0; i < p->num_imports; ++i) {
+            if (!valid_string(p, imps[i].module) ||
+                !valid_string(p, imps[i].name))
+                return AERR_MALFORMED;
+        }
+        if (!valid_instructions(p, ins)) return AERR_MALFORMED;
+
+        *num_imps += p->num_imports;
+        *num_protos += 1;
+        remain += p->num_nesteds - 1;
+        off = sz - left;
+    }
     return AERR_NONE;
 }
 
+static AINLINE void link_unlink(aimport_link_t* l)
+{
+    alist_node_erase(&l->node);
+    l->node.next = &l->node;
+    l->node.prev = &l->node;
+}
+
+static void unlink_imports(achunk_t* c)
+{
+    aint_t i;
+    for (i = 0; i < c->num_imports; ++i) link_unlink(c->links + i);
+}
+
+// Link byte code imports of a chunk which are already resolved.
+static void link_imports(achunk_t* c)
+{
+    aint_t i;
+    for (i = 0; i < c->num_imports; ++i) {
+        avalue_t* const v = c->imports + i;
+        if (av_type(v) != AVT_BYTE_CODE_FUNC) continue;
+        link_unlink(c->links + i);
+        alist_push_back(
+            &av_to_byte_code_func(v)->chunk->dependents, &c->links[i].node);
+    }
+}
+
+// Unlink imports and dependents, nothing refers to the chunk after that.
+static void detach_chunk(achunk_t* c)
+{
+    alist_node_t* n;
+    unlink_imports(c);
+    n = alist_head(&c->dependents);
+    while (!alist_is_end(&c->dependents, n)) {
+        alist_node_t* const next = n->next;
+        link_unlink(ALIST_NODE_CAST(aimport_link_t, n));
+        n = next;
+    }
+}
+
+static void free_chunk(aloader_t* self, achunk_t* c)
+{
+    detach_chunk(c);
+    alist_node_erase(&c->node);
+    if (c->alloc) c->alloc(c->alloc_ud, c->header, 0);
+    self->alloc(self->alloc_ud, c, 0);
+}
+
 static void free_chunk_list(
     aloader_t* self, alist_t* l, int32_t check_for_retain)
 {
@@ -44,9 +221,7 @@ static void free_chunk_list(
         achunk_t* c = ALIST_NODE_CAST(achunk_t, i);
         i = i->next;
         if (check_for_retain && c->retain) continue;
-        alist_node_erase(&c->node);
-        if (c->alloc) c->alloc(c->alloc_ud, c->header, 0);
-        self->alloc(self->alloc_ud, c, 0);
+        free_chunk(self, c);
     }
 }
 
@@ -78,34 +253,128 @@ static void create_proto(
     pt->import_values = *next_imp; *next_imp += p->num_imports;
     *off += (uint8_t*)(pt->imports + p->num_imports) - (uint8_t*)p;
 
+    for (i = 0; i < p->num_imports; ++i) {
+        aimport_link_t* const l =
+            chunk->links + (pt->import_values - chunk->imports) + i;
+        l->proto = pt;
+        l->idx = i;
+        av_nil(pt->import_values + i);
+    }
+
     for (i = 0; i < p->num_nesteds; ++i) {
         create_proto(chunk, off, pt->nesteds + i, next_imp, next_pt);
     }
 }
 
-static aint_t find_in_libs(
-    alist_t* libs, const char* module, const char* name, avalue_t* value)
+// chunk strings are prefixed by their precomputed hash
+static AINLINE uint32_t str_hash(const char* s)
 {
-    alist_node_t* n;
-    const alib_func_t* nf;
-
-    for (n = alist_head(libs); !alist_is_end(libs, n); n = n->next) {
-        alib_t* const lib = ALIST_NODE_CAST(alib_t, n);
-        if (strcmp(lib->name, module) != 0) continue;
-        // for each native module function
-        for (nf = lib->funcs; nf->name != NULL; ++nf) {
-            if (strcmp(nf->name, name) == 0) {
-                av_native_func(value, nf->func);
-                return AERR_NONE;
-            }
-        }
-    }
+    uint32_t h;
+    memcpy(&h, s - sizeof(uint32_t), sizeof(uint32_t));
+    return h;
+}
+
+static AINLINE aint_t symbol_slot(uint32_t mh, uint32_t nh, aint_t cap)
+{
+    return (aint_t)((mh ^ (nh * 0x9E3779B1u)) & (uint32_t)(cap - 1));
+}
 
-    return AERR_UNRESOLVED;
+// Returns the slot of symbol `m`.`n` or the empty slot to insert it.
+static asymbol_t* symbol_lookup(
+    asymbol_t* symbols, aint_t cap,
+    uint32_t mh, const char* m, uint32_t nh, const char* n)
+{
+    aint_t i = symbol_slot(mh, nh, cap);
+    for (;;) {
+        asymbol_t* const s = symbols + i;
+        if (s->module == NULL) return s;
+        if (s->module_hash == mh && s->name_hash == nh &&
+            strcmp(s->name, n) == 0 && strcmp(s->module, m) == 0) return s;
+        i = (i + 1) & (cap - 1);
+    }
 }
 
-static aint_t find_in_list(
-    alist_t* list, const char* module, const char* name, avalue_t* value)
+static void symbols_grow(aloader_t* self, asymbol_table_t* t)
+{
+    aint_t i;
+    const aint_t old_cap = t->cap;
+    asymbol_t* const old = t->slots;
+    const aint_t new_cap = old_cap ? old_cap*2 : MIN_SYMBOLS;
+    t->slots = (asymbol_t*)self->alloc(
+        self->alloc_ud, NULL, new_cap * sizeof(asymbol_t));
+    memset(t->slots, 0, (size_t)new_cap * sizeof(asymbol_t));
+    t->cap = new_cap;
+    for (i = 0; i < old_cap; ++i) {
+        asymbol_t* const s = old + i;
+        if (s->module == NULL) continue;
+        *symbol_lookup(t->slots, new_cap,
+            s->module_hash, s->module, s->name_hash, s->name) = *s;
+    }
+    if (old) self->alloc(self->alloc_ud, old, 0);
+}
+
+/// Add symbol `m`.`n` to `t` if it is not indexed yet.
+static void symbol_add(
+    aloader_t* self, asymbol_table_t* t,
+    uint32_t mh, const char* m, uint32_t nh, const char* n,
+    const avalue_t* value)
+{
+    asymbol_t* s;
+    // keep the load factor under 1/2
+    if ((t->num + 1)*2 > t->cap) symbols_grow(self, t);
+    s = symbol_lookup(t->slots, t->cap, mh, m, nh, n);
+    if (s->module != NULL) return;
+    ++t->num;
+    s->module_hash = mh;
+    s->name_hash = nh;
+    s->module = m;
+    s->name = n;
+    s->value = *value;
+}
+
+static AINLINE const asymbol_t* table_find(
+    const asymbol_table_t* t,
+    uint32_t mh, const char* m, uint32_t nh, const char* n)
+{
+    const asymbol_t* s;
+    if (t->cap == 0) return NULL;
+    s = symbol_lookup(t->slots, t->cap, mh, m, nh, n);
+    return s->module ? s : NULL;
+}
+
+// Natives are searched first, then byte code.
+static aerror_t symbol_find(
+    aloader_t* self, uint32_t mh, const char* m, uint32_t nh, const char* n,
+    avalue_t* value)
+{
+    const asymbol_t* s = table_find(&self->natives, mh, m, nh, n);
+    if (s == NULL) s = table_find(&self->symbols, mh, m, nh, n);
+    if (s == NULL) return AERR_UNRESOLVED;
+    *value = s->value;
+    return AERR_NONE;
+}
+
+static void index_lib(aloader_t* self, alib_t* lib)
+{
+    const alib_func_t* nf;
+    const uint32_t mh = ahash_and_length(lib->name).hash;
+    for (nf = lib->funcs; nf->name != NULL; ++nf) {
+        avalue_t v;
+        av_native_func(&v, nf->func);
+        symbol_add(self, &self->natives,
+            mh, lib->name, ahash_and_length(nf->name).hash, nf->name, &v);
+    }
+}
+
+static void free_symbols(aloader_t* self, asymbol_table_t* t)
+{
+    if (t->slots) self->alloc(self->alloc_ud, t->slots, 0);
+    t->slots = NULL;
+    t->num = 0;
+    t->cap = 0;
+}
+
+static void index_chunks(aloader_t* self, alist_t* list)
 {
     aint_t i;
     alist_node_t* n;
@@ -113,112 +382,170 @@ static aint_t find_in_list(
     for (n = alist_head(list); !alist_is_end(list, n); n = n->next) {
         achunk_t* const chunk = ALIST_NODE_CAST(achunk_t, n);
         aprototype_t* const m = chunk->prototypes;
-        if (strcmp(m->strings + m->header->symbol, module) != 0) continue;
+        const char* const module = m->strings + m->header->symbol;
+        const uint32_t mh = str_hash(module);
         // for each module function
         for (i = 0; i < m->header->num_nesteds; ++i) {
             aprototype_t* const f = m->nesteds + i;
-            if (strcmp(f->strings + f->header->symbol, name) == 0) {
-                av_byte_code_func(value, f);
-                return AERR_NONE;
-            }
+            const char* const name = f->strings + f->header->symbol;
+            avalue_t v;
+            av_byte_code_func(&v, f);
+            symbol_add(self, &self->symbols,
+                mh, module, str_hash(name), name, &v);
         }
     }
+}
 
-    return AERR_UNRESOLVED;
+/** Index `pendings` if requested then `runnings`.
+\brief The first indexed symbol wins, which follows the lookup order. Libs
+are indexed once when they are added.
+*/
+static void index_rebuild(aloader_t* self, int32_t with_pendings)
+{
+    asymbol_table_t* const t = &self->symbols;
+    if (t->cap) memset(t->slots, 0, (size_t)t->cap * sizeof(asymbol_t));
+    t->num = 0;
+    if (with_pendings) index_chunks(self, &self->pendings);
+    index_chunks(self, &self->runnings);
 }
 
 static int32_t has_chunk(alist_t* list, alist_node_t* node)
 {
     aprototype_t* a = ALIST_NODE_CAST(achunk_t, node)->prototypes;
     const char* a_sym = a->strings + a->header->symbol;
+    const uint32_t a_hash = str_hash(a_sym);
     alist_node_t* i = alist_head(list);
     while (!alist_is_end(list, i)) {
         aprototype_t* b = ALIST_NODE_CAST(achunk_t, i)->prototypes;
         const char* b_sym = b->strings + b->header->symbol;
-        if (strcmp(a_sym, b_sym) == 0) return TRUE;
+        if (str_hash(b_sym) == a_hash && strcmp(a_sym, b_sym) == 0) {
+            return TRUE;
+        }
         i = i->next;
     }
     return FALSE;
 }
 
-static aint_t resolve(aloader_t* self, aprototype_t* p)
+// Resolve import `idx` of `p`, byte code exporters keep track of the slot.
+static aint_t resolve_import(aloader_t* self, aprototype_t* p, aint_t idx)
+{
+    aimport_t* imp = p->imports + idx;
+    const char* m_name = p->strings + imp->module;
+    const char* n_name = p->strings + imp->name;
+    avalue_t* val = p->import_values + idx;
+    aimport_link_t* l = p->chunk->links + (val - p->chunk->imports);
+    aerror_t ec = symbol_find(
+        self, str_hash(m_name), m_name, str_hash(n_name), n_name, val);
+    if (ec != AERR_NONE) {
+        if (self->on_unresolved) self->on_unresolved(m_name, n_name);
+        return AERR_UNRESOLVED;
+    }
+    link_unlink(l);
+    // imports of garbage are resolved lazily but never relinked
+    if (av_type(val) == AVT_BYTE_CODE_FUNC && p->chunk->epoch == 0) {
+        alist_push_back(
+            &av_to_byte_code_func(val)->chunk->dependents, &l->node);
+    }
+    return AERR_NONE;
+}
+
+// Resolve imports of `p` and its nesteds without linking them, that only reads
+// the loader so chunks can be resolved concurrently.
+static int32_t resolve_values(
+    aloader_t* self, aprototype_t* p, aprototype_t** failed, aint_t* idx)
 {
     aint_t i;
-    aerror_t ec;
 
     // for each import
     for (i = 0; i < p->header->num_imports; ++i) {
         aimport_t* imp = p->imports + i;
         const char* m_name = p->strings + imp->module;
         const char* n_name = p->strings + imp->name;
-        avalue_t* val = p->import_values + i;
-        ec = find_in_libs(&self->libs, m_name, n_name, val);
-        if (ec == AERR_NONE) continue;
-        ec = find_in_list(&self->pendings, m_name, n_name, val);
-        if (ec == AERR_NONE) continue;
-        ec = find_in_list(&self->runnings, m_name, n_name, val);
-        if (ec == AERR_NONE) continue;
-        if (self->on_unresolved) self->on_unresolved(m_name, n_name);
-        return AERR_UNRESOLVED;
+        aerror_t ec = symbol_find(self,
+            str_hash(m_name), m_name, str_hash(n_name), n_name,
+            p->import_values + i);
+        if (ec != AERR_NONE) {
+            *failed = p;
+            *idx = i;
+            return FALSE;
+        }
     }
 
     // recursive for children
     for (i = 0; i < p->header->num_nesteds; ++i) {
-        ec = resolve(self, p->nesteds + i);
-        if (ec != AERR_NONE) return ec;
+        if (!resolve_values(self, p->nesteds + i, failed, idx)) return FALSE;
     }
 
-    return AERR_NONE;
+    return TRUE;
 }
 
-static aint_t cacl_chunk_imports(aprototype_t* pt)
+// Per pending chunk linking task.
+typedef struct {
+    aloader_t* loader;
+    achunk_t* chunk;
+    aprototype_t* failed;
+    aint_t failed_idx;
+} link_task_t;
+
+static void create_task(void* ud, aint_t i)
 {
-    aint_t i;
-    aint_t acc = pt->header->num_imports;
-    for (i = 0; i < pt->header->num_nesteds; ++i) {
-        acc += cacl_chunk_imports(pt->nesteds + i);
-    }
-    return acc;
+    achunk_t* const chunk = ((link_task_t*)ud)[i].chunk;
+    aint_t off = sizeof(achunk_header_t);
+    avalue_t* next_imp = chunk->imports;
+    aprototype_t* next_pt = chunk->prototypes;
+    aprototype_t* pt = next_pt++;
+    create_proto(chunk, &off, pt, &next_imp, &next_pt);
 }
 
-static aint_t calc_imports(alist_t* list)
+static void resolve_task(void* ud, aint_t i)
 {
-    aint_t acc = 0;
-    alist_node_t* i = alist_head(list);
-    while (!alist_is_end(list, i)) {
-        achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
-        acc += cacl_chunk_imports(chunk->prototypes);
-        i = i->next;
-    }
-    return acc;
+    link_task_t* const t = ((link_task_t*)ud) + i;
+    t->failed = NULL;
+    if (t->loader->lazy) return;
+    resolve_values(t->loader, t->chunk->prototypes, &t->failed, &t->failed_idx);
 }
 
-static void backup_imports(aprototype_t* pt, aint_t* off, avalue_t* imp)
+static void serial_for(
+    void* ud, aint_t n, aparallel_task_t task, void* task_ud)
 {
     aint_t i;
-    memcpy(
-        imp + *off,
-        pt->import_values,
-        sizeof(avalue_t) * (size_t)pt->header->num_imports);
-    *off += pt->header->num_imports;
-    for (i = 0; i < pt->header->num_nesteds; ++i) {
-        backup_imports(pt->nesteds + i, off, imp);
-    }
+    AUNUSED(ud);
+    for (i = 0; i < n; ++i) task(task_ud, i);
 }
 
-static void rollback_imports(aprototype_t* pt, aint_t* off, avalue_t* imp)
+typedef struct {
+    aimport_link_t* link;
+    avalue_t value;
+} saved_import_t;
+
+static void restore_imports(saved_import_t* saved, aint_t num_saved)
 {
     aint_t i;
-    memcpy(
-        pt->import_values,
-        imp + *off,
-        sizeof(avalue_t) * (size_t)pt->header->num_imports);
-    *off += pt->header->num_imports;
-    for (i = 0; i < pt->header->num_nesteds; ++i) {
-        rollback_imports(pt->nesteds + i, off, imp);
+    for (i = 0; i < num_saved; ++i) {
+        aimport_link_t* const l = saved[i].link;
+        l->proto->import_values[l->idx] = saved[i].value;
+        link_unlink(l);
+        alist_push_back(
+            &av_to_byte_code_func(&saved[i].value)->chunk->dependents,
+            &l->node);
     }
 }
 
+// Bring replaced chunks back to `runnings` and empty `pendings`.
+static void rollback(aloader_t* self, alist_node_t* garbage_back)
+{
+    alist_node_t* i = garbage_back->next;
+    while (!alist_is_end(&self->garbages, i)) {
+        alist_node_t* const next = i->next;
+        alist_node_erase(i);
+        alist_push_back(&self->runnings, i);
+        link_imports(ALIST_NODE_CAST(achunk_t, i));
+        i = next;
+    }
+    free_chunk_list(self, &self->pendings, FALSE);
+    index_rebuild(self, FALSE);
+}
+
 void aloader_init(aloader_t* self, aalloc_t alloc, void* alloc_ud)
 {
     memset(self, 0, sizeof(aloader_t));
@@ -236,6 +563,8 @@ void aloader_cleanup(aloader_t* self)
     free_chunk_list(self, &self->runnings, FALSE);
     free_chunk_list(self, &self->garbages, FALSE);
     free_libs(&self->libs);
+    free_symbols(self, &self->natives);
+    free_symbols(self, &self->symbols);
 }
 
 aerror_t aloader_add_chunk(
@@ -243,131 +572,356 @@ aerror_t aloader_add_chunk(
     aalloc_t chunk_alloc, void* chunk_alloc_ud)
 {
     achunk_t* c;
-    aint_t off, num_imps, num_protos;
+    aint_t i, num_imps, num_protos;
     aerror_t ec;
 
     if (chunk_sz < sizeof(achunk_header_t) ||
         memcmp(chunk, &CHUNK_HEADER, sizeof(achunk_header_t)) != 0)
         return AERR_MALFORMED;
-    off = sizeof(achunk_header_t);
 
-    num_imps = 0; num_protos = 1 /* include module proto */;
-    ec = calc_sizes((int8_t*)chunk, chunk_sz, &off, &num_imps, &num_protos);
+    ec = validate((int8_t*)chunk, chunk_sz, &num_imps, &num_protos);
     if (ec != AERR_NONE) return ec;
 
     c = (achunk_t*)self->alloc(self->alloc_ud, NULL,
         sizeof(achunk_t) +
         num_imps * sizeof(avalue_t) +
+        num_imps * sizeof(aimport_link_t) +
         num_protos * sizeof(aprototype_t));
     c->header = chunk;
     c->alloc = chunk_alloc;
     c->alloc_ud = chunk_alloc_ud;
     c->imports = (avalue_t*)(((uint8_t*)c) + sizeof(achunk_t));
-    c->prototypes = (aprototype_t*)(
+    c->links = (aimport_link_t*)(
         ((uint8_t*)c->imports) + num_imps * sizeof(avalue_t));
+    c->num_imports = num_imps;
+    c->prototypes = (aprototype_t*)(
+        ((uint8_t*)c->links) + num_imps * sizeof(aimport_link_t));
+    for (i = 0; i < num_imps; ++i) {
+        c->links[i].node.next = &c->links[i].node;
+        c->links[i].node.prev = &c->links[i].node;
+    }
+    alist_init(&c->dependents);
     c->retain = FALSE;
+    c->epoch = 0;
     alist_push_back(&self->pendings, &c->node);
 
     return AERR_NONE;
 }
 
+// Loaded file content, `free` releases `data`.
+typedef struct {
+    void* data;
+    aint_t sz;
+    aalloc_t free;
+    void* free_ud;
+} file_data_t;
+
+#ifdef ANY_MMAP
+// Free function of mapped files, `ud` is the mapping size.
+static void* unmap_file(void* ud, void* old, aint_t sz)
+{
+    AUNUSED(sz);
+    munmap(old, (size_t)ud);
+    return NULL;
+}
+
+static aerror_t map_file(const char* path, aint_t min_sz, file_data_t* fd)
+{
+    struct stat st;
+    int f = open(path, O_RDONLY);
+    if (f < 0) return AERR_IO;
+    if (fstat(f, &st) != 0) {
+        close(f);
+        return AERR_IO;
+    }
+    if ((aint_t)st.st_size < min_sz) {
+        close(f);
+        return AERR_MALFORMED;
+    }
+    fd->data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+    // the mapping stays valid after closing
+    close(f);
+    if (fd->data == MAP_FAILED) return AERR_IO;
+    fd->sz = (aint_t)st.st_size;
+    fd->free = &unmap_file;
+    fd->free_ud = (void*)(size_t)st.st_size;
+    return AERR_NONE;
+}
+#endif
+
+static aerror_t read_file(
+    aloader_t* self, const char* path, aint_t min_sz, file_data_t* fd)
+{
+    long sz;
+    FILE* f = fopen(path, "rb");
+    if (!f) return AERR_IO;
+    if (fseek(f, 0, SEEK_END) != 0 || (sz = ftell(f)) < 0) {
+        fclose(f);
+        return AERR_IO;
+    }
+    if ((aint_t)sz < min_sz) {
+        fclose(f);
+        return AERR_MALFORMED;
+    }
+    fd->data = self->alloc(self->alloc_ud, NULL, (aint_t)sz);
+    rewind(f);
+    if (fread(fd->data, 1, (size_t)sz, f) != (size_t)sz) {
+        fclose(f);
+        self->alloc(self->alloc_ud, fd->data, 0);
+        return AERR_IO;
+    }
+    fclose(f);
+    fd->sz = (aint_t)sz;
+    fd->free = self->alloc;
+    fd->free_ud = self->alloc_ud;
+    return AERR_NONE;
+}
+
+// Loaded chunks are trusted, the file is only mapped if asked to.
+static aerror_t load_file(
+    aloader_t* self, const char* path, aint_t min_sz, file_data_t* fd)
+{
+#ifdef ANY_MMAP
+    if (self->map_files) return map_file(path, min_sz, fd);
+#endif
+    return read_file(self, path, min_sz, fd);
+}
+
+aerror_t aloader_add_chunk_file(aloader_t* self, const char* path)
+{
+    file_data_t fd;
+    aerror_t ec = load_file(self, path, sizeof(achunk_header_t), &fd);
+    if (ec != AERR_NONE) return ec;
+    ec = aloader_add_chunk(self, (achunk_header_t*)fd.data, fd.sz,
+        fd.free, fd.free_ud);
+    if (ec != AERR_NONE) fd.free(fd.free_ud, fd.data, 0);
+    return ec;
+}
+
+// Shared by chunks of a bundle, which is freed along with the last chunk.
+typedef struct {
+    aalloc_t alloc;
+    void* alloc_ud;
+    void* bundle;
+    aalloc_t bundle_alloc;
+    void* bundle_alloc_ud;
+    aint_t refs;
+} bundle_ref_t;
+
+static void* release_bundle(void* ud, void* old, aint_t sz)
+{
+    bundle_ref_t* const b = (bundle_ref_t*)ud;
+    AUNUSED(old);
+    AUNUSED(sz);
+    if (--b->refs > 0) return NULL;
+    if (b->bundle_alloc) b->bundle_alloc(b->bundle_alloc_ud, b->bundle, 0);
+    b->alloc(b->alloc_ud, b, 0);
+    return NULL;
+}
+
+static aerror_t check_bundle(const abundle_header_t* bundle, aint_t bundle_sz)
+{
+    uint32_t i;
+    const abundle_entry_t* const entries = (const abundle_entry_t*)(bundle + 1);
+    const char* const strings = (const char*)(entries + bundle->num_chunks);
+    const uint64_t sz = (uint64_t)bundle_sz;
+    const uint64_t toc_sz = sizeof(abundle_header_t) +
+        (uint64_t)bundle->num_chunks * sizeof(abundle_entry_t) +
+        bundle->strings_sz;
+
+    if (memcmp(bundle->signature, BUNDLE_SIGNATURE, 4) != 0 || toc_sz > sz) {
+        return AERR_MALFORMED;
+    }
+    if (bundle->strings_sz && strings[bundle->strings_sz - 1] != '\0') {
+        return AERR_MALFORMED;
+    }
+    for (i = 0; i < bundle->num_chunks; ++i) {
+        const abundle_entry_t* const e = entries + i;
+        if (e->name >= bundle->strings_sz ||
+            e->offset % ABUNDLE_ALIGN != 0 ||
+            e->offset < toc_sz || e->offset > sz ||
+            e->size > sz - e->offset) {
+            return AERR_MALFORMED;
+        }
+    }
+    return AERR_NONE;
+}
+
+aerror_t aloader_add_bundle(
+    aloader_t* self, abundle_header_t* bundle, aint_t bundle_sz,
+    aalloc_t bundle_alloc, void* bundle_alloc_ud)
+{
+    abundle_entry_t* const entries = (abundle_entry_t*)(bundle + 1);
+    alist_node_t* const back = alist_back(&self->pendings);
+    bundle_ref_t* b;
+    uint32_t i;
+
+    if (bundle_sz < (aint_t)sizeof(abundle_header_t) ||
+        check_bundle(bundle, bundle_sz) != AERR_NONE) {
+        return AERR_MALFORMED;
+    }
+
+    b = (bundle_ref_t*)self->alloc(self->alloc_ud, NULL, sizeof(bundle_ref_t));
+    b->alloc = self->alloc;
+    b->alloc_ud = self->alloc_ud;
+    b->bundle = bundle;
+    b->bundle_alloc = bundle_alloc;
+    b->bundle_alloc_ud = bundle_alloc_ud;
+    b->refs = 1; // held until every chunk is added
+
+    for (i = 0; i < bundle->num_chunks; ++i) {
+        aerror_t ec = aloader_add_chunk(self,
+            (achunk_header_t*)(((uint8_t*)bundle) + entries[i].offset),
+            (aint_t)entries[i].size, &release_bundle, b);
+        if (ec != AERR_NONE) {
+            // remove chunks of this bundle, which is still owned by caller
+            alist_node_t* n = back->next;
+            while (!alist_is_end(&self->pendings, n)) {
+                alist_node_t* const next = n->next;
+                free_chunk(self, ALIST_NODE_CAST(achunk_t, n));
+                n = next;
+            }
+            self->alloc(self->alloc_ud, b, 0);
+            return ec;
+        }
+        ++b->refs;
+    }
+    release_bundle(b, NULL, 0);
+
+    return AERR_NONE;
+}
+
+aerror_t aloader_add_bundle_file(aloader_t* self, const char* path)
+{
+    file_data_t fd;
+    aerror_t ec = load_file(self, path, sizeof(abundle_header_t), &fd);
+    if (ec != AERR_NONE) return ec;
+    ec = aloader_add_bundle(self, (abundle_header_t*)fd.data, fd.sz,
+        fd.free, fd.free_ud);
+    if (ec != AERR_NONE) fd.free(fd.free_ud, fd.data, 0);
+    return ec;
+}
+
+
 void aloader_add_lib(aloader_t* self, alib_t* lib)
 {
     alist_push_back(&self->libs, &lib->node);
+    index_lib(self, lib);
 }
 
 aerror_t aloader_link(aloader_t* self, int32_t safe)
 {
     alist_node_t* const garbage_back = alist_back(&self->garbages);
-    avalue_t* old_imps;
+    aparallel_for_t const parallel_for =
+        self->parallel_for ? self->parallel_for : &serial_for;
+    link_task_t* tasks = NULL;
+    aint_t num_tasks = 0;
+    saved_import_t* saved = NULL;
+    aint_t num_saved = 0;
     alist_node_t* i;
+    aint_t t;
+    aerror_t ec;
 
-    // create prototypes
-    i = alist_head(&self->pendings);
-    while (!alist_is_end(&self->pendings, i)) {
-        aint_t off = sizeof(achunk_header_t);
-        achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
-        avalue_t* next_imp = chunk->imports;
-        aprototype_t* next_pt = chunk->prototypes;
-        aprototype_t* pt = next_pt++;
-        create_proto(chunk, &off, pt, &next_imp, &next_pt);
-        i = i->next;
+    for (i = alist_head(&self->pendings); !alist_is_end(&self->pendings, i);
+        i = i->next) {
+        ++num_tasks;
+    }
+    if (num_tasks) {
+        tasks = (link_task_t*)self->alloc(
+            self->alloc_ud, NULL, num_tasks * sizeof(link_task_t));
     }
+    t = 0;
+    for (i = alist_head(&self->pendings); !alist_is_end(&self->pendings, i);
+        i = i->next) {
+        tasks[t].loader = self;
+        tasks[t].chunk = ALIST_NODE_CAST(achunk_t, i);
+        ++t;
+    }
+
+    // create prototypes
+    parallel_for(self->parallel_for_ud, num_tasks, &create_task, tasks);
 
-    // copy old chunk to garbages
+    // copy old chunk to garbages, their imports are not relinked anymore
     i = alist_head(&self->runnings);
     while (!alist_is_end(&self->runnings, i)) {
         alist_node_t* const next = i->next;
         if (has_chunk(&self->pendings, i)) {
             alist_node_erase(i);
             alist_push_back(&self->garbages, i);
+            unlink_imports(ALIST_NODE_CAST(achunk_t, i));
         }
         i = next;
     }
 
-    // resolve pending imports
-    i = alist_head(&self->pendings);
-    while (!alist_is_end(&self->pendings, i)) {
-        achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
-        aerror_t ec = resolve(self, chunk->prototypes);
-        if (ec != AERR_NONE) {
-            if (!safe) return ec;
-            // rollback garbages
-            i = garbage_back;
-            while (!alist_is_end(&self->garbages, i)) {
-                alist_node_t* const next = i->next;
-                alist_node_erase(i);
-                alist_push_back(&self->runnings, i);
-                i = next;
-            }
-            // empty pendings
-            free_chunk_list(self, &self->pendings, FALSE);
-            return ec;
+    // pendings are visible while resolving
+    index_rebuild(self, TRUE);
+
+    // resolve pending imports against the read-only index, then report the
+    // first failure in chunk order as same as resolving one by one
+    parallel_for(self->parallel_for_ud, num_tasks, &resolve_task, tasks);
+    for (t = 0; t < num_tasks; ++t) {
+        aprototype_t* const p = tasks[t].failed;
+        if (p == NULL) continue;
+        if (self->on_unresolved) {
+            aimport_t* const imp = p->imports + tasks[t].failed_idx;
+            self->on_unresolved(
+                p->strings + imp->module, p->strings + imp->name);
         }
-        i = i->next;
+        self->alloc(self->alloc_ud, tasks, 0);
+        if (!safe) {
+            index_rebuild(self, FALSE);
+            return AERR_UNRESOLVED;
+        }
+        rollback(self, garbage_back);
+        return AERR_UNRESOLVED;
     }
+    for (t = 0; t < num_tasks; ++t) link_imports(tasks[t].chunk);
+    if (tasks) self->alloc(self->alloc_ud, tasks, 0);
 
-    // resolve running imports
+    // only importers of replaced chunks need to be resolved again
     if (safe) {
-        aint_t imp_off = 0;
-        aint_t imp_sz = calc_imports(&self->runnings) * sizeof(avalue_t);
-        old_imps = (avalue_t*)self->alloc(self->alloc_ud, NULL, imp_sz);
-        i = alist_head(&self->runnings);
-        while (!alist_is_end(&self->runnings, i)) {
+        aint_t num_deps = 0;
+        for (i = garbage_back->next; !alist_is_end(&self->garbages, i);
+            i = i->next) {
             achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
-            backup_imports(chunk->prototypes, &imp_off, old_imps);
-            i = i->next;
+            alist_node_t* n = alist_head(&chunk->dependents);
+            for (; !alist_is_end(&chunk->dependents, n); n = n->next) {
+                ++num_deps;
+            }
+        }
+        if (num_deps) {
+            saved = (saved_import_t*)self->alloc(
+                self->alloc_ud, NULL, num_deps * sizeof(saved_import_t));
         }
     }
-    i = alist_head(&self->runnings);
-    while (!alist_is_end(&self->runnings, i)) {
+    for (i = garbage_back->next; !alist_is_end(&self->garbages, i);
+        i = i->next) {
         achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
-        aerror_t ec = resolve(self, chunk->prototypes);
-        if (ec != AERR_NONE) {
-            if (!safe) return ec;
-            // rollback running imports
-            i = alist_head(&self->runnings);
-            while (!alist_is_end(&self->runnings, i)) {
-                aint_t imp_off = 0;
-                achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
-                rollback_imports(chunk->prototypes, &imp_off, old_imps);
-                i = i->next;
+        alist_node_t* n = alist_head(&chunk->dependents);
+        while (!alist_is_end(&chunk->dependents, n)) {
+            alist_node_t* const next = n->next;
+            aimport_link_t* const l = ALIST_NODE_CAST(aimport_link_t, n);
+            const avalue_t old = l->proto->import_values[l->idx];
+            ec = resolve_import(self, l->proto, l->idx);
+            if (ec != AERR_NONE) {
+                if (!safe) {
+                    index_rebuild(self, FALSE);
+                    return ec;
+                }
+                restore_imports(saved, num_saved);
+                self->alloc(self->alloc_ud, saved, 0);
+                rollback(self, garbage_back);
+                return ec;
             }
-            // rollback garbages
-            i = garbage_back;
-            while (!alist_is_end(&self->garbages, i)) {
-                alist_node_t* const next = i->next;
-                alist_node_erase(i);
-                alist_push_back(&self->runnings, i);
-                i = next;
+            if (safe) {
+                saved[num_saved].link = l;
+                saved[num_saved].value = old;
+                ++num_saved;
             }
-            // empty pendings
-            free_chunk_list(self, &self->pendings, FALSE);
-            return ec;
+            n = next;
         }
-        i = i->next;
     }
-    if (safe) self->alloc(self->alloc_ud, old_imps, 0);
+    if (saved) self->alloc(self->alloc_ud, saved, 0);
 
     // move pendings to runnings
     i = alist_head(&self->pendings);
@@ -378,23 +932,45 @@ aerror_t aloader_link(aloader_t* self, int32_t safe)
         i = next;
     }
 
+    // replaced chunks are stamped with a new epoch
+    if (!alist_is_end(&self->garbages, garbage_back->next)) {
+        ++self->epoch;
+        for (i = garbage_back->next; !alist_is_end(&self->garbages, i);
+            i = i->next) {
+            ALIST_NODE_CAST(achunk_t, i)->epoch = self->epoch;
+        }
+    }
+
     return AERR_NONE;
 }
 
+aerror_t aloader_resolve(aloader_t* self, aprototype_t* p, aint_t idx)
+{
+    return (aerror_t)resolve_import(self, p, idx);
+}
+
 void aloader_sweep(aloader_t* self)
 {
     free_chunk_list(self, &self->garbages, TRUE);
 }
 
+void aloader_reclaim(aloader_t* self, aint_t epoch)
+{
+    alist_node_t* i = alist_head(&self->garbages);
+    while (!alist_is_end(&self->garbages, i)) {
+        achunk_t* c = ALIST_NODE_CAST(achunk_t, i);
+        i = i->next;
+        // a failed unsafe link leaves replaced chunks without an epoch,
+        // actors do not track them so only aloader_sweep may free them
+        if (c->retain || c->epoch == 0 || c->epoch >= epoch) continue;
+        free_chunk(self, c);
+    }
+}
+
 aerror_t aloader_find(
     aloader_t* self, const char* module, const char* name, avalue_t* value)
 {
-    aerror_t ec;
-
-    ec = find_in_libs(&self->libs, module, name, value);
-    if (ec == AERR_NONE) return AERR_NONE;
-    ec = find_in_list(&self->runnings, module, name, value);
-    if (ec == AERR_NONE) return AERR_NONE;
-
-    return AERR_UNRESOLVED;
+    return symbol_find(self,
+        ahash_and_length(module).hash, module,
+        ahash_and_length(name).hash, name, value);
 }
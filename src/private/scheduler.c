@@ -3,6 +3,13 @@
 
 #include <any/loader.h>
 #include <any/actor.h>
+#include <any/gc.h>
+#include <any/heap_pool.h>
+
+#define INIT_HEAP_SZ 512
+#define HEAP_POOL_RETAIN (4*1024*1024)
+#define GC_WATERMARK_PERCENT 90
+#define HIBERNATE_MSECS 1000
 
 void ASTDCALL actor_entry(void* ud);
 
@@ -20,6 +27,16 @@ static void init_processes(aprocess_t* procs, aint_t num)
     }
 }
 
+static void cleanup_actor(ascheduler_t* self, aactor_t* a)
+{
+    // keep the statistics of dead actors, but not their heap capacity
+    agc_stats_t st = *agc_stats(&a->gc);
+    st.heap_cap = 0;
+    agc_stats_merge(&self->dead_gc_stats, &st);
+    aactor_cleanup(a);
+    self->oldest_code_at = -1;
+}
+
 static void cleanup(ascheduler_t* self, int32_t shutdown)
 {
     alist_node_t* i = alist_head(&self->runnings);
@@ -28,7 +45,7 @@ static void cleanup(ascheduler_t* self, int32_t shutdown)
         aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
         aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
         if (shutdown || (p->actor.flags & APF_EXIT) != 0) {
-            aactor_cleanup(&p->actor);
+            cleanup_actor(self, &p->actor);
             alist_node_erase(&t->node);
             ascheduler_free(p->actor.owner, p);
         }
@@ -40,7 +57,7 @@ static void cleanup(ascheduler_t* self, int32_t shutdown)
         alist_node_t* const next = i->next;
         aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
         aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
-        aactor_cleanup(&p->actor);
+        cleanup_actor(self, &p->actor);
         alist_node_erase(&t->node);
         ascheduler_free(p->actor.owner, p);
         i = next;
@@ -50,13 +67,44 @@ static void cleanup(ascheduler_t* self, int32_t shutdown)
         alist_node_t* const next = i->next;
         aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
         aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
-        aactor_cleanup(&p->actor);
+        cleanup_actor(self, &p->actor);
         alist_node_erase(&t->node);
         ascheduler_free(p->actor.owner, p);
         i = next;
     }
 }
 
+static void collect_waiting(ascheduler_t* self, aprocess_t* p)
+{
+    aactor_collect(&p->actor);
+    p->collected_sz = p->actor.gc.heap_sz;
+    p->code_scanned = self->loader.epoch;
+}
+
+static AINLINE int32_t has_garbage(ascheduler_t* self)
+{
+    alist_t* const garbages = &self->loader.garbages;
+    return !alist_is_end(garbages, alist_head(garbages));
+}
+
+/// Collects a waiting process if it may hold old code or its heap occupancy
+/// reached the watermark, called wherever its heap changes.
+static void check_waiting(ascheduler_t* self, aprocess_t* p)
+{
+    const aidle_gc_t* const c = &self->idle_gc;
+    const agc_t* const gc = &p->actor.gc;
+    const aint_t epoch = self->loader.epoch;
+    // once per epoch, find out if old code is still referred to
+    const int32_t old_code = gc->code_epoch <= epoch &&
+        p->code_scanned != epoch && has_garbage(self);
+    // skip if nothing has been allocated since the last collection
+    if (old_code || (gc->heap_sz != p->collected_sz &&
+        c->watermark_percent > 0 &&
+        gc->heap_sz * 100 >= gc->heap_cap * c->watermark_percent)) {
+        collect_waiting(self, p);
+    }
+}
+
 static void wait_for(
     ascheduler_t* self, aactor_t* a, aint_t nsecs, int32_t msg_wake)
 {
@@ -65,6 +113,7 @@ static void wait_for(
     aprocess_task_t* next = ALIST_NODE_CAST(aprocess_task_t, next_node);
     alist_node_t* wback = alist_back(&self->waitings);
     assert(p->wait_for == 0);
+    check_waiting(self, p);
     alist_node_erase(&p->ptask.node);
     alist_node_insert(&p->ptask.node, wback, wback->next);
     p->wait_for = nsecs;
@@ -80,6 +129,13 @@ static AINLINE void add_to_runnings(ascheduler_t* self, aprocess_t* p)
     alist_node_insert(n, r->prev, r);
 }
 
+static void hibernate(ascheduler_t* self, aprocess_t* p)
+{
+    collect_waiting(self, p);
+    agc_shrink(&p->actor.gc);
+    p->collected_sz = p->actor.gc.heap_sz;
+}
+
 static void check_waitings(ascheduler_t* self, aint_t delta)
 {
     alist_node_t* i = alist_head(&self->waitings);
@@ -95,15 +151,68 @@ static void check_waitings(ascheduler_t* self, aint_t delta)
                 add_to_runnings(self, p);
             }
         }
+        // woken up processes have `wait_for` reset
+        if (p->hibernate_in >= 0 && p->wait_for != 0) {
+            p->hibernate_in -= delta;
+            if (p->hibernate_in <= 0) {
+                p->hibernate_in = -1;
+                hibernate(self, p);
+            }
+        }
         i = next;
     }
 }
 
+/// Sweeps the waiting processes only when the scheduler goes idle or code
+/// has been replaced since the last sweep, others are checked on the spot.
+static void collect_waitings(ascheduler_t* self)
+{
+    const int32_t idle = self->idle_gc.idle && !self->idle_swept &&
+        alist_head(&self->runnings) == &self->root.node;
+    const aint_t epoch = self->loader.epoch;
+    alist_node_t* i;
+    if (!idle && (self->swept_epoch == epoch || !has_garbage(self))) return;
+    if (idle) self->idle_swept = TRUE;
+    self->swept_epoch = epoch;
+    i = alist_head(&self->waitings);
+    while (!alist_is_end(&self->waitings, i)) {
+        aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
+        aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
+        if (idle && p->actor.gc.heap_sz != p->collected_sz) {
+            collect_waiting(self, p);
+        } else {
+            check_waiting(self, p);
+        }
+        i = i->next;
+    }
+}
+
+static void reclaim_code(ascheduler_t* self)
+{
+    aint_t epoch = self->loader.epoch + 1;
+    aint_t i;
+    if (!has_garbage(self)) return;
+    // code epochs only rise on collections and exits
+    if (self->oldest_code_at != self->loader.epoch) {
+        for (i = 0; i < (aint_t)(1 << self->idx_bits); ++i) {
+            aprocess_t* p = self->procs + i;
+            if (p->dead) continue;
+            if (p->actor.gc.code_epoch < epoch) {
+                epoch = p->actor.gc.code_epoch;
+            }
+        }
+        self->oldest_code = epoch;
+        self->oldest_code_at = self->loader.epoch;
+    }
+    aloader_reclaim(&self->loader, self->oldest_code);
+}
+
 static AINLINE void run_once(ascheduler_t* self)
 {
     alist_node_t* head = alist_head(&self->runnings);
     if (head != &self->root.node) {
         aprocess_task_t* next = ALIST_NODE_CAST(aprocess_task_t, head);
+        self->idle_swept = FALSE;
         atask_yield(&self->root.task, &next->task);
     }
 }
@@ -121,6 +230,11 @@ aerror_t ascheduler_init(
     self->procs = aalloc(self, NULL,
         ((aint_t)sizeof(aprocess_t)) * (aint_t)(1 << idx_bits));
     self->next_idx = 0;
+    self->gc_policy = agc_default_policy(INIT_HEAP_SZ);
+    self->idle_gc.idle = TRUE;
+    self->idle_gc.watermark_percent = GC_WATERMARK_PERCENT;
+    self->idle_gc.hibernate_nsecs = amsec(HIBERNATE_MSECS);
+    aheap_pool_init(&self->heap_pool, HEAP_POOL_RETAIN, alloc, alloc_ud);
     aloader_init(&self->loader, alloc, alloc_ud);
     init_processes(self->procs, (aint_t)(1 << idx_bits));
     alist_init(&self->pendings);
@@ -130,6 +244,8 @@ aerror_t ascheduler_init(
     ec = atask_shadow(&self->root.task);
     if (ec != AERR_NONE) goto failed;
     self->first_run = TRUE;
+    self->swept_epoch = -1;
+    self->oldest_code_at = -1;
     return ec;
 failed:
     if (self->procs) aalloc(self, self->procs, 0);
@@ -146,6 +262,8 @@ void ascheduler_run_once(ascheduler_t* self)
         check_waitings(self, atimer_delta_nsecs(&self->timer));
     }
     run_once(self);
+    collect_waitings(self);
+    reclaim_code(self);
 }
 
 void ascheduler_yield(ascheduler_t* self, aactor_t* a)
@@ -158,14 +276,40 @@ void ascheduler_yield(ascheduler_t* self, aactor_t* a)
 
 void ascheduler_sleep(ascheduler_t* self, aactor_t* a, aint_t nsecs)
 {
+    aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
+    p->collected_sz = -1;
+    p->hibernate_in = -1;
     wait_for(self, a, nsecs, FALSE);
 }
 
 void ascheduler_wait(ascheduler_t* self, aactor_t* a, aint_t nsecs)
 {
+    aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
+    const aint_t hibernate = self->idle_gc.hibernate_nsecs;
+    p->collected_sz = -1;
+    // counted down by check_waitings, waits which end before never hibernate
+    p->hibernate_in = hibernate >= 0 && (nsecs < 0 || nsecs > hibernate)
+        ? hibernate : -1;
     wait_for(self, a, nsecs, TRUE);
 }
 
+void ascheduler_code_change(ascheduler_t* self)
+{
+    alist_node_t* i = alist_head(&self->waitings);
+    self->code_change = self->loader.epoch;
+    while (!alist_is_end(&self->waitings, i)) {
+        alist_node_t* const next = i->next;
+        aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
+        aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
+        if (p->msg_wake && aactor_new_version(&p->actor)) {
+            p->wait_for = 0;
+            p->msg_wake = FALSE;
+            add_to_runnings(self, p);
+        }
+        i = next;
+    }
+}
+
 void ascheduler_got_new_message(ascheduler_t* self, aactor_t* a)
 {
     aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
@@ -173,6 +317,8 @@ void ascheduler_got_new_message(ascheduler_t* self, aactor_t* a)
         p->wait_for = 0;
         p->msg_wake = FALSE;
         add_to_runnings(self, p);
+    } else if (p->wait_for != 0) {
+        check_waiting(self, p);
     }
 }
 
@@ -181,6 +327,18 @@ void ascheduler_cleanup(ascheduler_t* self)
     cleanup(self, TRUE);
     aalloc(self, self->procs, 0);
     aloader_cleanup(&self->loader);
+    aheap_pool_cleanup(&self->heap_pool);
+}
+
+void ascheduler_gc_stats(ascheduler_t* self, agc_stats_t* stats)
+{
+    aint_t i;
+    *stats = self->dead_gc_stats;
+    for (i = 0; i < (aint_t)(1 << self->idx_bits); ++i) {
+        aprocess_t* p = self->procs + i;
+        if (p->dead) continue;
+        agc_stats_merge(stats, agc_stats(&p->actor.gc));
+    }
 }
 
 aprocess_t* ascheduler_alloc(ascheduler_t* self)
@@ -197,6 +355,8 @@ aprocess_t* ascheduler_alloc(ascheduler_t* self)
             p->dead = FALSE;
             p->wait_for = 0;
             p->msg_wake = FALSE;
+            p->code_scanned = 0;
+            p->hibernate_in = -1;
             ++self->num_procs;
             return p;
         }
@@ -213,8 +373,10 @@ aerror_t ascheduler_new_actor(
     *a = &p->actor;
     ec = atask_create(&p->ptask.task, &actor_entry, *a, cstack_sz);
     if (ec != AERR_NONE) return ec;
-    ec = aactor_init(*a, self, self->alloc, self->alloc_ud);
+    ec = aactor_init(*a, self, &aheap_pool_alloc, &self->heap_pool);
     if (ec != AERR_NONE) atask_delete(&p->ptask.task);
+    // large objects are not rounded up to the size classes of the pool
+    else agc_large_alloc(&(*a)->gc, self->alloc, self->alloc_ud);
     alist_push_back(&self->pendings, &p->ptask.node);
     return ec;
 }
@@ -0,0 +1,68 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/std_libs.h>
+
+#include <any/actor.h>
+#include <any/loader.h>
+#include <any/gc_buffer.h>
+
+static void check(aactor_t* a, aint_t idx, atype_t type, const char* what)
+{
+    if ((atype_t)any_type(a, idx).type != type) {
+        any_error(a, AERR_RUNTIME, "%s expected", what);
+    }
+}
+
+static void new_buffer(aactor_t* a)
+{
+    check(a, -1, AVT_INTEGER, "capacity");
+    any_push_buffer(a, any_to_integer(a, -1));
+}
+
+static void append(aactor_t* a)
+{
+    aint_t buf = aactor_absidx(a, -1);
+    check(a, -1, AVT_BUFFER, "buffer");
+    agc_buffer_append_value(a, buf, aactor_absidx(a, -2));
+    any_push_idx(a, -1);
+}
+
+static void size(aactor_t* a)
+{
+    check(a, -1, AVT_BUFFER, "buffer");
+    any_push_integer(a, any_buffer_size(a, -1));
+}
+
+static void slice(aactor_t* a)
+{
+    check(a, -1, AVT_BUFFER, "buffer");
+    check(a, -2, AVT_INTEGER, "from");
+    check(a, -3, AVT_INTEGER, "to");
+    any_push_buffer_view(a, aactor_absidx(a, -1),
+        any_to_integer(a, -2), any_to_integer(a, -3));
+}
+
+static void get(aactor_t* a)
+{
+    aint_t i;
+    check(a, -1, AVT_BUFFER, "buffer");
+    check(a, -2, AVT_INTEGER, "index");
+    i = any_to_integer(a, -2);
+    if (i < 0 || i >= any_buffer_size(a, -1)) any_push_nil(a);
+    else any_push_integer(a, any_to_buffer(a, -1)[i]);
+}
+
+static alib_func_t funcs[] = {
+    { "new/1", &new_buffer },
+    { "append/2", &append },
+    { "size/1", &size },
+    { "slice/3", &slice },
+    { "get/2", &get },
+    { NULL, NULL }
+};
+
+static alib_t mod = { "buffer", funcs };
+
+void astd_lib_add_buffer(aloader_t* l)
+{
+    aloader_add_lib(l, &mod);
+}
@@ -0,0 +1,78 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/std_libs.h>
+
+#include <any/actor.h>
+#include <any/loader.h>
+#include <any/scheduler.h>
+#include <any/gc.h>
+#include <any/gc_string.h>
+#include <any/gc_array.h>
+#include <any/gc_table.h>
+
+enum { NUM_FIELDS = 10 };
+
+static void set_integer(aactor_t* a, aint_t t, const char* key, aint_t value)
+{
+    any_push_string(a, key);
+    any_push_integer(a, value);
+    any_set(a, t);
+}
+
+static void push_stats(aactor_t* a, const agc_stats_t* st)
+{
+    aint_t t;
+    aint_t i;
+    any_push_table(a, NUM_FIELDS);
+    t = any_count(a) - 1;
+    set_integer(a, t, "collections", st->collections);
+    set_integer(a, t, "pause_total_nsecs", st->pause_total_nsecs);
+    set_integer(a, t, "pause_max_nsecs", st->pause_max_nsecs);
+    set_integer(a, t, "bytes_copied", st->bytes_copied);
+    set_integer(a, t, "grows", st->grows);
+    set_integer(a, t, "shrinks", st->shrinks);
+    set_integer(a, t, "heap_cap", st->heap_cap);
+    set_integer(a, t, "heap_cap_high_water", st->heap_cap_high_water);
+    set_integer(a, t, "heap_sz_high_water", st->heap_sz_high_water);
+    any_push_string(a, "pause_histogram");
+    any_push_array(a, AGC_PAUSE_BUCKETS);
+    for (i = 0; i < AGC_PAUSE_BUCKETS; ++i) {
+        any_push_integer(a, i);
+        any_push_integer(a, st->pause_histogram[i]);
+        any_set(a, t + 2);
+    }
+    any_set(a, t);
+}
+
+static void stats(aactor_t* a)
+{
+    // copy first, pushing the result may collect and update the statistics
+    agc_stats_t st = *agc_stats(&a->gc);
+    push_stats(a, &st);
+}
+
+static void total_stats(aactor_t* a)
+{
+    agc_stats_t st;
+    ascheduler_gc_stats(a->owner, &st);
+    push_stats(a, &st);
+}
+
+static void collect(aactor_t* a)
+{
+    aactor_collect(a);
+    any_push_nil(a);
+}
+
+static alib_func_t funcs[] = {
+    { "stats/0", &stats },
+    { "total_stats/0", &total_stats },
+    { "collect/0", &collect },
+    { NULL, NULL }
+};
+
+static alib_t mod = { "gc", funcs };
+
+void astd_lib_add_gc(aloader_t* l)
+{
+    aloader_add_lib(l, &mod);
+}
@@ -68,12 +68,33 @@ static void rebuild_hash_table(astring_table_t* self)
     memset(ht, 0, (size_t)self->num_hash_slots * sizeof(hash_slot_t));
 
     while (string < strs + self->string_bytes) {
-        const ahash_and_length_t hl = ahash_and_length(string + sizeof(uint32_t));
-        aint_t i = hl.hash % self->num_hash_slots;
-        while (ht[i].offset) i = (i + 1) % self->num_hash_slots;
+        // hashes are kept along with strings, only lengths are measured
+        const uint32_t hash = *(const uint32_t*)string;
+        const aint_t length = (aint_t)strlen(string + sizeof(uint32_t));
+        aint_t i = hash % self->num_hash_slots;
+        while (ht[i].offset) {
+            if (++i == self->num_hash_slots) i = 0;
+        }
         ht[i].offset = (uint32_t)(string - strs);
-        string = string + sizeof(uint32_t) + hl.length + 1;
+        string = string + sizeof(uint32_t) + length + 1;
+    }
+}
+
+// Slot of `string`, or the empty slot where it belongs.
+static aint_t find_slot(
+    const astring_table_t* self, const char* string, uint32_t hash)
+{
+    const char* const strs = strings_const(self);
+    const hash_slot_t* const ht = hashtable_const(self);
+    aint_t i = hash % self->num_hash_slots;
+    while (ht[i].offset) {
+        const char* const s = strs + ht[i].offset;
+        // the stored hash rules most candidates out without comparing
+        if (*(const uint32_t*)s == hash &&
+            strcmp(string, s + sizeof(uint32_t)) == 0) break;
+        if (++i == self->num_hash_slots) i = 0;
     }
+    return i;
 }
 
 void astring_table_init(
@@ -132,12 +153,8 @@ aint_t astring_table_to_ref(astring_table_t* self, const char* string)
         char* const strs = strings(self);
 
         hash_slot_t* const ht = hashtable(self);
-        aint_t i = hl.hash % self->num_hash_slots;
-        while (ht[i].offset) {
-            if (strcmp(string, strs + ht[i].offset + sizeof(uint32_t)) == 0)
-                return ht[i].offset;
-            i = (i + 1) % self->num_hash_slots;
-        }
+        const aint_t i = find_slot(self, string, hl.hash);
+        if (ht[i].offset) return ht[i].offset;
 
         if (self->count + 1 >= self->num_hash_slots)
             return AERR_FULL;
@@ -170,18 +187,9 @@ aint_t astring_table_to_ref_const(
 {
     if (*string) {
         const ahash_and_length_t hl = ahash_and_length(string);
-        const char* const strs = strings_const(self);
-
-        aint_t i = 0;
         const hash_slot_t* const ht = hashtable_const(self);
-        i = hl.hash % self->num_hash_slots;
-        while (ht[i].offset) {
-            if (strcmp(string, strs + ht[i].offset + sizeof(uint32_t)) == 0)
-                return ht[i].offset;
-            i = (i + 1) % self->num_hash_slots;
-        }
-
-        return AERR_FULL;
+        const aint_t i = find_slot(self, string, hl.hash);
+        return ht[i].offset ? ht[i].offset : AERR_FULL;
     } else {
         // "" maps to 0
         return 0;
@@ -0,0 +1,162 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/platform.h>
+#include <catch.hpp>
+
+#include <string.h>
+#include <any/allocator.h>
+#include <any/scheduler.h>
+#include <any/actor.h>
+#include <any/gc_string.h>
+#include <any/asm.h>
+
+enum { CSTACK_SZ = 8192 };
+enum { NUM_BLOCKS = 1000 };
+
+static aint_t num_allocs;
+
+static void* counting_alloc(void*, void* old, aint_t sz)
+{
+    if (sz) ++num_allocs;
+    return realloc(old, (size_t)sz);
+}
+
+static void churn(aactor_t* a)
+{
+    for (aint_t i = 0; i < 100; ++i) {
+        any_push_string(a, "a string which makes the heap and stack grow");
+    }
+    any_push_nil(a);
+}
+
+TEST_CASE("allocator")
+{
+    aallocator_t al;
+    aallocator_init(&al, &counting_alloc, NULL);
+    num_allocs = 0;
+
+    SECTION("small")
+    {
+        void* blocks[NUM_BLOCKS];
+        for (aint_t i = 0; i < NUM_BLOCKS; ++i) {
+            blocks[i] = aallocator_alloc(&al, NULL, 24);
+            REQUIRE(((size_t)blocks[i] & 15) == 0);
+            memset(blocks[i], (int)i, 24);
+        }
+        REQUIRE(aallocator_stats(&al)->in_use == NUM_BLOCKS*32);
+        // slabs amortize the backing allocator
+        REQUIRE(num_allocs < NUM_BLOCKS / 10);
+        for (aint_t i = 0; i < NUM_BLOCKS; ++i) {
+            REQUIRE(((uint8_t*)blocks[i])[23] == (uint8_t)i);
+        }
+        void* last = blocks[NUM_BLOCKS - 1];
+        aallocator_alloc(&al, last, 0);
+        REQUIRE(aallocator_alloc(&al, NULL, 20) == last);
+        for (aint_t i = 0; i < NUM_BLOCKS; ++i) {
+            aallocator_alloc(&al, blocks[i], 0);
+        }
+        REQUIRE(aallocator_stats(&al)->in_use == 0);
+        REQUIRE(aallocator_stats(&al)->allocs == NUM_BLOCKS + 1);
+        REQUIRE(aallocator_stats(&al)->frees == NUM_BLOCKS + 1);
+    }
+
+    SECTION("realloc")
+    {
+        uint8_t* p = (uint8_t*)aallocator_alloc(&al, NULL, 10);
+        memcpy(p, "0123456789", 10);
+        REQUIRE(aallocator_alloc(&al, p, 16) == p);
+        p = (uint8_t*)aallocator_alloc(&al, p, 5000);
+        REQUIRE(memcmp(p, "0123456789", 10) == 0);
+        REQUIRE(aallocator_stats(&al)->large_bytes == 5000);
+        REQUIRE(aallocator_alloc(&al, p, 4000) == p);
+        p = (uint8_t*)aallocator_alloc(&al, p, 100);
+        REQUIRE(memcmp(p, "0123456789", 10) == 0);
+        REQUIRE(aallocator_stats(&al)->large_bytes == 0);
+        REQUIRE(aallocator_stats(&al)->in_use == 128);
+        aallocator_alloc(&al, p, 0);
+    }
+
+    SECTION("huge pages")
+    {
+        enum { HUGE_SZ = 3*1024*1024 };
+        aallocator_huge_pages(&al, 1024*1024);
+        uint8_t* p = (uint8_t*)aallocator_alloc(&al, NULL, HUGE_SZ);
+        REQUIRE(p != NULL);
+        p[0] = 1;
+        p[HUGE_SZ - 1] = 2;
+#ifdef ALINUX
+        REQUIRE(aallocator_stats(&al)->huge_bytes >= HUGE_SZ);
+        REQUIRE(aallocator_stats(&al)->large_bytes == 0);
+#endif
+        aallocator_alloc(&al, p, 0);
+        REQUIRE(aallocator_stats(&al)->huge_bytes == 0);
+        REQUIRE(aallocator_stats(&al)->in_use == 0);
+    }
+
+    SECTION("scheduler")
+    {
+        enum { NUM_IDX_BITS = 4 };
+        enum { NUM_GEN_BITS = 4 };
+
+        ascheduler_t s;
+        REQUIRE(AERR_NONE == ascheduler_init(
+            &s, NUM_IDX_BITS, NUM_GEN_BITS, &aallocator_alloc, &al));
+        for (aint_t round = 0; round < 5; ++round) {
+            for (aint_t i = 0; i < 10; ++i) {
+                aactor_t* a;
+                REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+                any_push_native_func(a, &churn);
+                ascheduler_start(&s, a, 0);
+            }
+            ascheduler_run_once(&s);
+            ascheduler_run_once(&s); // cleanup is deferred
+        }
+        REQUIRE(aallocator_stats(&al)->in_use_high_water > 0);
+        ascheduler_cleanup(&s);
+        REQUIRE(aallocator_stats(&al)->in_use == 0);
+    }
+
+    aallocator_cleanup(&al);
+    REQUIRE(aallocator_stats(&al)->slab_bytes == 0);
+}
+
+TEST_CASE("allocator_arena")
+{
+    aarena_t ar;
+    aarena_init(&ar, &counting_alloc, NULL);
+    num_allocs = 0;
+
+    SECTION("bump")
+    {
+        uint8_t* p = (uint8_t*)aarena_alloc(&ar, NULL, 10);
+        uint8_t* q = (uint8_t*)aarena_alloc(&ar, NULL, 10);
+        REQUIRE(q - p == 32);
+        REQUIRE(aarena_alloc(&ar, q, 100) == q);
+        REQUIRE((uint8_t*)aarena_alloc(&ar, NULL, 10) - q == 128);
+        memcpy(p, "0123456789", 10);
+        uint8_t* np = (uint8_t*)aarena_alloc(&ar, p, 20);
+        REQUIRE(np != p);
+        REQUIRE(memcmp(np, "0123456789", 10) == 0);
+        REQUIRE(num_allocs == 1);
+        aarena_reset(&ar);
+        REQUIRE(ar.reserved == 0);
+        REQUIRE(aarena_alloc(&ar, NULL, 100000) != NULL);
+        REQUIRE(num_allocs == 2);
+    }
+
+    SECTION("assembler")
+    {
+        aasm_t as;
+        aasm_init(&as, &aarena_alloc, &ar);
+        REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+        for (aint_t i = 0; i < NUM_BLOCKS; ++i) {
+            aasm_emit(&as, ai_nop());
+        }
+        aasm_emit(&as, ai_ret());
+        aasm_save(&as);
+        REQUIRE(as.chunk_size > 0);
+        aasm_cleanup(&as);
+        aarena_reset(&ar);
+    }
+
+    aarena_cleanup(&ar);
+}
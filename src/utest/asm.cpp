@@ -4,6 +4,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include <any/asm.h>
 #include <any/string_table.h>
 
@@ -308,4 +309,281 @@ TEST_CASE("asm_save_load")
 
     aasm_cleanup(&a1);
     aasm_cleanup(&a2);
-}
\ No newline at end of file
+}
+
+static void emit_all(aasm_t* a, const std::vector<ainstruction_t>& is)
+{
+    for (auto& i : is) aasm_emit(a, i);
+}
+
+static void require_instructions(
+    aasm_t* a, const std::vector<ainstruction_t>& expected)
+{
+    aasm_prototype_t* p = aasm_prototype(a);
+    ainstruction_t* is = aasm_resolve(a).instructions;
+    REQUIRE(p->num_instructions == (aint_t)expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(is[i].b.opcode == expected[i].b.opcode);
+        switch (is[i].b.opcode) {
+        case AOC_NOP:
+        case AOC_NIL:
+        case AOC_RET:
+            break; // no operand
+        default:
+            REQUIRE(is[i].b._ == expected[i].b._);
+            break;
+        }
+    }
+}
+
+TEST_CASE("asm_optimize")
+{
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    REQUIRE(aasm_load(&a, NULL) == AERR_NONE);
+    aasm_module_push(&a, "f");
+
+    SECTION("thread jumps")
+    {
+        emit_all(&a, {
+            ai_jin(1), ai_ret(), ai_jmp(1), ai_ret(), ai_jmp(0), ai_nil(),
+            ai_ret() });
+        REQUIRE(aasm_optimize(&a, AAOP_THREAD_JUMPS) == 0);
+        require_instructions(&a, {
+            ai_jin(4), ai_ret(), ai_jmp(2), ai_ret(), ai_nop(), ai_nil(),
+            ai_ret() });
+    }
+
+    SECTION("jump loop")
+    {
+        emit_all(&a, { ai_jmp(0), ai_jmp(-2), ai_ret() });
+        REQUIRE(aasm_optimize(&a, AAOP_ALL) == 1);
+        require_instructions(&a, { ai_jmp(0), ai_jmp(-2) });
+    }
+
+    SECTION("dead code")
+    {
+        emit_all(&a, {
+            ai_nil(), ai_jmp(2), ai_lsi(1), ai_pop(1), ai_ret(), ai_lsi(2),
+            ai_ret() });
+        REQUIRE(aasm_optimize(&a, AAOP_DEAD_CODE | AAOP_STRIP_NOPS) == 4);
+        require_instructions(&a, { ai_nil(), ai_jmp(0), ai_ret() });
+    }
+
+    SECTION("fold loads")
+    {
+        emit_all(&a, {
+            ai_llv(0), ai_pop(1), ai_lsi(1), ai_pop(2), ai_ldb(1), ai_jin(1),
+            ai_nil(), ai_pop(1), ai_nil(), ai_ret() });
+        REQUIRE(aasm_optimize(&a, AAOP_FOLD_LOADS | AAOP_STRIP_NOPS) == 3);
+        // the last pop is a jump target
+        require_instructions(&a, {
+            ai_pop(1), ai_ldb(1), ai_jin(1), ai_nil(), ai_pop(1), ai_nil(),
+            ai_ret() });
+    }
+
+    SECTION("trailing nops")
+    {
+        emit_all(&a, { ai_jin(2), ai_nop(), ai_ret(), ai_nop(), ai_nop() });
+        REQUIRE(aasm_optimize(&a, AAOP_STRIP_NOPS) == 2);
+        // the jump still has somewhere to land
+        require_instructions(&a, { ai_jin(1), ai_ret(), ai_nop() });
+    }
+
+    SECTION("bad jump")
+    {
+        emit_all(&a, { ai_nop(), ai_jmp(5), ai_ret() });
+        REQUIRE(aasm_optimize(&a, AAOP_ALL) == 0);
+        require_instructions(&a, { ai_nop(), ai_jmp(5), ai_ret() });
+    }
+
+    SECTION("nested")
+    {
+        emit_all(&a, { ai_cls(0), ai_ret(), ai_nil() });
+        aasm_push(&a);
+        emit_all(&a, { ai_nop(), ai_lsi(1), ai_pop(1), ai_nil(), ai_ret() });
+        aasm_pop(&a);
+        REQUIRE(aasm_optimize(&a, AAOP_ALL) == 4);
+        require_instructions(&a, { ai_cls(0), ai_ret() });
+        aasm_open(&a, 0);
+        require_instructions(&a, { ai_nil(), ai_ret() });
+        aasm_pop(&a);
+    }
+
+    aasm_pop(&a);
+    aasm_cleanup(&a);
+}
+
+TEST_CASE("asm_dedup")
+{
+    enum { NUM_CONSTANTS = 1000 };
+
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    REQUIRE(aasm_load(&a, NULL) == AERR_NONE);
+
+    SECTION("constants")
+    {
+        const aint_t s = aasm_string_to_ref(&a, "str");
+        REQUIRE(0 == aasm_add_constant(&a, ac_integer(1)));
+        REQUIRE(1 == aasm_add_constant(&a, ac_string(s)));
+        REQUIRE(2 == aasm_add_constant(&a, ac_real(1)));
+        REQUIRE(3 == aasm_add_constant(&a, ac_real(0.0)));
+        REQUIRE(4 == aasm_add_constant(&a, ac_real(-0.0)));
+        REQUIRE(0 == aasm_add_constant(&a, ac_integer(1)));
+        REQUIRE(1 == aasm_add_constant(
+            &a, ac_string(aasm_string_to_ref(&a, "str"))));
+        REQUIRE(2 == aasm_add_constant(&a, ac_real(1)));
+        REQUIRE(4 == aasm_add_constant(&a, ac_real(-0.0)));
+        REQUIRE(aasm_prototype(&a)->num_constants == 5);
+    }
+
+    SECTION("imports")
+    {
+        REQUIRE(0 == aasm_add_import(&a, "mod", "f/1"));
+        REQUIRE(1 == aasm_add_import(&a, "mod", "g/1"));
+        REQUIRE(2 == aasm_add_import(&a, "g/1", "mod"));
+        REQUIRE(0 == aasm_add_import(&a, "mod", "f/1"));
+        REQUIRE(1 == aasm_add_import(&a, "mod", "g/1"));
+        REQUIRE(aasm_prototype(&a)->num_imports == 3);
+        // imports and constants are pooled apart
+        REQUIRE(0 == aasm_add_constant(&a, ac_integer(0)));
+    }
+
+    SECTION("per prototype")
+    {
+        REQUIRE(0 == aasm_add_constant(&a, ac_integer(7)));
+        REQUIRE(0 == aasm_push(&a));
+        REQUIRE(0 == aasm_add_constant(&a, ac_integer(8)));
+        REQUIRE(1 == aasm_add_constant(&a, ac_integer(7)));
+        REQUIRE(0 == aasm_pop(&a));
+        REQUIRE(1 == aasm_add_constant(&a, ac_integer(8)));
+        aasm_open(&a, 0);
+        REQUIRE(1 == aasm_add_constant(&a, ac_integer(7)));
+        REQUIRE(0 == aasm_pop(&a));
+    }
+
+    SECTION("growth")
+    {
+        for (aint_t i = 0; i < NUM_CONSTANTS; ++i) {
+            REQUIRE(i == aasm_add_constant(&a, ac_integer(i)));
+        }
+        for (aint_t i = 0; i < NUM_CONSTANTS; ++i) {
+            REQUIRE(i == aasm_add_constant(&a, ac_integer(i)));
+        }
+        REQUIRE(aasm_prototype(&a)->num_constants == NUM_CONSTANTS);
+    }
+
+    SECTION("load")
+    {
+        REQUIRE(0 == aasm_push(&a));
+        REQUIRE(0 == aasm_add_constant(&a, ac_integer(1)));
+        REQUIRE(1 == aasm_add_constant(&a, ac_real(2)));
+        REQUIRE(0 == aasm_add_import(&a, "mod", "f/1"));
+        aasm_emit(&a, ai_ret());
+        REQUIRE(0 == aasm_pop(&a));
+        aasm_save(&a);
+
+        aasm_t b;
+        aasm_init(&b, &myalloc, NULL);
+        REQUIRE(aasm_load(&b, a.chunk) == AERR_NONE);
+        aasm_open(&b, 0);
+        REQUIRE(1 == aasm_add_constant(&b, ac_real(2)));
+        REQUIRE(0 == aasm_add_import(&b, "mod", "f/1"));
+        REQUIRE(2 == aasm_add_constant(&b, ac_integer(2)));
+        REQUIRE(0 == aasm_pop(&b));
+        aasm_cleanup(&b);
+    }
+
+    aasm_cleanup(&a);
+}
+
+TEST_CASE("asm_prototypes_in_place")
+{
+    enum { NUM_PROTOTYPES = 2000 };
+
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    REQUIRE(aasm_load(&a, NULL) == AERR_NONE);
+
+    std::vector<aasm_prototype_t*> ps;
+    for (aint_t i = 0; i < NUM_PROTOTYPES; ++i) {
+        REQUIRE(i == aasm_push(&a));
+        ps.push_back(aasm_prototype(&a));
+        aasm_emit(&a, ai_lsi((int32_t)i));
+        REQUIRE(i == aasm_pop(&a));
+    }
+
+    // growing one prototype leaves the others where they are
+    aasm_open(&a, NUM_PROTOTYPES / 2);
+    for (aint_t i = 0; i < 1000; ++i) aasm_emit(&a, ai_nop());
+    REQUIRE(aasm_pop(&a) == NUM_PROTOTYPES / 2);
+
+    for (aint_t i = 0; i < NUM_PROTOTYPES; ++i) {
+        aasm_open(&a, i);
+        if (i != NUM_PROTOTYPES / 2) REQUIRE(aasm_prototype(&a) == ps[i]);
+        REQUIRE(aasm_resolve(&a).instructions[0].lsi.val == i);
+        REQUIRE(aasm_pop(&a) == i);
+    }
+
+    aasm_cleanup(&a);
+}
+
+struct sink_t
+{
+    std::vector<uint8_t> bytes;
+    aint_t num_writes;
+    aint_t fail_at;
+};
+
+static aerror_t sink_write(void* ud, const void* data, aint_t sz)
+{
+    sink_t* s = (sink_t*)ud;
+    if (++s->num_writes == s->fail_at) return AERR_IO;
+    s->bytes.insert(s->bytes.end(), (const uint8_t*)data,
+        (const uint8_t*)data + sz);
+    return AERR_NONE;
+}
+
+TEST_CASE("asm_save_to")
+{
+    enum { NUM_INSTRUCTIONS = 5000 };
+
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    REQUIRE(aasm_load(&a, NULL) == AERR_NONE);
+    for (aint_t i = 0; i < 10; ++i) {
+        REQUIRE(i == aasm_push(&a));
+        basic_test_ctx t;
+        basic_add(&a, t);
+        REQUIRE(0 == aasm_push(&a));
+        for (aint_t j = 0; j < NUM_INSTRUCTIONS; ++j) {
+            aasm_emit(&a, ai_lsi((int32_t)j));
+        }
+        REQUIRE(0 == aasm_pop(&a));
+        REQUIRE(i == aasm_pop(&a));
+    }
+    aasm_save(&a);
+
+    sink_t s;
+    s.num_writes = 0;
+    s.fail_at = 0;
+
+    SECTION("same as in memory")
+    {
+        REQUIRE(aasm_save_to(&a, &sink_write, &s) == AERR_NONE);
+        REQUIRE((aint_t)s.bytes.size() == a.chunk_size);
+        REQUIRE(memcmp(s.bytes.data(), a.chunk, s.bytes.size()) == 0);
+        // small parts are batched
+        REQUIRE(s.num_writes < 100);
+    }
+
+    SECTION("failure stops writing")
+    {
+        s.fail_at = 3;
+        REQUIRE(aasm_save_to(&a, &sink_write, &s) == AERR_IO);
+        REQUIRE(s.num_writes == 3);
+    }
+
+    aasm_cleanup(&a);
+}
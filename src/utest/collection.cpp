@@ -0,0 +1,325 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/platform.h>
+#include <catch.hpp>
+
+#include <stdio.h>
+#include <any/rt_types.h>
+#include <any/actor.h>
+#include <any/scheduler.h>
+#include <any/gc_string.h>
+#include <any/gc_tuple.h>
+#include <any/gc_array.h>
+#include <any/gc_table.h>
+#include <any/gc_buffer.h>
+
+enum { CSTACK_SZ = 16384 };
+enum { NUM_ITEMS = 1000 };
+
+static void* myalloc(void*, void* old, aint_t sz)
+{
+    return realloc(old, (size_t)sz);
+}
+
+static bool done;
+
+static void tuple_actor(aactor_t* a)
+{
+    any_push_integer(a, 1);
+    any_push_string(a, "two");
+    any_push_real(a, 3.0);
+    any_push_tuple(a, 3);
+    REQUIRE(any_count(a) == 1);
+    REQUIRE(any_type(a, 0).type == AVT_TUPLE);
+
+    any_push_integer(a, 0);
+    any_get(a, 0);
+    REQUIRE(any_to_integer(a, 1) == 1);
+    any_pop(a, 1);
+
+    any_push_integer(a, 1);
+    any_get(a, 0);
+    CHECK_THAT(any_to_string(a, 1), Catch::Equals("two"));
+    any_pop(a, 1);
+
+    any_push_integer(a, 3);
+    any_get(a, 0);
+    REQUIRE(any_type(a, 1).type == AVT_NIL);
+    any_pop(a, 1);
+
+    any_push_integer(a, 2);
+    any_push_bool(a, TRUE);
+    any_set(a, 0);
+    REQUIRE(any_count(a) == 1);
+    any_push_integer(a, 2);
+    any_get(a, 0);
+    REQUIRE(any_type(a, 1).type == AVT_BOOLEAN);
+    any_pop(a, 1);
+
+    done = true;
+}
+
+static void array_actor(aactor_t* a)
+{
+    char buff[32];
+    any_push_array(a, 0);
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        any_push_integer(a, i);
+        snprintf(buff, sizeof(buff), "item %d", (int)i);
+        any_push_string(a, buff);
+        any_set(a, 0);
+    }
+    REQUIRE(any_count(a) == 1);
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        any_push_integer(a, i);
+        any_get(a, 0);
+        snprintf(buff, sizeof(buff), "item %d", (int)i);
+        REQUIRE(any_type(a, 1).type == AVT_STRING);
+        CHECK_THAT(any_to_string(a, 1), Catch::Equals(buff));
+        any_pop(a, 1);
+    }
+    any_push_integer(a, NUM_ITEMS);
+    any_get(a, 0);
+    REQUIRE(any_type(a, 1).type == AVT_NIL);
+    any_pop(a, 1);
+    any_push_integer(a, -1);
+    any_get(a, 0);
+    REQUIRE(any_type(a, 1).type == AVT_NIL);
+    any_pop(a, 1);
+    done = true;
+}
+
+static void array_out_of_range_actor(aactor_t* a)
+{
+    any_push_array(a, 4);
+    any_push_integer(a, 1);
+    any_push_nil(a);
+    any_set(a, 0);
+}
+
+static void table_actor(aactor_t* a)
+{
+    char buff[32];
+    any_push_table(a, 0);
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        snprintf(buff, sizeof(buff), "key %d", (int)i);
+        any_push_string(a, buff);
+        any_push_integer(a, i);
+        any_set(a, 0);
+    }
+    REQUIRE(any_count(a) == 1);
+
+    // remove even keys
+    for (aint_t i = 0; i < NUM_ITEMS; i += 2) {
+        snprintf(buff, sizeof(buff), "key %d", (int)i);
+        any_push_string(a, buff);
+        any_push_nil(a);
+        any_set(a, 0);
+    }
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        snprintf(buff, sizeof(buff), "key %d", (int)i);
+        any_push_string(a, buff);
+        any_get(a, 0);
+        if (i % 2) {
+            REQUIRE(any_type(a, 1).type == AVT_INTEGER);
+            REQUIRE(any_to_integer(a, 1) == i);
+        } else {
+            REQUIRE(any_type(a, 1).type == AVT_NIL);
+        }
+        any_pop(a, 1);
+    }
+
+    any_push_real(a, 0.0);
+    any_push_string(a, "zero");
+    any_set(a, 0);
+    any_push_real(a, -0.0);
+    any_get(a, 0);
+    CHECK_THAT(any_to_string(a, 1), Catch::Equals("zero"));
+    any_pop(a, 1);
+
+    any_push_integer(a, 0);
+    any_get(a, 0);
+    REQUIRE(any_type(a, 1).type == AVT_NIL);
+    any_pop(a, 1);
+
+    done = true;
+}
+
+static void table_nil_key_actor(aactor_t* a)
+{
+    any_push_table(a, 0);
+    any_push_nil(a);
+    any_push_integer(a, 1);
+    any_set(a, 0);
+}
+
+static void nested_actor(aactor_t* a)
+{
+    char buff[32];
+    any_push_array(a, 0);
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        any_push_integer(a, i);
+        any_push_table(a, 1);
+        any_push_string(a, "name");
+        snprintf(buff, sizeof(buff), "table %d", (int)i);
+        any_push_string(a, buff);
+        any_set(a, 2);
+        any_set(a, 0);
+    }
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        any_push_integer(a, i);
+        any_get(a, 0);
+        any_push_string(a, "name");
+        any_get(a, 1);
+        snprintf(buff, sizeof(buff), "table %d", (int)i);
+        CHECK_THAT(any_to_string(a, 2), Catch::Equals(buff));
+        any_pop(a, 2);
+    }
+    done = true;
+}
+
+static void buffer_actor(aactor_t* a)
+{
+    any_push_buffer(a, 0);
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        uint8_t byte = (uint8_t)i;
+        agc_buffer_append(a, aactor_absidx(a, 0), &byte, 1);
+        // garbage forces collections in between
+        any_push_string(a, "garbage");
+        any_pop(a, 1);
+    }
+    REQUIRE(any_buffer_size(a, 0) == NUM_ITEMS);
+    agc_buffer_t* b = AGC_CAST(agc_buffer_t, &a->gc,
+        av_heap_idx(aactor_at(a, aactor_absidx(a, 0))));
+    REQUIRE(b->cap < NUM_ITEMS*2);
+    for (aint_t i = 0; i < NUM_ITEMS; ++i) {
+        REQUIRE(any_to_buffer(a, 0)[i] == (uint8_t)i);
+    }
+
+    any_push_string(a, "abc");
+    agc_buffer_append_value(a, aactor_absidx(a, 0), aactor_absidx(a, 1));
+    any_pop(a, 1);
+    REQUIRE(any_buffer_size(a, 0) == NUM_ITEMS + 3);
+    REQUIRE(memcmp(any_to_buffer(a, 0) + NUM_ITEMS, "abc", 3) == 0);
+
+    // doubling by appending the buffer to itself
+    agc_buffer_append_value(a, aactor_absidx(a, 0), aactor_absidx(a, 0));
+    REQUIRE(any_buffer_size(a, 0) == (NUM_ITEMS + 3)*2);
+    REQUIRE(memcmp(any_to_buffer(a, 0),
+        any_to_buffer(a, 0) + NUM_ITEMS + 3, NUM_ITEMS + 3) == 0);
+    done = true;
+}
+
+static void buffer_view_actor(aactor_t* a)
+{
+    any_push_buffer(a, 8);
+    agc_buffer_append(a, aactor_absidx(a, 0), "abcdefgh", 8);
+    any_push_buffer_view(a, aactor_absidx(a, 0), 2, 6);
+    REQUIRE(any_buffer_size(a, 1) == 4);
+    REQUIRE(any_to_buffer(a, 1) == any_to_buffer(a, 0) + 2);
+    REQUIRE(memcmp(any_to_buffer(a, 1), "cdef", 4) == 0);
+
+    // view of view, still sharing bytes
+    any_push_buffer_view(a, aactor_absidx(a, 1), 1, 3);
+    REQUIRE(any_to_buffer(a, 2) == any_to_buffer(a, 0) + 3);
+    REQUIRE(memcmp(any_to_buffer(a, 2), "de", 2) == 0);
+
+    // the bytes survive collections while only the views are reachable
+    any_remove(a, 0);
+    aactor_collect(a);
+    REQUIRE(memcmp(any_to_buffer(a, 0), "cdef", 4) == 0);
+    REQUIRE(any_to_buffer(a, 1) == any_to_buffer(a, 0) + 1);
+
+    // appending to a view copies it, the other view is untouched
+    agc_buffer_append(a, aactor_absidx(a, 0), "!", 1);
+    REQUIRE(memcmp(any_to_buffer(a, 0), "cdef!", 5) == 0);
+    REQUIRE(memcmp(any_to_buffer(a, 1), "de", 2) == 0);
+    done = true;
+}
+
+static void buffer_bad_view_actor(aactor_t* a)
+{
+    any_push_buffer(a, 8);
+    any_push_buffer_view(a, aactor_absidx(a, 0), 0, 1);
+}
+
+static void run(anative_func_t f, const char* err)
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_push_native_func(a, f);
+    ascheduler_start(&s, a, 0);
+
+    done = false;
+    ascheduler_run_once(&s);
+
+    if (err) {
+        REQUIRE(any_type(a, 0).type == AVT_STRING);
+        CHECK_THAT(any_to_string(a, 0), Catch::Equals(err));
+    } else {
+        REQUIRE(done);
+    }
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("collection_tuple")
+{
+    run(&tuple_actor, NULL);
+}
+
+TEST_CASE("collection_array")
+{
+    SECTION("append")
+    {
+        run(&array_actor, NULL);
+    }
+
+    SECTION("out of range")
+    {
+        run(&array_out_of_range_actor, "index 1 out of range");
+    }
+}
+
+TEST_CASE("collection_table")
+{
+    SECTION("set get remove")
+    {
+        run(&table_actor, NULL);
+    }
+
+    SECTION("nil key")
+    {
+        run(&table_nil_key_actor, "table key must not be nil");
+    }
+}
+
+TEST_CASE("collection_buffer")
+{
+    SECTION("append")
+    {
+        run(&buffer_actor, NULL);
+    }
+
+    SECTION("view")
+    {
+        run(&buffer_view_actor, NULL);
+    }
+
+    SECTION("bad view")
+    {
+        run(&buffer_bad_view_actor, "bad view [0, 1) of buffer size 0");
+    }
+}
+
+TEST_CASE("collection_nested")
+{
+    run(&nested_actor, NULL);
+}
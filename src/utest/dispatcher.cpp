@@ -128,20 +128,8 @@ TEST_CASE("dispatcher_ldk")
         aasm_emit(&as, ai_ldk(0));
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad constant index 0"));
     }
 
     SECTION("overflow index")
@@ -151,20 +139,8 @@ TEST_CASE("dispatcher_ldk")
         aasm_emit(&as, ai_ldk(1));
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad constant index 1"));
     }
 
     SECTION("negative index")
@@ -174,20 +150,8 @@ TEST_CASE("dispatcher_ldk")
         aasm_emit(&as, ai_ldk(-1));
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad constant index -1"));
     }
 
     SECTION("return string")
@@ -646,20 +610,8 @@ TEST_CASE("dispatcher_imp")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad import index 0"));
     }
 
     SECTION("overflow index")
@@ -672,20 +624,8 @@ TEST_CASE("dispatcher_imp")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad import index 3"));
     }
 
     SECTION("negative index")
@@ -698,20 +638,8 @@ TEST_CASE("dispatcher_imp")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad import index -1"));
     };
 
     SECTION("import 0")
@@ -739,7 +667,7 @@ TEST_CASE("dispatcher_imp")
         REQUIRE(any_type(a, 1).type == AVT_NIL);
         REQUIRE(any_type(a, 0).type == AVT_NATIVE_FUNC);
         REQUIRE((anative_func_t)0xF0 ==
-            aactor_at(a, aactor_absidx(a, 0))->v.func);
+            any_to_native_func(a, 0));
     };
 
     SECTION("import 1")
@@ -767,7 +695,7 @@ TEST_CASE("dispatcher_imp")
         REQUIRE(any_type(a, 1).type == AVT_NIL);
         REQUIRE(any_type(a, 0).type == AVT_NATIVE_FUNC);
         REQUIRE((anative_func_t)0xF1 ==
-            aactor_at(a, aactor_absidx(a, 0))->v.func);
+            any_to_native_func(a, 0));
     };
 
     SECTION("import 2")
@@ -795,7 +723,7 @@ TEST_CASE("dispatcher_imp")
         REQUIRE(any_type(a, 1).type == AVT_NIL);
         REQUIRE(any_type(a, 0).type == AVT_NATIVE_FUNC);
         REQUIRE((anative_func_t)0xF2 ==
-            aactor_at(a, aactor_absidx(a, 0))->v.func);
+            any_to_native_func(a, 0));
     };
 
     ascheduler_cleanup(&s);
@@ -855,20 +783,8 @@ TEST_CASE("dispatcher_jmp")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad jump"));
     }
 
     SECTION("bad positive index")
@@ -882,20 +798,8 @@ TEST_CASE("dispatcher_jmp")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad jump"));
     }
 
     ascheduler_cleanup(&s);
@@ -1011,20 +915,8 @@ TEST_CASE("dispatcher_jin")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad jump"));
     }
 
     SECTION("bad positive index")
@@ -1038,20 +930,8 @@ TEST_CASE("dispatcher_jin")
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
 
-        REQUIRE(AERR_NONE ==
+        REQUIRE(AERR_MALFORMED ==
             aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
-        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
-
-        aactor_t* a;
-        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
-        any_find(a, "mod_test", "test_f");
-        ascheduler_start(&s, a, 0);
-
-        ascheduler_run_once(&s);
-
-        REQUIRE(any_count(a) == 1);
-        REQUIRE(any_type(a, 0).type == AVT_STRING);
-        CHECK_THAT(any_to_string(a, 0), Catch::Equals("bad jump"));
     }
 
     SECTION("bad condition")
@@ -1059,7 +939,7 @@ TEST_CASE("dispatcher_jin")
         aasm_module_push(&as, "test_f");
         aasm_emit(&as, ai_lsi(0));
         aasm_emit(&as, ai_lsi(1));
-        aasm_emit(&as, ai_jin(2));
+        aasm_emit(&as, ai_jin(1));
         aasm_emit(&as, ai_lsi(2));
         aasm_emit(&as, ai_ret());
         aasm_save(&as);
@@ -1241,6 +1121,7 @@ TEST_CASE("dispatcher_msbox")
     SECTION("normal")
     {
         aasm_emit(&as, ai_ret());
+        aasm_emit(&as, ai_ret()); // jump target of the last receive
     }
 
     aasm_save(&as);
@@ -1262,6 +1143,86 @@ TEST_CASE("dispatcher_msbox")
     REQUIRE(any_type(a, 0).type == AVT_INTEGER);
     REQUIRE(any_to_integer(a, 0) == (timeout ? 5 : 2));
 
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+TEST_CASE("dispatcher_collections")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_test_module(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    aint_t expected = 0;
+
+    SECTION("tuple")
+    {
+        aasm_module_push(&as, "test_f");
+        aasm_emit(&as, ai_lsi(0xC0));
+        aasm_emit(&as, ai_lsi(0xC1));
+        aasm_emit(&as, ai_tup(2));
+        aasm_emit(&as, ai_lsi(1));
+        aasm_emit(&as, ai_get());
+        aasm_emit(&as, ai_ret());
+        aasm_save(&as);
+        expected = 0xC1;
+    }
+
+    SECTION("array")
+    {
+        aasm_module_push(&as, "test_f");
+        aasm_emit(&as, ai_arr(0));
+        aasm_emit(&as, ai_lsi(0));
+        aasm_emit(&as, ai_lsi(0xA0));
+        aasm_emit(&as, ai_set());
+        aasm_emit(&as, ai_lsi(1));
+        aasm_emit(&as, ai_lsi(0xA1));
+        aasm_emit(&as, ai_set());
+        aasm_emit(&as, ai_lsi(1));
+        aasm_emit(&as, ai_get());
+        aasm_emit(&as, ai_ret());
+        aasm_save(&as);
+        expected = 0xA1;
+    }
+
+    SECTION("table")
+    {
+        aasm_module_push(&as, "test_f");
+        aasm_add_constant(&as, ac_string(aasm_string_to_ref(&as, "key")));
+        aasm_emit(&as, ai_tbl(1));
+        aasm_emit(&as, ai_ldk(0));
+        aasm_emit(&as, ai_lsi(0xB0));
+        aasm_emit(&as, ai_set());
+        aasm_emit(&as, ai_ldk(0));
+        aasm_emit(&as, ai_get());
+        aasm_emit(&as, ai_ret());
+        aasm_save(&as);
+        expected = 0xB0;
+    }
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_find(a, "mod_test", "test_f");
+    ascheduler_start(&s, a, 0);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(any_count(a) == 2);
+    REQUIRE(any_type(a, 0).type == AVT_INTEGER);
+    REQUIRE(any_to_integer(a, 0) == expected);
+
     ascheduler_cleanup(&s);
     aasm_cleanup(&as);
 }
\ No newline at end of file
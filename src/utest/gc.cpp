@@ -79,8 +79,8 @@ TEST_CASE("gc")
         while (AERR_NONE != agc_buffer_new(&gc, 100, &v)) {
             REQUIRE(AERR_NONE == agc_reserve(&gc, 50));
         }
-        agc_buffer_t* b = AGC_CAST(agc_buffer_t, &gc, v.v.heap_idx);
-        *AGC_CAST(aint_t, &gc, b->buff.v.heap_idx) = i;
+        agc_buffer_t* b = AGC_CAST(agc_buffer_t, &gc, av_heap_idx(&v));
+        *AGC_CAST(aint_t, &gc, av_heap_idx(&b->buff)) = i;
         stack.push_back(v);
     }
 
@@ -153,6 +153,254 @@ TEST_CASE("gc")
     agc_cleanup(&gc);
 }
 
+static void collect(agc_t* gc, std::vector<avalue_t>& stack)
+{
+    avalue_t* roots[] = { stack.data(), NULL };
+    aint_t num_roots[] = { (aint_t)stack.size() };
+    agc_collect(gc, roots, num_roots);
+}
+
+TEST_CASE("gc_policy")
+{
+    agc_t gc;
+    agc_init(&gc, 256, &myalloc, NULL);
+    REQUIRE(gc.policy.min_heap_cap == 256);
+
+    std::vector<avalue_t> stack;
+
+    for (aint_t i = 0; i < 100; ++i) {
+        avalue_t v;
+        while (AERR_NONE != agc_fixed_buffer_new(&gc, 64, &v)) {
+            REQUIRE(AERR_NONE == agc_reserve(&gc, 64));
+        }
+        *AGC_CAST(aint_t, &gc, av_heap_idx(&v)) = i;
+        stack.push_back(v);
+    }
+
+    aint_t peak_cap = agc_heap_capacity(&gc);
+    REQUIRE(peak_cap > 256);
+
+    SECTION("shrink")
+    {
+        stack.resize(1);
+        for (int32_t i = 0; i < gc.policy.shrink_cycles - 1; ++i) {
+            collect(&gc, stack);
+            REQUIRE(agc_heap_capacity(&gc) == peak_cap);
+        }
+        collect(&gc, stack);
+        REQUIRE(agc_heap_capacity(&gc) == peak_cap / 2);
+
+        for (aint_t i = 0; i < 100; ++i) {
+            collect(&gc, stack);
+        }
+        REQUIRE(agc_heap_capacity(&gc) == 256);
+        REQUIRE(search_for(&gc, 0));
+        REQUIRE(agc_heap_size(&gc) == 64 + sizeof(agc_header_t));
+    }
+
+    SECTION("no shrink")
+    {
+        agc_policy_t p = gc.policy;
+        p.shrink_percent = 0;
+        agc_set_policy(&gc, &p);
+        stack.resize(1);
+        for (aint_t i = 0; i < 100; ++i) {
+            collect(&gc, stack);
+        }
+        REQUIRE(agc_heap_capacity(&gc) == peak_cap);
+    }
+
+    SECTION("shrink only while live objects fit in half")
+    {
+        agc_policy_t p = gc.policy;
+        p.shrink_percent = 150;
+        p.grow_percent = 100;
+        agc_set_policy(&gc, &p);
+        REQUIRE(gc.policy.shrink_percent == 100);
+        stack.resize(60);
+        for (aint_t i = 0; i < 100; ++i) {
+            collect(&gc, stack);
+            REQUIRE(agc_heap_size(&gc) <= agc_heap_capacity(&gc));
+        }
+        // 60 objects take more than half of peak_cap / 2
+        REQUIRE(agc_heap_capacity(&gc) == peak_cap / 2);
+        for (aint_t i = 0; i < 60; ++i) {
+            REQUIRE(search_for(&gc, i));
+        }
+    }
+
+    SECTION("sparse cycles must be consecutive")
+    {
+        std::vector<avalue_t> all = stack;
+        stack.resize(1);
+        for (aint_t i = 0; i < 10; ++i) {
+            collect(&gc, stack);
+            collect(&gc, stack);
+            collect(&gc, all);
+            REQUIRE(agc_heap_capacity(&gc) == peak_cap);
+        }
+    }
+
+    SECTION("grow")
+    {
+        agc_policy_t p = gc.policy;
+        p.grow_percent = 10;
+        agc_set_policy(&gc, &p);
+        collect(&gc, stack);
+        REQUIRE(agc_heap_capacity(&gc) == peak_cap * 2);
+        for (aint_t i = 0; i < 100; ++i) {
+            REQUIRE(search_for(&gc, i));
+        }
+    }
+
+    agc_cleanup(&gc);
+}
+
+TEST_CASE("gc_stats")
+{
+    agc_t gc;
+    agc_init(&gc, 256, &myalloc, NULL);
+
+    const agc_stats_t* st = agc_stats(&gc);
+    REQUIRE(st->collections == 0);
+    REQUIRE(st->heap_cap == 256);
+
+    std::vector<avalue_t> stack;
+    for (aint_t i = 0; i < 100; ++i) {
+        avalue_t v;
+        while (AERR_NONE != agc_fixed_buffer_new(&gc, 64, &v)) {
+            REQUIRE(AERR_NONE == agc_reserve(&gc, 64));
+        }
+        stack.push_back(v);
+    }
+    aint_t peak_sz = agc_heap_size(&gc);
+    aint_t peak_cap = agc_heap_capacity(&gc);
+
+    stack.resize(10);
+    for (aint_t i = 0; i < 20; ++i) {
+        collect(&gc, stack);
+    }
+
+    st = agc_stats(&gc);
+    REQUIRE(st->collections == 20);
+    REQUIRE(st->bytes_copied == 20 * 10 * (64 + sizeof(agc_header_t)));
+    REQUIRE(st->grows > 0);
+    REQUIRE(st->shrinks > 0);
+    REQUIRE(st->heap_cap == agc_heap_capacity(&gc));
+    REQUIRE(st->heap_cap_high_water == peak_cap);
+    REQUIRE(st->heap_sz_high_water == peak_sz);
+    REQUIRE(st->pause_max_nsecs <= st->pause_total_nsecs);
+
+    aint_t num_pauses = 0;
+    for (aint_t i = 0; i < AGC_PAUSE_BUCKETS; ++i) {
+        num_pauses += st->pause_histogram[i];
+    }
+    REQUIRE(num_pauses == st->collections);
+
+    agc_stats_t total = *st;
+    agc_stats_merge(&total, st);
+    REQUIRE(total.collections == 40);
+    REQUIRE(total.heap_cap == 2 * st->heap_cap);
+    REQUIRE(total.heap_sz_high_water == peak_sz);
+
+    agc_cleanup(&gc);
+}
+
+TEST_CASE("gc_large")
+{
+    enum { LARGE_SZ = 1024*1024 };
+
+    agc_t gc;
+    agc_init(&gc, 256, &myalloc, NULL);
+    REQUIRE(gc.policy.large_threshold > 0);
+
+    std::vector<avalue_t> stack;
+
+    SECTION("never copied")
+    {
+        avalue_t v;
+        REQUIRE(AERR_NONE == agc_reserve(&gc, LARGE_SZ));
+        REQUIRE(AERR_NONE == agc_fixed_buffer_new(&gc, LARGE_SZ, &v));
+        REQUIRE((av_heap_idx(&v) & AGC_LARGE_BIT) != 0);
+        REQUIRE(agc_heap_size(&gc) == 0);
+        REQUIRE(agc_heap_capacity(&gc) == 256);
+        uint8_t* b = AGC_CAST(uint8_t, &gc, av_heap_idx(&v));
+        memset(b, 0xAB, LARGE_SZ);
+        stack.push_back(v);
+
+        for (aint_t i = 0; i < 10; ++i) {
+            collect(&gc, stack);
+            REQUIRE(av_heap_idx(&stack[0]) == av_heap_idx(&v));
+            REQUIRE(AGC_CAST(uint8_t, &gc, av_heap_idx(&v)) == b);
+        }
+        REQUIRE(b[0] == 0xAB);
+        REQUIRE(b[LARGE_SZ - 1] == 0xAB);
+        REQUIRE(agc_stats(&gc)->bytes_copied == 0);
+
+        stack.clear();
+        collect(&gc, stack);
+        REQUIRE(gc.los_sz == 0);
+    }
+
+    SECTION("traced in place")
+    {
+        enum { NUM_VALUES = 1000 };
+        avalue_t t;
+        aint_t sz = sizeof(agc_tuple_t) + NUM_VALUES * sizeof(avalue_t);
+        REQUIRE(AERR_NONE == agc_reserve(&gc, sz));
+        aint_t ti = agc_alloc(&gc, AVT_TUPLE, sz);
+        REQUIRE(ti >= 0);
+        REQUIRE((ti & AGC_LARGE_BIT) != 0);
+        AGC_CAST(agc_tuple_t, &gc, ti)->sz = NUM_VALUES;
+        av_collectable(&t, AVT_TUPLE, ti);
+        stack.push_back(t);
+
+        for (aint_t i = 0; i < NUM_VALUES; ++i) {
+            avalue_t v;
+            while (AERR_NONE != agc_fixed_buffer_new(&gc, 64, &v)) {
+                REQUIRE(AERR_NONE == agc_reserve(&gc, 64));
+            }
+            *AGC_CAST(aint_t, &gc, av_heap_idx(&v)) = i;
+            ((avalue_t*)(AGC_CAST(agc_tuple_t, &gc, ti) + 1))[i] = v;
+        }
+
+        collect(&gc, stack);
+        REQUIRE(av_heap_idx(&stack[0]) == ti);
+        avalue_t* vs = (avalue_t*)(AGC_CAST(agc_tuple_t, &gc, ti) + 1);
+        for (aint_t i = 0; i < NUM_VALUES; ++i) {
+            REQUIRE(*AGC_CAST(aint_t, &gc, av_heap_idx(&vs[i])) == i);
+        }
+    }
+
+    SECTION("first large objects")
+    {
+        avalue_t v;
+        for (aint_t i = 0; i < 4; ++i) {
+            REQUIRE(AERR_NONE == agc_fixed_buffer_new(
+                &gc, gc.policy.large_threshold, &v));
+        }
+    }
+
+    SECTION("budget")
+    {
+        avalue_t v;
+        REQUIRE(AERR_NONE == agc_fixed_buffer_new(&gc, 8192, &v));
+        stack.push_back(v);
+        while (AERR_NONE == agc_fixed_buffer_new(&gc, 8192, &v)) {}
+        REQUIRE(gc.los_sz <= gc.los_budget);
+        REQUIRE(AERR_NONE == agc_reserve(&gc, 8192));
+        REQUIRE(AERR_NONE == agc_fixed_buffer_new(&gc, 8192, &v));
+
+        // only the rooted one survives, the budget is twice of it
+        collect(&gc, stack);
+        REQUIRE(gc.los_sz == 8192 + sizeof(agc_header_t));
+        REQUIRE(AERR_NONE == agc_fixed_buffer_new(&gc, 8192, &v));
+        REQUIRE(AERR_FULL == agc_fixed_buffer_new(&gc, 8192, &v));
+    }
+
+    agc_cleanup(&gc);
+}
+
 TEST_CASE("gc_string")
 {
     enum { NUM_IDX_BITS = 4 };
@@ -3,8 +3,16 @@
 #include <catch.hpp>
 
 #include <any/asm.h>
+#include <any/bundle.h>
 #include <any/loader.h>
+#include <any/scheduler.h>
+#include <any/actor.h>
+#include <any/gc_string.h>
 #include <any/list.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
 
 static void* myalloc(void*, void* old, aint_t sz)
 {
@@ -107,73 +115,77 @@ TEST_CASE("loader_link")
 
     avalue_t af1;
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_a", "f1", &af1));
-    REQUIRE(af1.tag.type == AVT_BYTE_CODE_FUNC);
-    REQUIRE(af1.v.avm_func->header->num_instructions == 4);
-    REQUIRE(af1.v.avm_func->instructions[0].b.opcode == AOC_NOP);
-    REQUIRE(af1.v.avm_func->instructions[1].b.opcode == AOC_IMP);
-    REQUIRE(af1.v.avm_func->instructions[1].imp.idx == 0);
-    REQUIRE(af1.v.avm_func->instructions[2].b.opcode == AOC_LDK);
-    REQUIRE(af1.v.avm_func->instructions[2].ldk.idx == 0);
-    REQUIRE(af1.v.avm_func->instructions[3].b.opcode == AOC_RET);
-    REQUIRE(af1.v.avm_func->header->num_constants == 1);
-    REQUIRE(af1.v.avm_func->constants[0].type == ACT_INTEGER);
-    REQUIRE(af1.v.avm_func->constants[0].integer == 0xAF1);
-    REQUIRE(af1.v.avm_func->header->num_imports == 1);
-    REQUIRE(af1.v.avm_func->import_values[0].tag.type == AVT_BYTE_CODE_FUNC);
-    avalue_t af1i = af1.v.avm_func->import_values[0];
+    REQUIRE(av_type(&af1) == AVT_BYTE_CODE_FUNC);
+    aprototype_t* af1p = av_to_byte_code_func(&af1);
+    REQUIRE(af1p->header->num_instructions == 4);
+    REQUIRE(af1p->instructions[0].b.opcode == AOC_NOP);
+    REQUIRE(af1p->instructions[1].b.opcode == AOC_IMP);
+    REQUIRE(af1p->instructions[1].imp.idx == 0);
+    REQUIRE(af1p->instructions[2].b.opcode == AOC_LDK);
+    REQUIRE(af1p->instructions[2].ldk.idx == 0);
+    REQUIRE(af1p->instructions[3].b.opcode == AOC_RET);
+    REQUIRE(af1p->header->num_constants == 1);
+    REQUIRE(af1p->constants[0].type == ACT_INTEGER);
+    REQUIRE(af1p->constants[0].integer == 0xAF1);
+    REQUIRE(af1p->header->num_imports == 1);
+    REQUIRE(av_type(af1p->import_values) == AVT_BYTE_CODE_FUNC);
+    avalue_t af1i = af1p->import_values[0];
 
     avalue_t af2;
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_a", "f2", &af2));
-    REQUIRE(af2.v.avm_func->header->num_instructions == 4);
-    REQUIRE(af2.v.avm_func->instructions[0].b.opcode == AOC_NOP);
-    REQUIRE(af2.v.avm_func->instructions[1].b.opcode == AOC_LDK);
-    REQUIRE(af2.v.avm_func->instructions[1].ldk.idx == 0);
-    REQUIRE(af2.v.avm_func->instructions[2].b.opcode == AOC_IMP);
-    REQUIRE(af2.v.avm_func->instructions[2].imp.idx == 0);
-    REQUIRE(af2.v.avm_func->instructions[3].b.opcode == AOC_RET);
-    REQUIRE(af2.v.avm_func->header->num_constants == 1);
-    REQUIRE(af2.v.avm_func->constants[0].type == ACT_INTEGER);
-    REQUIRE(af2.v.avm_func->constants[0].integer == 0xAF2);
-    REQUIRE(af2.v.avm_func->header->num_imports == 1);
-    REQUIRE(af2.v.avm_func->import_values[0].tag.type == AVT_NATIVE_FUNC);
-    REQUIRE(af2.v.avm_func->import_values[0].v.func == (anative_func_t)0xF1);
+    aprototype_t* af2p = av_to_byte_code_func(&af2);
+    REQUIRE(af2p->header->num_instructions == 4);
+    REQUIRE(af2p->instructions[0].b.opcode == AOC_NOP);
+    REQUIRE(af2p->instructions[1].b.opcode == AOC_LDK);
+    REQUIRE(af2p->instructions[1].ldk.idx == 0);
+    REQUIRE(af2p->instructions[2].b.opcode == AOC_IMP);
+    REQUIRE(af2p->instructions[2].imp.idx == 0);
+    REQUIRE(af2p->instructions[3].b.opcode == AOC_RET);
+    REQUIRE(af2p->header->num_constants == 1);
+    REQUIRE(af2p->constants[0].type == ACT_INTEGER);
+    REQUIRE(af2p->constants[0].integer == 0xAF2);
+    REQUIRE(af2p->header->num_imports == 1);
+    REQUIRE(av_type(af2p->import_values) == AVT_NATIVE_FUNC);
+    REQUIRE(av_to_native_func(af2p->import_values) == (anative_func_t)0xF1);
 
     avalue_t bf2;
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_b", "f2", &bf2));
-    REQUIRE(bf2.v.avm_func->header->num_instructions == 4);
-    REQUIRE(bf2.v.avm_func->instructions[0].b.opcode == AOC_LDK);
-    REQUIRE(bf2.v.avm_func->instructions[0].ldk.idx == 0);
-    REQUIRE(bf2.v.avm_func->instructions[1].b.opcode == AOC_IMP);
-    REQUIRE(bf2.v.avm_func->instructions[1].imp.idx == 0);
-    REQUIRE(bf2.v.avm_func->instructions[2].b.opcode == AOC_NOP);
-    REQUIRE(bf2.v.avm_func->instructions[3].b.opcode == AOC_RET);
-    REQUIRE(bf2.v.avm_func->header->num_constants == 1);
-    REQUIRE(bf2.v.avm_func->constants[0].type == ACT_INTEGER);
-    REQUIRE(bf2.v.avm_func->constants[0].integer == 0xBF2);
-    REQUIRE(bf2.v.avm_func->header->num_imports == 1);
-    REQUIRE(bf2.v.avm_func->import_values[0].tag.type == AVT_NATIVE_FUNC);
-    REQUIRE(bf2.v.avm_func->import_values[0].v.func == (anative_func_t)0xF2);
+    aprototype_t* bf2p = av_to_byte_code_func(&bf2);
+    REQUIRE(bf2p->header->num_instructions == 4);
+    REQUIRE(bf2p->instructions[0].b.opcode == AOC_LDK);
+    REQUIRE(bf2p->instructions[0].ldk.idx == 0);
+    REQUIRE(bf2p->instructions[1].b.opcode == AOC_IMP);
+    REQUIRE(bf2p->instructions[1].imp.idx == 0);
+    REQUIRE(bf2p->instructions[2].b.opcode == AOC_NOP);
+    REQUIRE(bf2p->instructions[3].b.opcode == AOC_RET);
+    REQUIRE(bf2p->header->num_constants == 1);
+    REQUIRE(bf2p->constants[0].type == ACT_INTEGER);
+    REQUIRE(bf2p->constants[0].integer == 0xBF2);
+    REQUIRE(bf2p->header->num_imports == 1);
+    REQUIRE(av_type(bf2p->import_values) == AVT_NATIVE_FUNC);
+    REQUIRE(av_to_native_func(bf2p->import_values) == (anative_func_t)0xF2);
 
     avalue_t bf1;
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_b", "f1", &bf1));
-    REQUIRE(bf1.v.avm_func->header->num_instructions == 4);
-    REQUIRE(bf1.v.avm_func->instructions[0].b.opcode == AOC_IMP);
-    REQUIRE(bf1.v.avm_func->instructions[0].imp.idx == 0);
-    REQUIRE(bf1.v.avm_func->instructions[1].b.opcode == AOC_NOP);
-    REQUIRE(bf1.v.avm_func->instructions[2].b.opcode == AOC_LDK);
-    REQUIRE(bf1.v.avm_func->instructions[2].ldk.idx == 0);
-    REQUIRE(bf1.v.avm_func->instructions[3].b.opcode == AOC_RET);
-    REQUIRE(bf1.v.avm_func->header->num_constants == 1);
-    REQUIRE(bf1.v.avm_func->constants[0].type == ACT_INTEGER);
-    REQUIRE(bf1.v.avm_func->constants[0].integer == 0xBF1);
-    REQUIRE(bf1.v.avm_func->header->num_imports == 1);
-    REQUIRE(bf1.v.avm_func->import_values[0].tag.type == AVT_BYTE_CODE_FUNC);
-    avalue_t bf1i = bf1.v.avm_func->import_values[0];
-
-    REQUIRE(af1i.tag.type == bf2.tag.type);
-    REQUIRE(af1i.v.avm_func == bf2.v.avm_func);
-    REQUIRE(bf1i.tag.type == af1.tag.type);
-    REQUIRE(bf1i.v.avm_func == af1.v.avm_func);
+    aprototype_t* bf1p = av_to_byte_code_func(&bf1);
+    REQUIRE(bf1p->header->num_instructions == 4);
+    REQUIRE(bf1p->instructions[0].b.opcode == AOC_IMP);
+    REQUIRE(bf1p->instructions[0].imp.idx == 0);
+    REQUIRE(bf1p->instructions[1].b.opcode == AOC_NOP);
+    REQUIRE(bf1p->instructions[2].b.opcode == AOC_LDK);
+    REQUIRE(bf1p->instructions[2].ldk.idx == 0);
+    REQUIRE(bf1p->instructions[3].b.opcode == AOC_RET);
+    REQUIRE(bf1p->header->num_constants == 1);
+    REQUIRE(bf1p->constants[0].type == ACT_INTEGER);
+    REQUIRE(bf1p->constants[0].integer == 0xBF1);
+    REQUIRE(bf1p->header->num_imports == 1);
+    REQUIRE(av_type(bf1p->import_values) == AVT_BYTE_CODE_FUNC);
+    avalue_t bf1i = bf1p->import_values[0];
+
+    REQUIRE(av_type(&af1i) == av_type(&bf2));
+    REQUIRE(av_to_byte_code_func(&af1i) == av_to_byte_code_func(&bf2));
+    REQUIRE(av_type(&bf1i) == av_type(&af1));
+    REQUIRE(av_to_byte_code_func(&bf1i) == av_to_byte_code_func(&af1));
 
     aloader_cleanup(&l);
 
@@ -332,18 +344,18 @@ TEST_CASE("loader_link_safe_and_sweep")
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_n", "f1", &nnf1));
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_n", "f2", &nnf2));
 
-    REQUIRE(oaf1.tag.type == naf1.tag.type);
-    REQUIRE(oaf1.v.avm_func == naf1.v.avm_func);
-    REQUIRE(oaf2.tag.type == naf2.tag.type);
-    REQUIRE(oaf2.v.avm_func == naf2.v.avm_func);
-    REQUIRE(obf1.tag.type == nbf1.tag.type);
-    REQUIRE(obf1.v.avm_func == nbf1.v.avm_func);
-    REQUIRE(obf2.tag.type == nbf2.tag.type);
-    REQUIRE(obf2.v.avm_func == nbf2.v.avm_func);
-    REQUIRE(onf1.tag.type == nnf1.tag.type);
-    REQUIRE(onf1.v.func == nnf1.v.func);
-    REQUIRE(onf2.tag.type == nnf2.tag.type);
-    REQUIRE(onf2.v.func == nnf2.v.func);
+    REQUIRE(av_type(&oaf1) == av_type(&naf1));
+    REQUIRE(av_to_byte_code_func(&oaf1) == av_to_byte_code_func(&naf1));
+    REQUIRE(av_type(&oaf2) == av_type(&naf2));
+    REQUIRE(av_to_byte_code_func(&oaf2) == av_to_byte_code_func(&naf2));
+    REQUIRE(av_type(&obf1) == av_type(&nbf1));
+    REQUIRE(av_to_byte_code_func(&obf1) == av_to_byte_code_func(&nbf1));
+    REQUIRE(av_type(&obf2) == av_type(&nbf2));
+    REQUIRE(av_to_byte_code_func(&obf2) == av_to_byte_code_func(&nbf2));
+    REQUIRE(av_type(&onf1) == av_type(&nnf1));
+    REQUIRE(av_to_native_func(&onf1) == av_to_native_func(&nnf1));
+    REQUIRE(av_type(&onf2) == av_type(&nnf2));
+    REQUIRE(av_to_native_func(&onf2) == av_to_native_func(&nnf2));
 
     // link with mod_a.f3 (reload)
     aasm_t aa;
@@ -366,17 +378,18 @@ TEST_CASE("loader_link_safe_and_sweep")
     REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
 
     REQUIRE(AERR_NONE == aloader_find(&l, "mod_c", "f1", &cf1));
-    REQUIRE(cf1.v.avm_func->header->num_instructions == 2);
-    REQUIRE(cf1.v.avm_func->instructions[0].b.opcode == AOC_NOP);
-    REQUIRE(cf1.v.avm_func->instructions[1].b.opcode == AOC_RET);
-    REQUIRE(cf1.v.avm_func->header->num_constants == 1);
-    REQUIRE(cf1.v.avm_func->constants[0].type == ACT_INTEGER);
-    REQUIRE(cf1.v.avm_func->constants[0].integer == 0xCF1);
-    REQUIRE(cf1.v.avm_func->header->num_imports == 1);
-    REQUIRE(cf1.v.avm_func->import_values[0].tag.type == AVT_BYTE_CODE_FUNC);
-    avalue_t cf1i = cf1.v.avm_func->import_values[0];
-    REQUIRE(cf1i.tag.type == AVT_BYTE_CODE_FUNC);
-    aprototype_t* cf1ip = cf1i.v.avm_func;
+    aprototype_t* cf1p = av_to_byte_code_func(&cf1);
+    REQUIRE(cf1p->header->num_instructions == 2);
+    REQUIRE(cf1p->instructions[0].b.opcode == AOC_NOP);
+    REQUIRE(cf1p->instructions[1].b.opcode == AOC_RET);
+    REQUIRE(cf1p->header->num_constants == 1);
+    REQUIRE(cf1p->constants[0].type == ACT_INTEGER);
+    REQUIRE(cf1p->constants[0].integer == 0xCF1);
+    REQUIRE(cf1p->header->num_imports == 1);
+    REQUIRE(av_type(cf1p->import_values) == AVT_BYTE_CODE_FUNC);
+    avalue_t cf1i = cf1p->import_values[0];
+    REQUIRE(av_type(&cf1i) == AVT_BYTE_CODE_FUNC);
+    aprototype_t* cf1ip = av_to_byte_code_func(&cf1i);
     aprototype_t* cf1icp = cf1ip->chunk->prototypes;
     REQUIRE(strcmp(cf1icp->strings + cf1icp->header->symbol, "mod_a") == 0);
     REQUIRE(strcmp(cf1ip->strings + cf1ip->header->symbol, "f3") == 0);
@@ -400,4 +413,747 @@ TEST_CASE("loader_link_safe_and_sweep")
     aasm_cleanup(&aa);
     aasm_cleanup(&b);
     aasm_cleanup(&c);
-}
\ No newline at end of file
+}
+enum { NUM_MODULES = 200 };
+enum { NUM_FUNCS = 10 };
+
+static void push_module_n(aasm_t* a, aint_t m, aint_t num_funcs = NUM_FUNCS)
+{
+    char name[32];
+    char imp[32];
+    snprintf(name, sizeof(name), "mod_%d", (int)m);
+    snprintf(imp, sizeof(imp), "mod_%d", (int)(m + 1) % NUM_MODULES);
+    aasm_prototype(a)->symbol = aasm_string_to_ref(a, name);
+    for (aint_t f = 0; f < num_funcs; ++f) {
+        snprintf(name, sizeof(name), "f%d", (int)f);
+        aasm_module_push(a, name);
+        aasm_add_import(a, imp, name);
+        aasm_emit(a, ai_imp(0));
+        aasm_emit(a, ai_ret());
+        aasm_pop(a);
+    }
+}
+
+TEST_CASE("loader_index")
+{
+    static aasm_t as[NUM_MODULES];
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    for (aint_t m = 0; m < NUM_MODULES; ++m) {
+        aasm_init(as + m, &myalloc, NULL);
+        aasm_load(as + m, NULL);
+        push_module_n(as + m, m);
+        aasm_save(as + m);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &l, as[m].chunk, as[m].chunk_size, NULL, NULL));
+    }
+    REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+    REQUIRE(l.symbols.num == NUM_MODULES*NUM_FUNCS);
+
+    char module[32];
+    char name[32];
+    for (aint_t m = 0; m < NUM_MODULES; ++m) {
+        snprintf(module, sizeof(module), "mod_%d", (int)m);
+        for (aint_t f = 0; f < NUM_FUNCS; ++f) {
+            avalue_t v;
+            snprintf(name, sizeof(name), "f%d", (int)f);
+            REQUIRE(AERR_NONE == aloader_find(&l, module, name, &v));
+            aprototype_t* p = av_to_byte_code_func(&v);
+            REQUIRE(strcmp(p->strings + p->header->symbol, name) == 0);
+            REQUIRE(av_type(p->import_values) == AVT_BYTE_CODE_FUNC);
+        }
+    }
+    avalue_t v;
+    REQUIRE(AERR_UNRESOLVED == aloader_find(&l, "mod_0", "f10", &v));
+    REQUIRE(AERR_UNRESOLVED == aloader_find(&l, "mod_200", "f0", &v));
+
+    // reload, importers are relinked to the new version
+    aasm_t r;
+    aasm_init(&r, &myalloc, NULL);
+    aasm_load(&r, NULL);
+    push_module_n(&r, 1);
+    aasm_save(&r);
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&l, r.chunk, r.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+    REQUIRE(l.symbols.num == NUM_MODULES*NUM_FUNCS);
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_1", "f3", &v));
+    REQUIRE(av_to_byte_code_func(&v)->chunk->header == r.chunk);
+    avalue_t i;
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_0", "f3", &i));
+    REQUIRE(av_to_byte_code_func(av_to_byte_code_func(&i)->import_values) ==
+        av_to_byte_code_func(&v));
+
+    // native libs are searched first
+    alib_func_t nfuncs[] = {
+        { "f3", (anative_func_t)0xF3 },
+        { "f42", (anative_func_t)0xF42 },
+        { NULL, NULL }
+    };
+    alib_t nmodule = { "mod_1", nfuncs };
+    aloader_add_lib(&l, &nmodule);
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_1", "f3", &v));
+    REQUIRE(av_to_native_func(&v) == (anative_func_t)0xF3);
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_1", "f42", &v));
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_1", "f4", &v));
+    REQUIRE(av_type(&v) == AVT_BYTE_CODE_FUNC);
+
+    aloader_cleanup(&l);
+    REQUIRE(AERR_UNRESOLVED == aloader_find(&l, "mod_1", "f4", &v));
+
+    aasm_cleanup(&r);
+    for (aint_t m = 0; m < NUM_MODULES; ++m) aasm_cleanup(as + m);
+}
+
+enum { NUM_NATIVES = 500 };
+
+// Module `mod_1` shadowed by natives, but its last function.
+static void push_module_shadowed(aasm_t* a)
+{
+    char name[16];
+    aasm_prototype(a)->symbol = aasm_string_to_ref(a, "mod_1");
+    for (aint_t f = 0; f <= NUM_NATIVES; ++f) {
+        snprintf(name, sizeof(name), "f%d", (int)f);
+        aasm_module_push(a, name);
+        aasm_emit(a, ai_ret());
+        aasm_pop(a);
+    }
+}
+
+TEST_CASE("loader_natives")
+{
+    static char names[NUM_NATIVES][16];
+    static alib_func_t nfuncs[NUM_NATIVES + 1];
+    for (aint_t f = 0; f < NUM_NATIVES; ++f) {
+        snprintf(names[f], sizeof(names[f]), "f%d", (int)f);
+        nfuncs[f].name = names[f];
+        nfuncs[f].func = (anative_func_t)(size_t)(f + 1);
+    }
+    nfuncs[NUM_NATIVES].name = NULL;
+    nfuncs[NUM_NATIVES].func = NULL;
+    alib_t nmodule = { "mod_1", nfuncs };
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+    aloader_add_lib(&l, &nmodule);
+    REQUIRE(l.natives.num == NUM_NATIVES);
+    REQUIRE(l.symbols.num == 0);
+    asymbol_t* const slots = l.natives.slots;
+
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    aasm_load(&a, NULL);
+    push_module_n(&a, 0);
+    aasm_save(&a);
+    aasm_t b;
+    aasm_init(&b, &myalloc, NULL);
+    aasm_load(&b, NULL);
+    push_module_shadowed(&b);
+    aasm_save(&b);
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &l, a.chunk, a.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &l, b.chunk, b.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+
+    // links index byte code only, natives stay as they were
+    REQUIRE(l.natives.slots == slots);
+    REQUIRE(l.natives.num == NUM_NATIVES);
+    REQUIRE(l.symbols.num == NUM_FUNCS + NUM_NATIVES + 1);
+
+    avalue_t v;
+    for (aint_t f = 0; f < NUM_NATIVES; ++f) {
+        REQUIRE(AERR_NONE == aloader_find(&l, "mod_1", names[f], &v));
+        REQUIRE(av_to_native_func(&v) == nfuncs[f].func);
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "f%d", (int)NUM_NATIVES);
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_1", name, &v));
+    REQUIRE(av_type(&v) == AVT_BYTE_CODE_FUNC);
+
+    // imports resolve to natives as well
+    REQUIRE(AERR_NONE == aloader_find(&l, "mod_0", "f3", &v));
+    aprototype_t* const p = av_to_byte_code_func(&v);
+    REQUIRE(av_to_native_func(p->import_values) == nfuncs[3].func);
+
+    aloader_cleanup(&l);
+    REQUIRE(l.natives.num == 0);
+    aasm_cleanup(&a);
+    aasm_cleanup(&b);
+}
+
+static aprototype_t* find_proto(aloader_t* l, const char* module, aint_t f)
+{
+    char name[32];
+    avalue_t v;
+    snprintf(name, sizeof(name), "f%d", (int)f);
+    REQUIRE(AERR_NONE == aloader_find(l, module, name, &v));
+    return av_to_byte_code_func(&v);
+}
+
+static aprototype_t* import_of(aprototype_t* p)
+{
+    return av_to_byte_code_func(p->import_values);
+}
+
+TEST_CASE("loader_relink")
+{
+    enum { NUM_RELOADS = 3 };
+
+    static aasm_t as[NUM_MODULES];
+    aasm_t rs[NUM_RELOADS];
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    for (aint_t m = 0; m < NUM_MODULES; ++m) {
+        aasm_init(as + m, &myalloc, NULL);
+        aasm_load(as + m, NULL);
+        push_module_n(as + m, m);
+        aasm_save(as + m);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &l, as[m].chunk, as[m].chunk_size, NULL, NULL));
+    }
+    REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+    for (aint_t r = 0; r < NUM_RELOADS; ++r) {
+        aasm_init(rs + r, &myalloc, NULL);
+        aasm_load(rs + r, NULL);
+    }
+
+    // mod_0 is the only importer of mod_1
+    aprototype_t* old_1 = find_proto(&l, "mod_1", 5);
+    REQUIRE(import_of(find_proto(&l, "mod_0", 5)) == old_1);
+    aprototype_t* old_2 = find_proto(&l, "mod_2", 5);
+    REQUIRE(import_of(old_1) == old_2);
+
+    push_module_n(rs + 0, 1);
+    aasm_save(rs + 0);
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&l, rs[0].chunk, rs[0].chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+    aprototype_t* new_1 = find_proto(&l, "mod_1", 5);
+    REQUIRE(new_1 != old_1);
+    REQUIRE(import_of(find_proto(&l, "mod_0", 5)) == new_1);
+    REQUIRE(import_of(new_1) == old_2);
+    // old code keeps its bindings
+    REQUIRE(import_of(old_1) == old_2);
+
+    SECTION("rollback")
+    {
+        // mod_0 imports mod_1.f9 which is missing
+        push_module_n(rs + 1, 1, NUM_FUNCS - 1);
+        aasm_save(rs + 1);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &l, rs[1].chunk, rs[1].chunk_size, NULL, NULL));
+        REQUIRE(AERR_UNRESOLVED == aloader_link(&l, TRUE));
+        REQUIRE(find_proto(&l, "mod_1", 5) == new_1);
+        for (aint_t f = 0; f < NUM_FUNCS; ++f) {
+            REQUIRE(import_of(find_proto(&l, "mod_0", f)) ==
+                find_proto(&l, "mod_1", f));
+        }
+
+        // relinking still works after a rollback
+        push_module_n(rs + 2, 1);
+        aasm_save(rs + 2);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &l, rs[2].chunk, rs[2].chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        REQUIRE(find_proto(&l, "mod_1", 5)->chunk->header == rs[2].chunk);
+        REQUIRE(import_of(find_proto(&l, "mod_0", 5)) ==
+            find_proto(&l, "mod_1", 5));
+    }
+
+    SECTION("sweep")
+    {
+        aloader_sweep(&l);
+        REQUIRE(alist_is_end(&l.garbages, alist_head(&l.garbages)));
+        push_module_n(rs + 1, 2);
+        aasm_save(rs + 1);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &l, rs[1].chunk, rs[1].chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        REQUIRE(import_of(find_proto(&l, "mod_1", 5)) ==
+            find_proto(&l, "mod_2", 5));
+    }
+
+    aloader_cleanup(&l);
+
+    for (aint_t r = 0; r < NUM_RELOADS; ++r) aasm_cleanup(rs + r);
+    for (aint_t m = 0; m < NUM_MODULES; ++m) aasm_cleanup(as + m);
+}
+
+static void write_chunk(const char* path, aasm_t* a, aint_t sz)
+{
+    FILE* f = fopen(path, "wb");
+    REQUIRE(f != NULL);
+    fwrite(a->chunk, 1, (size_t)sz, f);
+    fclose(f);
+}
+
+static void require_module_c(aloader_t* l, aasm_t* a)
+{
+    avalue_t v;
+    REQUIRE(AERR_NONE == aloader_find(l, "mod_c", "f1", &v));
+    aprototype_t* p = av_to_byte_code_func(&v);
+    REQUIRE(p->chunk->header != a->chunk);
+    REQUIRE(p->header->num_instructions == 2);
+    REQUIRE(p->constants[0].integer == 0xCF1);
+    REQUIRE(av_to_native_func(p->import_values) == (anative_func_t)0xF3);
+}
+
+TEST_CASE("loader_chunk_file")
+{
+    static const char* PATH = "loader_chunk_file.avmc";
+
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    aasm_load(&a, NULL);
+    push_module_c(&a);
+    aasm_save(&a);
+
+    alib_func_t nfuncs[] = {
+        { "f3", (anative_func_t)0xF3 },
+        { NULL, NULL }
+    };
+    alib_t nmodule = { "mod_a", nfuncs };
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    REQUIRE(AERR_IO == aloader_add_chunk_file(&l, "not_existed.avmc"));
+
+    SECTION("read")
+    {
+        write_chunk(PATH, &a, a.chunk_size);
+        REQUIRE(AERR_NONE == aloader_add_chunk_file(&l, PATH));
+        // the loaded chunk does not follow the file
+        write_chunk(PATH, &a, 0);
+        aloader_add_lib(&l, &nmodule);
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        require_module_c(&l, &a);
+    }
+
+    SECTION("mapped")
+    {
+        aloader_map_files(&l, TRUE);
+        write_chunk(PATH, &a, a.chunk_size);
+        REQUIRE(AERR_NONE == aloader_add_chunk_file(&l, PATH));
+        aloader_add_lib(&l, &nmodule);
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        require_module_c(&l, &a);
+    }
+
+    SECTION("truncated")
+    {
+        write_chunk(PATH, &a, a.chunk_size - 1);
+        REQUIRE(AERR_MALFORMED == aloader_add_chunk_file(&l, PATH));
+        REQUIRE(alist_is_end(&l.pendings, alist_head(&l.pendings)));
+    }
+
+    aloader_cleanup(&l);
+    remove(PATH);
+    aasm_cleanup(&a);
+}
+
+TEST_CASE("loader_bundle")
+{
+    static aasm_t as[NUM_MODULES];
+    static achunk_header_t* chunks[NUM_MODULES];
+    static aint_t sizes[NUM_MODULES];
+
+    for (aint_t m = 0; m < NUM_MODULES; ++m) {
+        aasm_init(as + m, &myalloc, NULL);
+        aasm_load(as + m, NULL);
+        push_module_n(as + m, m);
+        aasm_save(as + m);
+        chunks[m] = as[m].chunk;
+        sizes[m] = as[m].chunk_size;
+    }
+    aint_t sz = abundle_size(chunks, sizes, NUM_MODULES);
+    abundle_header_t* b = (abundle_header_t*)myalloc(NULL, NULL, sz);
+    abundle_write(b, chunks, sizes, NUM_MODULES);
+    REQUIRE(b->num_chunks == NUM_MODULES);
+    abundle_entry_t* entries = (abundle_entry_t*)(b + 1);
+    const char* strings = (const char*)(entries + NUM_MODULES);
+    REQUIRE(strcmp(strings + entries[1].name, "mod_1") == 0);
+    REQUIRE(entries[1].offset % ABUNDLE_ALIGN == 0);
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    SECTION("link")
+    {
+        REQUIRE(AERR_NONE == aloader_add_bundle(&l, b, sz, &myalloc, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        REQUIRE(l.symbols.num == NUM_MODULES*NUM_FUNCS);
+        aprototype_t* p = find_proto(&l, "mod_7", 3);
+        REQUIRE((uint8_t*)p->chunk->header ==
+            (uint8_t*)b + entries[7].offset);
+        REQUIRE(import_of(p) == find_proto(&l, "mod_8", 3));
+
+        // the bundle goes away with its last chunk
+        aasm_t r;
+        aasm_init(&r, &myalloc, NULL);
+        aasm_load(&r, NULL);
+        push_module_n(&r, 7);
+        aasm_save(&r);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, r.chunk, r.chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        aloader_sweep(&l);
+        aloader_cleanup(&l);
+        aasm_cleanup(&r);
+    }
+
+    SECTION("file")
+    {
+        static const char* PATH = "loader_bundle.avmb";
+        FILE* f = fopen(PATH, "wb");
+        REQUIRE(f != NULL);
+        fwrite(b, 1, (size_t)sz, f);
+        fclose(f);
+        REQUIRE(AERR_NONE == aloader_add_bundle_file(&l, PATH));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        REQUIRE(import_of(find_proto(&l, "mod_199", 0)) ==
+            find_proto(&l, "mod_0", 0));
+        aloader_cleanup(&l);
+        remove(PATH);
+        myalloc(NULL, b, 0);
+    }
+
+    SECTION("malformed")
+    {
+        abundle_entry_t* last = entries + NUM_MODULES - 1;
+        REQUIRE(AERR_MALFORMED == aloader_add_bundle(&l, b,
+            (aint_t)(last->offset + last->size) - 1, &myalloc, NULL));
+        entries[5].offset += 1;
+        REQUIRE(AERR_MALFORMED ==
+            aloader_add_bundle(&l, b, sz, &myalloc, NULL));
+        entries[5].offset -= 1;
+        // a bad chunk rolls back the whole bundle
+        ((achunk_header_t*)((uint8_t*)b + entries[5].offset))->_[0] = 1;
+        REQUIRE(AERR_MALFORMED ==
+            aloader_add_bundle(&l, b, sz, &myalloc, NULL));
+        REQUIRE(alist_is_end(&l.pendings, alist_head(&l.pendings)));
+        aloader_cleanup(&l);
+        myalloc(NULL, b, 0);
+    }
+
+    for (aint_t m = 0; m < NUM_MODULES; ++m) aasm_cleanup(as + m);
+}
+
+// Header of the `n`th prototype in layout order.
+static aprototype_header_t* proto_at(std::vector<uint8_t>& c, aint_t n)
+{
+    aint_t off = sizeof(achunk_header_t);
+    for (;;) {
+        aprototype_header_t* p = (aprototype_header_t*)(c.data() + off);
+        if (n-- == 0) return p;
+        off += sizeof(aprototype_header_t) + p->strings_sz +
+            p->num_instructions * sizeof(ainstruction_t) +
+            p->num_constants * sizeof(aconstant_t) +
+            p->num_imports * sizeof(aimport_t);
+    }
+}
+
+static ainstruction_t* instructions_of(aprototype_header_t* p)
+{
+    return (ainstruction_t*)(((uint8_t*)(p + 1)) + p->strings_sz);
+}
+
+TEST_CASE("loader_validate")
+{
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    aasm_load(&a, NULL);
+    push_module_a(&a);
+    aasm_save(&a);
+
+    std::vector<uint8_t> c(
+        (uint8_t*)a.chunk, (uint8_t*)a.chunk + a.chunk_size);
+    aprototype_header_t* const m = proto_at(c, 0);
+    aprototype_header_t* const f1 = proto_at(c, 1);
+    ainstruction_t* const ins = instructions_of(f1);
+    aerror_t expected = AERR_MALFORMED;
+    aint_t sz = a.chunk_size;
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    SECTION("valid")
+    {
+        expected = AERR_NONE;
+    }
+
+    SECTION("truncated")
+    {
+        sz -= 1;
+    }
+
+    SECTION("string not terminated")
+    {
+        ((uint8_t*)(m + 1))[m->strings_sz - 1] = 'x';
+    }
+
+    SECTION("string out of range")
+    {
+        m->symbol = m->strings_sz;
+    }
+
+    SECTION("string without hash")
+    {
+        f1->source = 0;
+    }
+
+    SECTION("negative count")
+    {
+        m->num_nesteds = -1;
+    }
+
+    SECTION("count out of range")
+    {
+        f1->num_instructions = a.chunk_size;
+    }
+
+    SECTION("bad constant type")
+    {
+        ((aconstant_t*)(ins + f1->num_instructions))->type = 0xFF;
+    }
+
+    SECTION("bad opcode")
+    {
+        ins[0].b.opcode = 0xFF;
+    }
+
+    SECTION("bad import index")
+    {
+        ins[1] = ai_imp(1);
+    }
+
+    SECTION("bad jump")
+    {
+        ins[3] = ai_jmp(0);
+    }
+
+    REQUIRE(expected == aloader_add_chunk(
+        &l, (achunk_header_t*)c.data(), sz, NULL, NULL));
+
+    aloader_cleanup(&l);
+    aasm_cleanup(&a);
+}
+
+enum { NUM_WORKERS = 4 };
+
+static void thread_pool_for(
+    void*, aint_t n, aparallel_task_t task, void* task_ud)
+{
+    std::atomic<aint_t> next(0);
+    std::vector<std::thread> workers;
+    for (aint_t w = 0; w < NUM_WORKERS; ++w) {
+        workers.emplace_back([&] {
+            for (aint_t i = next++; i < n; i = next++) task(task_ud, i);
+        });
+    }
+    for (auto& w : workers) w.join();
+}
+
+static std::vector<std::string> unresolveds;
+
+static void on_unresolved(const char* m, const char* n)
+{
+    unresolveds.push_back(std::string(m) + ":" + n);
+}
+
+TEST_CASE("loader_parallel")
+{
+    static aasm_t as[NUM_MODULES];
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+    aloader_parallel(&l, &thread_pool_for, NULL);
+    aloader_on_unresolved(&l, &on_unresolved);
+    unresolveds.clear();
+
+    for (aint_t m = 0; m < NUM_MODULES; ++m) {
+        aasm_init(as + m, &myalloc, NULL);
+        aasm_load(as + m, NULL);
+        // mod_150 misses f9, which is imported by mod_149
+        push_module_n(as + m, m, m == 150 ? NUM_FUNCS - 1 : NUM_FUNCS);
+        aasm_save(as + m);
+    }
+
+    SECTION("link")
+    {
+        for (aint_t m = 0; m < NUM_MODULES; ++m) {
+            if (m == 150) continue;
+            REQUIRE(AERR_NONE == aloader_add_chunk(
+                &l, as[m].chunk, as[m].chunk_size, NULL, NULL));
+        }
+        aasm_t r;
+        aasm_init(&r, &myalloc, NULL);
+        aasm_load(&r, NULL);
+        push_module_n(&r, 150);
+        aasm_save(&r);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, r.chunk, r.chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        for (aint_t m = 0; m < NUM_MODULES; ++m) {
+            char module[32];
+            char next[32];
+            snprintf(module, sizeof(module), "mod_%d", (int)m);
+            snprintf(next, sizeof(next), "mod_%d", (int)(m + 1) % NUM_MODULES);
+            for (aint_t f = 0; f < NUM_FUNCS; ++f) {
+                REQUIRE(import_of(find_proto(&l, module, f)) ==
+                    find_proto(&l, next, f));
+            }
+        }
+        REQUIRE(unresolveds.empty());
+
+        // importers are linked after a parallel link
+        aasm_t rr;
+        aasm_init(&rr, &myalloc, NULL);
+        aasm_load(&rr, NULL);
+        push_module_n(&rr, 150);
+        aasm_save(&rr);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, rr.chunk, rr.chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&l, TRUE));
+        REQUIRE(import_of(find_proto(&l, "mod_149", 2)) ==
+            find_proto(&l, "mod_150", 2));
+        aloader_cleanup(&l);
+        aasm_cleanup(&r);
+        aasm_cleanup(&rr);
+    }
+
+    SECTION("unresolved")
+    {
+        for (aint_t m = 0; m < NUM_MODULES; ++m) {
+            REQUIRE(AERR_NONE == aloader_add_chunk(
+                &l, as[m].chunk, as[m].chunk_size, NULL, NULL));
+        }
+        REQUIRE(AERR_UNRESOLVED == aloader_link(&l, TRUE));
+        REQUIRE(unresolveds.size() == 1);
+        REQUIRE(unresolveds[0] == "mod_150:f9");
+        REQUIRE(alist_is_end(&l.pendings, alist_head(&l.pendings)));
+        avalue_t v;
+        REQUIRE(AERR_UNRESOLVED == aloader_find(&l, "mod_0", "f0", &v));
+        aloader_cleanup(&l);
+    }
+
+    for (aint_t m = 0; m < NUM_MODULES; ++m) aasm_cleanup(as + m);
+}
+
+static void push_module_lazy(aasm_t* a)
+{
+    aasm_prototype_t* const p = aasm_prototype(a);
+    p->symbol = aasm_string_to_ref(a, "mod_l");
+
+    aasm_module_push(a, "ok");
+    aasm_add_import(a, "mod_k", "get");
+    aasm_emit(a, ai_imp(0));
+    aasm_emit(a, ai_ivk(0));
+    aasm_emit(a, ai_ret());
+    aasm_pop(a);
+
+    aasm_module_push(a, "bad");
+    aasm_add_import(a, "mod_x", "missing");
+    aasm_emit(a, ai_imp(0));
+    aasm_emit(a, ai_ret());
+    aasm_pop(a);
+}
+
+static void push_module_k(aasm_t* a)
+{
+    aasm_prototype_t* const p = aasm_prototype(a);
+    p->symbol = aasm_string_to_ref(a, "mod_k");
+
+    aasm_module_push(a, "get");
+    aasm_add_constant(a, ac_integer(0x42));
+    aasm_emit(a, ai_ldk(0));
+    aasm_emit(a, ai_ret());
+    aasm_pop(a);
+}
+
+static aint_t lazy_result;
+static std::string lazy_error;
+
+static void call_lazy(aactor_t* a)
+{
+    any_find(a, "mod_l", "ok");
+    any_call(a, 0);
+    lazy_result = any_to_integer(a, 0);
+    any_find(a, "mod_l", "bad");
+    any_protected_call(a, 0);
+    lazy_error = any_to_string(a, any_count(a) - 1);
+    any_push_nil(a);
+}
+
+TEST_CASE("loader_lazy")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { CSTACK_SZ = 16384 };
+
+    aasm_t l, k;
+    aasm_init(&l, &myalloc, NULL);
+    aasm_load(&l, NULL);
+    push_module_lazy(&l);
+    aasm_save(&l);
+    aasm_init(&k, &myalloc, NULL);
+    aasm_load(&k, NULL);
+    push_module_k(&k);
+    aasm_save(&k);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    aloader_lazy(&s.loader, TRUE);
+    aloader_on_unresolved(&s.loader, &on_unresolved);
+    unresolveds.clear();
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, l.chunk, l.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, k.chunk, k.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    avalue_t v;
+    REQUIRE(AERR_NONE == aloader_find(&s.loader, "mod_l", "ok", &v));
+    aprototype_t* const ok = av_to_byte_code_func(&v);
+    REQUIRE(AERR_NONE == aloader_find(&s.loader, "mod_k", "get", &v));
+    achunk_t* const mod_k = av_to_byte_code_func(&v)->chunk;
+    REQUIRE(av_type(ok->import_values) == AVT_NIL);
+    REQUIRE(alist_is_end(&mod_k->dependents, alist_head(&mod_k->dependents)));
+
+    SECTION("first use")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &call_lazy);
+        ascheduler_start(&s, a, 0);
+        ascheduler_run_once(&s);
+
+        REQUIRE(lazy_result == 0x42);
+        REQUIRE(lazy_error == "unresolved import mod_x:missing");
+        REQUIRE(unresolveds.size() == 1);
+        REQUIRE(unresolveds[0] == "mod_x:missing");
+        // resolved slots are relinked on reload as eagerly linked ones
+        REQUIRE(av_type(ok->import_values) == AVT_BYTE_CODE_FUNC);
+        REQUIRE(alist_head(&mod_k->dependents) == &ok->chunk->links[0].node);
+    }
+
+    SECTION("resolve")
+    {
+        REQUIRE(AERR_NONE == aloader_resolve(&s.loader, ok, 0));
+        REQUIRE(import_of(ok)->chunk == mod_k);
+        aprototype_t* const bad = ok + 1;
+        REQUIRE(AERR_UNRESOLVED == aloader_resolve(&s.loader, bad, 0));
+        REQUIRE(av_type(bad->import_values) == AVT_NIL);
+    }
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&l);
+    aasm_cleanup(&k);
+}
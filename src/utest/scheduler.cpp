@@ -5,6 +5,11 @@
 #include <stdlib.h>
 #include <any/scheduler.h>
 #include <any/actor.h>
+#include <any/asm.h>
+#include <any/loader.h>
+#include <any/gc_string.h>
+#include <any/gc_buffer.h>
+#include <any/gc.h>
 
 enum { CSTACK_SZ = 8192 };
 
@@ -13,17 +18,175 @@ static void* myalloc(void*, void* old, aint_t sz)
     return realloc(old, (size_t)sz);
 }
 
+static aint_t num_allocs;
+static aint_t max_alloc_sz;
+
+static void* counting_alloc(void*, void* old, aint_t sz)
+{
+    if (sz) ++num_allocs;
+    if (sz > max_alloc_sz) max_alloc_sz = sz;
+    return realloc(old, (size_t)sz);
+}
+
 static void nop(aactor_t* a)
 {
     any_push_nil(a);
 }
 
-static void spawn_new(ascheduler_t* s)
+static void churn(aactor_t* a)
+{
+    for (aint_t i = 0; i < 100; ++i) {
+        any_push_string(a, "a string which makes the heap and stack grow");
+    }
+    any_push_nil(a);
+}
+
+enum { BIG_SZ = 1024*1024 + 1 };
+
+static void big_buffer(aactor_t* a)
+{
+    any_push_buffer(a, BIG_SZ);
+    any_push_nil(a);
+}
+
+static aint_t garbage_sz;
+static aint_t garbage_cap;
+
+static void make_garbage(aactor_t* a, aint_t n)
+{
+    for (aint_t i = 0; i < n; ++i) {
+        any_push_string(a, "garbage which is collected while waiting");
+    }
+    any_pop(a, n);
+    garbage_sz = agc_heap_size(&a->gc);
+    garbage_cap = agc_heap_capacity(&a->gc);
+}
+
+static void garbage_then_sleep(aactor_t* a)
+{
+    make_garbage(a, 5);
+    any_sleep(a, amsec(10000));
+    any_push_nil(a);
+}
+
+static void garbage_then_recv(aactor_t* a)
+{
+    make_garbage(a, 200);
+    any_push_nil(a);
+    any_mbox_recv(a, AINFINITE);
+}
+
+static void spin(aactor_t* a)
+{
+    for (;;) any_yield(a);
+}
+
+static aactor_t* spawn(ascheduler_t* s, anative_func_t f)
 {
     aactor_t* a;
     REQUIRE(AERR_NONE == ascheduler_new_actor(s, CSTACK_SZ, &a));
-    any_push_native_func(a, &nop);
+    any_push_native_func(a, f);
     ascheduler_start(s, a, 0);
+    return a;
+}
+
+static apid_t waker_target;
+
+static void push_module_waiter(aasm_t* a)
+{
+    aasm_prototype_t* const p = aasm_prototype(a);
+    p->symbol = aasm_string_to_ref(a, "mod_w");
+
+    aasm_module_push(a, "wait");
+    aasm_emit(a, ai_lsi(AINFINITE));
+    aasm_emit(a, ai_rcv(0));
+    aasm_emit(a, ai_rmv());
+    aasm_emit(a, ai_nil());
+    aasm_emit(a, ai_ret());
+    aasm_pop(a);
+}
+
+static void wait_in_byte_code(aactor_t* a)
+{
+    any_find(a, "mod_w", "wait");
+    any_call(a, 0);
+}
+
+static void hold_byte_code(aactor_t* a)
+{
+    any_find(a, "mod_w", "wait");
+    any_push_nil(a);
+    any_mbox_recv(a, AINFINITE);
+    any_mbox_remove(a);
+}
+
+static void wait_only(aactor_t* a)
+{
+    any_push_nil(a);
+    any_mbox_recv(a, AINFINITE);
+}
+
+static void waker(aactor_t* a)
+{
+    any_push_pid(a, waker_target);
+    any_push_integer(a, 0);
+    any_mbox_send(a);
+    any_push_nil(a);
+}
+
+static void push_module_looper(aasm_t* a, const char* name)
+{
+    aasm_prototype_t* const p = aasm_prototype(a);
+    p->symbol = aasm_string_to_ref(a, "mod_l");
+
+    aasm_module_push(a, name);
+    aasm_emit(a, ai_nil());
+    aasm_emit(a, ai_lsi(AINFINITE));
+    aasm_emit(a, ai_rcv(0));
+    aasm_emit(a, ai_rmv());
+    aasm_emit(a, ai_pop(1));
+    aasm_emit(a, ai_jmp(-6));
+    aasm_emit(a, ai_ret());
+    aasm_pop(a);
+}
+
+static void enter_loop(aactor_t* a)
+{
+    any_find(a, "mod_l", "loop");
+    any_push_idx(a, -1);
+    any_call(a, 1);
+}
+
+static void push_module_scanner(aasm_t* a, bool remove)
+{
+    aasm_prototype_t* const p = aasm_prototype(a);
+    p->symbol = aasm_string_to_ref(a, "mod_s");
+
+    aasm_module_push(a, "scan");
+    aasm_emit(a, ai_nil());
+    aasm_emit(a, ai_lsi(AINFINITE));
+    aasm_emit(a, ai_rcv(0));
+    if (remove) aasm_emit(a, ai_rmv());
+    aasm_emit(a, ai_pop(1));
+    aasm_emit(a, ai_jmp(remove ? -6 : -5));
+    aasm_emit(a, ai_ret());
+    aasm_pop(a);
+}
+
+static void enter_scan(aactor_t* a)
+{
+    any_find(a, "mod_s", "scan");
+    any_call(a, 0);
+}
+
+static bool has_garbage(ascheduler_t* s)
+{
+    return !alist_is_end(&s->loader.garbages, alist_head(&s->loader.garbages));
+}
+
+static void spawn_new(ascheduler_t* s)
+{
+    spawn(s, &nop);
 }
 
 TEST_CASE("scheduler_new_process")
@@ -50,3 +213,368 @@ TEST_CASE("scheduler_new_process")
 
     ascheduler_cleanup(&s);
 }
+
+TEST_CASE("scheduler_heap_pool")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_ACTORS = 8 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &counting_alloc, NULL));
+
+    aint_t warmed_up = 0;
+    for (aint_t round = 0; round < 5; ++round) {
+        for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+            aactor_t* a;
+            REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+            any_push_native_func(a, &churn);
+            ascheduler_start(&s, a, 0);
+        }
+        ascheduler_run_once(&s);
+        ascheduler_run_once(&s); // cleanup is deferred
+        REQUIRE(alist_head(&s.runnings) == &s.root.node);
+        if (round == 0) warmed_up = num_allocs;
+    }
+    REQUIRE(num_allocs == warmed_up);
+    REQUIRE(s.heap_pool.retained > 0);
+
+    ascheduler_cleanup(&s);
+    REQUIRE(s.heap_pool.retained == 0);
+}
+
+TEST_CASE("scheduler_large_objects")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &counting_alloc, NULL));
+
+    // not rounded up to the next power of two by the heap pool
+    max_alloc_sz = 0;
+    spawn(&s, &big_buffer);
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s); // cleanup is deferred
+    REQUIRE(max_alloc_sz > BIG_SZ);
+    REQUIRE(max_alloc_sz < BIG_SZ + 1024);
+    REQUIRE(s.heap_pool.retained < BIG_SZ);
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("scheduler_idle_gc")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    aidle_gc_t c;
+    c.idle = FALSE;
+    c.watermark_percent = 0;
+    c.hibernate_nsecs = -1;
+
+    SECTION("idle")
+    {
+        c.idle = TRUE;
+        ascheduler_idle_gc(&s, &c);
+        aactor_t* a = spawn(&s, &garbage_then_sleep);
+        ascheduler_run_once(&s);
+        REQUIRE(garbage_sz > 0);
+        REQUIRE(agc_heap_size(&a->gc) < garbage_sz);
+        REQUIRE(s.idle_swept);
+    }
+
+    SECTION("not idle")
+    {
+        c.idle = TRUE;
+        ascheduler_idle_gc(&s, &c);
+        aactor_t* a = spawn(&s, &garbage_then_sleep);
+        spawn(&s, &spin);
+        ascheduler_run_once(&s);
+        REQUIRE(agc_heap_size(&a->gc) == garbage_sz);
+    }
+
+    SECTION("watermark")
+    {
+        c.watermark_percent = 50;
+        ascheduler_idle_gc(&s, &c);
+        aactor_t* a = spawn(&s, &garbage_then_sleep);
+        spawn(&s, &spin);
+        ascheduler_run_once(&s);
+        REQUIRE(garbage_sz * 100 >= garbage_cap * c.watermark_percent);
+        REQUIRE(agc_heap_size(&a->gc) < garbage_sz);
+    }
+
+    SECTION("hibernate")
+    {
+        c.hibernate_nsecs = 0;
+        ascheduler_idle_gc(&s, &c);
+        aactor_t* a = spawn(&s, &garbage_then_recv);
+        spawn(&s, &spin);
+        ascheduler_run_once(&s);
+        REQUIRE(agc_heap_capacity(&a->gc) == garbage_cap);
+        ascheduler_run_once(&s);
+        REQUIRE(garbage_cap > s.gc_policy.min_heap_cap);
+        REQUIRE(agc_heap_capacity(&a->gc) == s.gc_policy.min_heap_cap);
+    }
+
+    SECTION("not hibernate")
+    {
+        c.hibernate_nsecs = amsec(1000);
+        ascheduler_idle_gc(&s, &c);
+        aactor_t* a = spawn(&s, &garbage_then_recv);
+        spawn(&s, &spin);
+        ascheduler_run_once(&s);
+        ascheduler_run_once(&s);
+        REQUIRE(agc_heap_capacity(&a->gc) == garbage_cap);
+    }
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("scheduler_code_reclaim")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t v1, v2;
+    aasm_init(&v1, &myalloc, NULL);
+    aasm_load(&v1, NULL);
+    push_module_waiter(&v1);
+    aasm_save(&v1);
+    aasm_init(&v2, &myalloc, NULL);
+    aasm_load(&v2, NULL);
+    push_module_waiter(&v2);
+    aasm_save(&v2);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v1.chunk, v1.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    // actors which never see the old code do not hold it back
+    spawn(&s, &wait_only);
+
+    aactor_t* a = NULL;
+
+    SECTION("frame")
+    {
+        a = spawn(&s, &wait_in_byte_code);
+    }
+
+    SECTION("value")
+    {
+        a = spawn(&s, &hold_byte_code);
+    }
+
+    ascheduler_run_once(&s);
+    waker_target = ascheduler_pid(&s, a);
+
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v2.chunk, v2.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+    REQUIRE(s.loader.epoch == 1);
+    REQUIRE(has_garbage(&s));
+
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s);
+    REQUIRE(has_garbage(&s));
+    REQUIRE(a->gc.code_epoch == 1);
+    REQUIRE(s.oldest_code == 1);
+    REQUIRE(s.oldest_code_at == s.loader.epoch);
+
+    spawn(&s, &waker);
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s); // cleanup is deferred
+    REQUIRE_FALSE(has_garbage(&s));
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&v1);
+    aasm_cleanup(&v2);
+}
+
+TEST_CASE("scheduler_code_reclaim_unsafe")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t v1, v2;
+    aasm_init(&v1, &myalloc, NULL);
+    aasm_load(&v1, NULL);
+    push_module_waiter(&v1);
+    aasm_save(&v1);
+    aasm_init(&v2, &myalloc, NULL);
+    aasm_load(&v2, NULL);
+    push_module_waiter(&v2);
+    aasm_add_import(&v2, "mod_missing", "f");
+    aasm_save(&v2);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v1.chunk, v1.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a = spawn(&s, &wait_in_byte_code);
+    ascheduler_run_once(&s);
+    waker_target = ascheduler_pid(&s, a);
+
+    // the replaced chunk is left in garbages without an epoch
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v2.chunk, v2.chunk_size, NULL, NULL));
+    REQUIRE(AERR_UNRESOLVED == aloader_link(&s.loader, FALSE));
+    REQUIRE(has_garbage(&s));
+
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s);
+    REQUIRE(has_garbage(&s));
+
+    // the actor still runs the old code
+    spawn(&s, &waker);
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s);
+    REQUIRE(ascheduler_num_processes(&s) == 0);
+    REQUIRE(has_garbage(&s));
+
+    aloader_sweep(&s.loader);
+    REQUIRE_FALSE(has_garbage(&s));
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&v1);
+    aasm_cleanup(&v2);
+}
+
+TEST_CASE("scheduler_code_change")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_ACTORS = 10 };
+
+    aasm_t v1, v2;
+    aasm_init(&v1, &myalloc, NULL);
+    aasm_load(&v1, NULL);
+    push_module_looper(&v1, "loop");
+    aasm_save(&v1);
+    aasm_init(&v2, &myalloc, NULL);
+    aasm_load(&v2, NULL);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v1.chunk, v1.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* as[NUM_ACTORS];
+    for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, as + i));
+        any_push_native_func(as[i], &enter_loop);
+        any_push_integer(as[i], i);
+        ascheduler_start(&s, as[i], 1);
+    }
+    ascheduler_run_once(&s);
+
+    SECTION("batch")
+    {
+        push_module_looper(&v2, "loop");
+        aasm_save(&v2);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &s.loader, v2.chunk, v2.chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+        ascheduler_run_once(&s);
+        for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+            REQUIRE(as[i]->frame->pt->chunk->header == v1.chunk);
+        }
+        ascheduler_code_change(&s);
+        ascheduler_run_once(&s);
+        for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+            aframe_t* const f = as[i]->frame;
+            REQUIRE(f->pt->chunk->header == v2.chunk);
+            REQUIRE(av_to_integer(as[i]->stack.v + f->bp - 1) == i);
+        }
+        ascheduler_run_once(&s);
+        REQUIRE_FALSE(has_garbage(&s));
+    }
+
+    SECTION("not exported")
+    {
+        push_module_looper(&v2, "loop2");
+        aasm_save(&v2);
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &s.loader, v2.chunk, v2.chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+        ascheduler_code_change(&s);
+        ascheduler_run_once(&s);
+        for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+            REQUIRE(as[i]->frame->pt->chunk->header == v1.chunk);
+        }
+        REQUIRE(has_garbage(&s));
+    }
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&v1);
+    aasm_cleanup(&v2);
+}
+
+TEST_CASE("scheduler_code_change_scan")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t v1, v2;
+    aasm_init(&v1, &myalloc, NULL);
+    aasm_load(&v1, NULL);
+    push_module_scanner(&v1, false);
+    aasm_save(&v1);
+    aasm_init(&v2, &myalloc, NULL);
+    aasm_load(&v2, NULL);
+    push_module_scanner(&v2, true);
+    aasm_save(&v2);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v1.chunk, v1.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    // the old code skips every message, leaving the cursor at the end
+    aactor_t* a = spawn(&s, &enter_scan);
+    ascheduler_run_once(&s);
+    waker_target = ascheduler_pid(&s, a);
+    spawn(&s, &waker);
+    spawn(&s, &waker);
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s);
+    REQUIRE(a->msbox.sp == 2);
+    REQUIRE(a->msg_pp == 2);
+
+    // the new code sees the skipped messages again and removes them
+    REQUIRE(AERR_NONE == aloader_add_chunk(
+        &s.loader, v2.chunk, v2.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+    ascheduler_code_change(&s);
+    ascheduler_run_once(&s);
+    REQUIRE(a->frame->pt->chunk->header == v2.chunk);
+    REQUIRE(a->msbox.sp == 0);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&v1);
+    aasm_cleanup(&v2);
+}
@@ -0,0 +1,131 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/platform.h>
+#include <catch.hpp>
+
+#include <any/std_libs.h>
+#include <any/scheduler.h>
+#include <any/actor.h>
+#include <any/gc_string.h>
+#include <any/gc_buffer.h>
+
+enum { CSTACK_SZ = 16384 };
+
+static void* myalloc(void*, void* old, aint_t sz)
+{
+    return realloc(old, (size_t)sz);
+}
+
+static bool done;
+
+// Arguments are pushed last to first, `-1` is the first argument.
+static void append_byte(aactor_t* a, aint_t buf, aint_t byte)
+{
+    any_find(a, "buffer", "append/2");
+    any_push_integer(a, byte);
+    any_push_idx(a, buf);
+    any_call(a, 2);
+    any_pop(a, 1);
+}
+
+static void append_string(aactor_t* a, aint_t buf, const char* s)
+{
+    any_find(a, "buffer", "append/2");
+    any_push_string(a, s);
+    any_push_idx(a, buf);
+    any_call(a, 2);
+    any_pop(a, 1);
+}
+
+static void encoder(aactor_t* a)
+{
+    any_find(a, "buffer", "new/1");
+    any_push_integer(a, 0);
+    any_call(a, 1);
+    REQUIRE(any_type(a, 0).type == AVT_BUFFER);
+
+    for (aint_t i = 0; i < 100; ++i) {
+        append_byte(a, 0, i);
+        append_string(a, 0, "frame");
+    }
+
+    any_find(a, "buffer", "size/1");
+    any_push_idx(a, 0);
+    any_call(a, 1);
+    REQUIRE(any_to_integer(a, 1) == 100*6);
+    any_pop(a, 1);
+
+    any_find(a, "buffer", "slice/3");
+    any_push_integer(a, 12);
+    any_push_integer(a, 6);
+    any_push_idx(a, 0);
+    any_call(a, 3);
+    REQUIRE(any_buffer_size(a, 1) == 6);
+    REQUIRE(memcmp(any_to_buffer(a, 1), "\x01" "frame", 6) == 0);
+
+    any_find(a, "buffer", "get/2");
+    any_push_integer(a, 0);
+    any_push_idx(a, 1);
+    any_call(a, 2);
+    REQUIRE(any_to_integer(a, 2) == 1);
+    any_pop(a, 1);
+
+    any_find(a, "buffer", "get/2");
+    any_push_integer(a, 6);
+    any_push_idx(a, 1);
+    any_call(a, 2);
+    REQUIRE(any_type(a, 2).type == AVT_NIL);
+    any_pop(a, 1);
+
+    done = true;
+}
+
+static void bad_byte(aactor_t* a)
+{
+    any_find(a, "buffer", "new/1");
+    any_push_integer(a, 0);
+    any_call(a, 1);
+    append_byte(a, 0, 256);
+}
+
+static void run(anative_func_t f, const char* err)
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    astd_lib_add_buffer(&s.loader);
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_push_native_func(a, f);
+    ascheduler_start(&s, a, 0);
+
+    done = false;
+    ascheduler_run_once(&s);
+
+    if (err) {
+        REQUIRE(any_type(a, 0).type == AVT_STRING);
+        CHECK_THAT(any_to_string(a, 0), Catch::Equals(err));
+    } else {
+        REQUIRE(done);
+    }
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("std_buffer")
+{
+    SECTION("encode")
+    {
+        run(&encoder, NULL);
+    }
+
+    SECTION("bad byte")
+    {
+        run(&bad_byte, "byte 256 out of range");
+    }
+}
@@ -0,0 +1,90 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/platform.h>
+#include <catch.hpp>
+
+#include <any/std_libs.h>
+#include <any/scheduler.h>
+#include <any/actor.h>
+#include <any/gc_string.h>
+
+enum { CSTACK_SZ = 8192 };
+
+static void* myalloc(void*, void* old, aint_t sz)
+{
+    return realloc(old, (size_t)sz);
+}
+
+static aint_t field(aactor_t* a, const char* name)
+{
+    any_push_string(a, name);
+    any_get(a, 0);
+    REQUIRE(any_type(a, any_count(a) - 1).type == AVT_INTEGER);
+    aint_t v = any_to_integer(a, any_count(a) - 1);
+    any_pop(a, 1);
+    return v;
+}
+
+static void make_garbage(aactor_t* a)
+{
+    for (aint_t i = 0; i < 100; ++i) {
+        any_push_string(a, "garbage");
+        any_pop(a, 1);
+    }
+    any_find(a, "gc", "collect/0");
+    any_call(a, 0);
+    any_pop(a, 1);
+    any_push_nil(a);
+}
+
+TEST_CASE("std_gc")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    astd_lib_add_gc(&s.loader);
+
+    aactor_t* g;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &g));
+    any_push_native_func(g, &make_garbage);
+    ascheduler_start(&s, g, 0);
+    ascheduler_run_once(&s);
+    ascheduler_run_once(&s); // cleanup is deferred
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+
+    SECTION("stats")
+    {
+        any_find(a, "gc", "stats/0");
+        ascheduler_start(&s, a, 0);
+        ascheduler_run_once(&s);
+
+        REQUIRE(any_count(a) == 2);
+        REQUIRE(any_type(a, 0).type == AVT_TABLE);
+        REQUIRE(field(a, "collections") == 0);
+        REQUIRE(field(a, "heap_cap") == s.gc_policy.min_heap_cap);
+    }
+
+    SECTION("total stats")
+    {
+        any_find(a, "gc", "total_stats/0");
+        ascheduler_start(&s, a, 0);
+        ascheduler_run_once(&s);
+
+        REQUIRE(any_count(a) == 2);
+        REQUIRE(any_type(a, 0).type == AVT_TABLE);
+        REQUIRE(field(a, "collections") >= 1);
+        REQUIRE(field(a, "heap_cap") == s.gc_policy.min_heap_cap);
+
+        any_push_string(a, "pause_histogram");
+        any_get(a, 0);
+        REQUIRE(any_type(a, 2).type == AVT_ARRAY);
+    }
+
+    ascheduler_cleanup(&s);
+}
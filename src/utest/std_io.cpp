@@ -94,7 +94,7 @@ TEST_CASE("std_io")
     SECTION("pointer")
     {
         avalue_t v;
-        v.tag.type = AVT_POINTER;
+        av_pointer(&v, NULL);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
@@ -144,7 +144,7 @@ TEST_CASE("std_io")
     SECTION("byte_code_function")
     {
         avalue_t v;
-        v.tag.type = AVT_BYTE_CODE_FUNC;
+        av_byte_code_func(&v, NULL);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
@@ -158,7 +158,7 @@ TEST_CASE("std_io")
     SECTION("fixed_buffer")
     {
         avalue_t v;
-        v.tag.type = AVT_FIXED_BUFFER;
+        av_collectable(&v, AVT_FIXED_BUFFER, 0);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
@@ -172,7 +172,7 @@ TEST_CASE("std_io")
     SECTION("buffer")
     {
         avalue_t v;
-        v.tag.type = AVT_BUFFER;
+        av_collectable(&v, AVT_BUFFER, 0);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
@@ -198,7 +198,7 @@ TEST_CASE("std_io")
     SECTION("tuple")
     {
         avalue_t v;
-        v.tag.type = AVT_TUPLE;
+        av_collectable(&v, AVT_TUPLE, 0);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
@@ -212,7 +212,7 @@ TEST_CASE("std_io")
     SECTION("array")
     {
         avalue_t v;
-        v.tag.type = AVT_ARRAY;
+        av_collectable(&v, AVT_ARRAY, 0);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
@@ -226,7 +226,7 @@ TEST_CASE("std_io")
     SECTION("table")
     {
         avalue_t v;
-        v.tag.type = AVT_TABLE;
+        av_collectable(&v, AVT_TABLE, 0);
         aactor_push(a, &v);
         ascheduler_start(&s, a, 1);
         ascheduler_run_once(&s);
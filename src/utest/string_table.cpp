@@ -77,4 +77,26 @@ TEST_CASE("string_table_grow")
     }
 
     free(st);
-}
\ No newline at end of file
+}
+
+TEST_CASE("string_table_same_hash")
+{
+    // "gz" and "hb" hash the same, strings still tell them apart
+    REQUIRE(ahash_and_length("gz").hash == ahash_and_length("hb").hash);
+
+    char buffer[1024];
+    astring_table_t* const st = (astring_table_t*)buffer;
+    astring_table_init(st, 1024, 10);
+
+    aint_t gz = astring_table_to_ref(st, "gz");
+    REQUIRE(AERR_FULL == astring_table_to_ref_const(st, "hb"));
+    aint_t hb = astring_table_to_ref(st, "hb");
+    REQUIRE(gz != hb);
+    REQUIRE(gz == astring_table_to_ref_const(st, "gz"));
+    REQUIRE(hb == astring_table_to_ref_const(st, "hb"));
+
+    astring_table_pack(st);
+    REQUIRE(gz == astring_table_to_ref_const(st, "gz"));
+    REQUIRE(hb == astring_table_to_ref_const(st, "hb"));
+    REQUIRE_STR_EQUALS("hb", astring_table_to_string(st, hb));
+}
@@ -24,8 +24,6 @@ typedef std::vector<amlc_value_t> amlc_pool;
 struct amlc_prototype_ctx_t
 {
     amlc_pool arguments;
-    amlc_pool imports;
-    amlc_pool constants;
     amlc_pool nesteds;
     amlc_pool pseudo_nesteds;
 };
@@ -123,39 +121,26 @@ static inline aint_t pool_take_argument(
     });
 }
 
-static inline aint_t pool_push_import(
-    amlc_pool& pool, aasm_t* a,
-    const std::string& module, const std::string& name)
+// Imports and constants are deduplicated by the assembler itself.
+static inline aint_t push_import(
+    aasm_t* a, const std::string& module, const std::string& name)
 {
-    auto literal = module + ':' + name;
-    return pool_push(pool, literal, [&] {
-        return aasm_add_import(a, module.c_str(), name.c_str());
-    });
+    return aasm_add_import(a, module.c_str(), name.c_str());
 }
 
-static inline aint_t pool_push_integer_constant(
-    amlc_pool& pool, aasm_t* a, const std::string& literal, aint_t v)
+static inline aint_t push_integer_constant(aasm_t* a, aint_t v)
 {
-    return pool_push(pool, literal, [&] {
-        return aasm_add_constant(a, ac_integer(v));
-    });
+    return aasm_add_constant(a, ac_integer(v));
 }
 
-static inline aint_t pool_push_string_constant(
-    amlc_pool& pool, aasm_t* a, const std::string& v)
+static inline aint_t push_string_constant(aasm_t* a, const std::string& v)
 {
-    return pool_push(pool, v, [&] {
-        return aasm_add_constant(
-            a, ac_string(aasm_string_to_ref(a, v.c_str())));
-    });
+    return aasm_add_constant(a, ac_string(aasm_string_to_ref(a, v.c_str())));
 }
 
-static inline aint_t pool_push_real_constant(
-    amlc_pool& pool, aasm_t* a, const std::string& literal, areal_t v)
+static inline aint_t push_real_constant(aasm_t* a, areal_t v)
 {
-    return pool_push(pool, literal, [&] {
-        return aasm_add_constant(a, ac_real(v));
-    });
+    return aasm_add_constant(a, ac_real(v));
 }
 
 static inline aint_t pool_push_nested(
@@ -465,19 +450,18 @@ static void match_pop(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
     aasm_emit(ctx.a, ai_pop(match_integer(ctx)));
 }
 
-static void match_ldk(amlc_ctx_t& ctx, amlc_prototype_ctx_t& pctx)
+static void match_ldk(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
 {
     aint_t idx;
     if (*ctx.s == '"') {
-        idx = pool_push_string_constant(
-            pctx.constants, ctx.a, match_string(ctx));
+        idx = push_string_constant(ctx.a, match_string(ctx));
     } else if (*ctx.s == '-' || isdigit(*ctx.s)) {
         bool integer; aint_t i; areal_t r;
-        auto literal = match_number(ctx, integer, i, r);
+        match_number(ctx, integer, i, r);
         if (integer) {
-            idx = pool_push_integer_constant(pctx.constants, ctx.a, literal, i);
+            idx = push_integer_constant(ctx.a, i);
         } else {
-            idx = pool_push_real_constant(pctx.constants, ctx.a, literal, r);
+            idx = push_real_constant(ctx.a, r);
         }
     } else {
         error(ctx, "unexpected character `%s`", character(*ctx.s).c_str());
@@ -520,7 +504,7 @@ static void match_slv(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
     aasm_emit(ctx.a, ai_slv(match_integer(ctx)));
 }
 
-static void match_imp(amlc_ctx_t& ctx, amlc_prototype_ctx_t& pctx)
+static void match_imp(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
 {
     std::stringstream name;
     auto module = match_symbol(ctx);
@@ -534,7 +518,7 @@ static void match_imp(amlc_ctx_t& ctx, amlc_prototype_ctx_t& pctx)
     } else {
         name << match_integer(ctx);
     }
-    aint_t idx = pool_push_import(pctx.imports, ctx.a, module, name.str());
+    aint_t idx = push_import(ctx.a, module, name.str());
     aasm_emit(ctx.a, ai_imp(idx));
 }
 
@@ -588,6 +572,31 @@ static void match_rwd(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
     aasm_emit(ctx.a, ai_rwd());
 }
 
+static void match_tup(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_tup(match_integer(ctx)));
+}
+
+static void match_arr(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_arr(match_integer(ctx)));
+}
+
+static void match_tbl(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_tbl(match_integer(ctx)));
+}
+
+static void match_get(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_get());
+}
+
+static void match_set(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_set());
+}
+
 static aint_t match_prototype(amlc_ctx_t& ctx);
 
 static void match_nested_prototype(amlc_ctx_t& ctx, amlc_prototype_ctx_t& pctx)
@@ -715,6 +724,11 @@ void amlc_compile(
     ADD_HANDLER(rcv);
     ADD_HANDLER(rmv);
     ADD_HANDLER(rwd);
+    ADD_HANDLER(tup);
+    ADD_HANDLER(arr);
+    ADD_HANDLER(tbl);
+    ADD_HANDLER(get);
+    ADD_HANDLER(set);
 
 #undef  ADD_HANDLER
 
@@ -1,10 +1,18 @@
 /* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
 #include <ProgramOptions.hxx>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <any/version.h>
+#include <any/allocator.h>
 #include <any/asm.h>
+#include <any/bundle.h>
 #include <any/scheduler.h>
 #include <any/loader.h>
 #include <any/actor.h>
@@ -14,6 +22,20 @@
 
 #include "compiler.h"
 
+#ifdef AWINDOWS
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char COMPILER_VERSION[] = "amlc version 1.0";
+
+// Must be bumped whenever the compiler emits different code for the same
+// source, cached outputs are keyed by it along with `AASM_REVISION`.
+static const int32_t COMPILER_REVISION = 1;
+
+static std::mutex log_mutex;
+
 static void* myalloc(void*, void* old, aint_t sz)
 {
     return realloc(old, (size_t)sz);
@@ -29,6 +51,13 @@ static void error(const char* fmt, ...)
     throw std::logic_error(buf);
 }
 
+// Workers of a batch share the console.
+static void log(const std::string& msg)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << msg;
+}
+
 static std::string file_name_without_extension(const std::string& path)
 {
     auto base_filename = path.substr(path.find_last_of("/\\") + 1);
@@ -39,15 +68,47 @@ static std::string file_name_without_extension(const std::string& path)
 static void print_version()
 {
     std::cout <<
-        "amlc version 1.0" << ", " <<
+        COMPILER_VERSION << ", " <<
         "target AVM " << AVERSION_MAJOR << "." << AVERSION_MINOR <<
         " [" << AVERSION_NAME << "]\n";
 }
 
-static void compile(const std::string& i, const std::string& o, bool verbose)
+static bool try_read_file(const std::string& path, std::vector<char>& buf)
+{
+    std::ifstream is;
+    is.open(path, std::fstream::in | std::fstream::binary);
+    if (!is.is_open()) return false;
+    is.seekg(0, std::fstream::end);
+    auto sz = (size_t)is.tellg();
+    is.seekg(0, std::fstream::beg);
+    buf.resize(sz);
+    is.read(buf.data(), sz);
+    is.close();
+    return true;
+}
+
+static std::vector<char> read_file(const std::string& path)
 {
-    std::cout << "compiling " << i << "\n";
+    std::vector<char> buf;
+    if (!try_read_file(path, buf)) {
+        error("failed to open `%s`", path.c_str());
+    }
+    return buf;
+}
 
+static bool write_file(const std::string& path, const std::vector<char>& buf)
+{
+    std::ofstream os;
+    os.open(
+        path, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+    if (!os.is_open()) return false;
+    os.write(buf.data(), buf.size());
+    os.close();
+    return !os.fail();
+}
+
+static std::vector<char> read_source(const std::string& i)
+{
     std::ifstream is;
     is.open(i, std::fstream::in);
     if (!is.is_open()) {
@@ -59,21 +120,310 @@ static void compile(const std::string& i, const std::string& o, bool verbose)
     std::vector<char> buf;
     buf.resize(sz + 1);
     is.read(buf.data(), sz);
-    buf[sz] = '\0';
+    // text mode may read less than the file size
+    buf.resize((size_t)is.gcount() + 1);
+    buf.back() = '\0';
     is.close();
+    return buf;
+}
+
+// Passes enabled by `-O` levels, higher levels include the lower ones.
+static int32_t passes_of(int32_t level)
+{
+    if (level <= 0) return 0;
+    if (level == 1) return AAOP_THREAD_JUMPS | AAOP_STRIP_NOPS;
+    return AAOP_ALL;
+}
+
+struct outputs_t
+{
+    FILE* out;
+    // optional, dropped as soon as it fails to be written
+    FILE* cache;
+};
+
+// Sink writing chunk parts to the output and the cache entry.
+static aerror_t write_outputs(void* ud, const void* data, aint_t sz)
+{
+    auto outs = (outputs_t*)ud;
+    if (outs->cache && fwrite(data, 1, (size_t)sz, outs->cache) != (size_t)sz) {
+        fclose(outs->cache);
+        outs->cache = NULL;
+    }
+    if (fwrite(data, 1, (size_t)sz, outs->out) != (size_t)sz) return AERR_IO;
+    return AERR_NONE;
+}
+
+// Assemble `src` and stream the chunk to `outs`, true if it is all written.
+static bool assemble(
+    const std::vector<char>& src, const std::string& i, int32_t level,
+    bool verbose, outputs_t& outs)
+{
+    // assembling is short-lived, everything goes away at once
+    aarena_t arena;
+    aarena_init(&arena, &myalloc, NULL);
 
     aasm_t a;
-    aasm_init(&a, &myalloc, NULL);
+    aasm_init(&a, &aarena_alloc, &arena);
     if (aasm_load(&a, NULL) != AERR_NONE) {
+        aarena_cleanup(&arena);
         error("failed to load aasm_t");
     }
-    amlc_compile(&a, buf.data(), i.c_str(), verbose);
-    aasm_save(&a);
+    try {
+        amlc_compile(&a, src.data(), i.c_str(), verbose);
+        if (passes_of(level)) {
+            auto removed = aasm_optimize(&a, passes_of(level));
+            if (verbose) {
+                log("    optimized out " + std::to_string(removed) +
+                    " instructions\n");
+            }
+        }
+    } catch (...) {
+        aasm_cleanup(&a);
+        aarena_cleanup(&arena);
+        throw;
+    }
+    auto ec = aasm_save_to(&a, &write_outputs, &outs);
+    aasm_cleanup(&a);
+    aarena_cleanup(&arena);
+    return ec == AERR_NONE;
+}
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t sz)
+{
+    auto p = (const uint8_t*)data;
+    for (size_t i = 0; i < sz; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Anything which changes the output must be part of the key, the source
+// file name is not as it only shows up in error messages.
+static std::string cache_key(const std::vector<char>& src, int32_t level)
+{
+    static const uint8_t target[] = { AVERSION_MAJOR, AVERSION_MINOR };
+    static const int32_t revisions[] = { COMPILER_REVISION, AASM_REVISION };
+    const int32_t passes = passes_of(level);
+    char key[17];
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = fnv1a(h, COMPILER_VERSION, sizeof(COMPILER_VERSION));
+    h = fnv1a(h, revisions, sizeof(revisions));
+    h = fnv1a(h, target, sizeof(target));
+    h = fnv1a(h, &passes, sizeof(passes));
+    h = fnv1a(h, src.data(), src.size());
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)h);
+    return key;
+}
+
+// Cache entries may be damaged or stale, only use the ones the loader takes.
+static bool is_valid_chunk(std::vector<char>& chunk)
+{
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+    auto ec = aloader_add_chunk(&l,
+        (achunk_header_t*)chunk.data(), (aint_t)chunk.size(), NULL, NULL);
+    aloader_cleanup(&l);
+    return ec == AERR_NONE;
+}
+
+// Outputs and cache entries are written aside then renamed into place,
+// readers never see a partial chunk and failures keep the previous one.
+// Several amlc processes may share a cache, names are unique per thread.
+static std::string tmp_path(const std::string& path)
+{
+#ifdef AWINDOWS
+    const unsigned long pid = (unsigned long)_getpid();
+#else
+    const unsigned long pid = (unsigned long)getpid();
+#endif
+    char tid[17];
+    snprintf(tid, sizeof(tid), "%016llx", (unsigned long long)
+        std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return path + "." + std::to_string(pid) + "." + tid + ".tmp";
+}
+
+// Move `tmp` over `path`, `tmp` is removed if that fails.
+static bool replace_file(const std::string& tmp, const std::string& path)
+{
+    // rename does not replace existing files on Windows
+    if (std::rename(tmp.c_str(), path.c_str()) != 0 &&
+        (std::remove(path.c_str()) != 0 ||
+        std::rename(tmp.c_str(), path.c_str()) != 0)) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Close `outs`, the output `o` is only replaced by `otmp` if `ok`, the cache
+// entry is only stored if complete.
+static bool close_outputs(
+    outputs_t& outs, const std::string& otmp, const std::string& o,
+    const std::string& tmp, const std::string& entry, bool ok)
+{
+    ok = fclose(outs.out) == 0 && ok;
+    if (ok) {
+        ok = replace_file(otmp, o);
+    } else {
+        std::remove(otmp.c_str());
+    }
+    if (outs.cache) {
+        const bool stored = fclose(outs.cache) == 0 && ok;
+        if (!stored || std::rename(tmp.c_str(), entry.c_str()) != 0) {
+            std::remove(tmp.c_str());
+        }
+    } else if (!tmp.empty()) {
+        std::remove(tmp.c_str());
+    }
+    return ok;
+}
+
+/** Compile `i` into `o`.
+\brief If `cache` is not empty, outputs are looked up in and stored to that
+directory, keyed by the hash of the source, the compiler version and the
+optimization passes.
+*/
+static void compile(
+    const std::string& i, const std::string& o, const std::string& cache,
+    int32_t level, bool verbose)
+{
+    auto src = read_source(i);
+    std::string entry;
+    if (!cache.empty()) {
+        std::vector<char> chunk;
+        entry = cache + "/" + cache_key(src, level) + ".avmc";
+        if (try_read_file(entry, chunk) && is_valid_chunk(chunk)) {
+            const std::string otmp = tmp_path(o);
+            if (!write_file(otmp, chunk)) {
+                std::remove(otmp.c_str());
+                error("failed to write `%s`", o.c_str());
+            }
+            if (!replace_file(otmp, o)) {
+                error("failed to write `%s`", o.c_str());
+            }
+            log("cached " + i + "\n    -> " + o + "\n");
+            return;
+        }
+    }
+
+    log("compiling " + i + "\n");
+    outputs_t outs;
+    const std::string otmp = tmp_path(o);
+    std::string tmp;
+    bool ok;
+    outs.out = fopen(otmp.c_str(), "wb");
+    if (!outs.out) error("failed to write `%s`", o.c_str());
+    outs.cache = NULL;
+    if (!entry.empty()) {
+        tmp = tmp_path(entry);
+        outs.cache = fopen(tmp.c_str(), "wb");
+    }
+    try {
+        ok = assemble(src, i, level, verbose, outs);
+    } catch (...) {
+        close_outputs(outs, otmp, o, tmp, entry, false);
+        throw;
+    }
+    if (!close_outputs(outs, otmp, o, tmp, entry, ok)) {
+        error("failed to write `%s`", o.c_str());
+    }
+    log("    -> " + o + "\n");
+}
+
+/** Compile all `inputs` by `jobs` worker threads, 0 for one per core.
+\brief Outputs are placed into `out_dir` if not empty. Every input is tried,
+failures are reported at the end.
+\note Inputs which would compile to the same output are rejected up front.
+*/
+static void compile_batch(
+    const std::vector<std::string>& inputs, const std::string& out_dir,
+    const std::string& cache, int32_t level, int32_t jobs, bool verbose)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::string> outputs;
+    std::vector<std::string> errors(inputs.size());
+    std::vector<std::thread> workers;
+    std::map<std::string, size_t> seen;
+    size_t num_failed = 0;
+
+    for (size_t n = 0; n < inputs.size(); ++n) {
+        auto o = file_name_without_extension(inputs[n]) + ".avmc";
+        if (!out_dir.empty()) o = out_dir + "/" + o;
+        auto s = seen.insert(std::make_pair(o, n));
+        if (!s.second) {
+            error("`%s` and `%s` both compile to `%s`",
+                inputs[s.first->second].c_str(), inputs[n].c_str(),
+                o.c_str());
+        }
+        outputs.push_back(o);
+    }
+
+    auto work = [&] {
+        for (size_t n = next++; n < inputs.size(); n = next++) {
+            auto& i = inputs[n];
+            auto& o = outputs[n];
+            try {
+                compile(i, o, cache, level, verbose);
+            } catch (const std::exception& e) {
+                errors[n] = e.what();
+            }
+        }
+    };
+
+    if (jobs <= 0) jobs = (int32_t)std::thread::hardware_concurrency();
+    if ((size_t)jobs > inputs.size()) jobs = (int32_t)inputs.size();
+    for (int32_t t = 1; t < jobs; ++t) workers.emplace_back(work);
+    work();
+    for (auto& w : workers) w.join();
+
+    for (auto& e : errors) {
+        if (e.empty()) continue;
+        std::cerr << e << "\n";
+        ++num_failed;
+    }
+    if (num_failed) {
+        error("%d of %d inputs failed",
+            (int32_t)num_failed, (int32_t)inputs.size());
+    }
+}
+
+static bool is_bundle(const std::string& path)
+{
+    static const std::string ext = ".avmb";
+    return path.length() >= ext.length() &&
+        path.compare(path.length() - ext.length(), ext.length(), ext) == 0;
+}
+
+static void bundle(
+    const std::vector<std::string>& inputs, const std::string& o)
+{
+    std::vector<std::vector<char>> bufs;
+    std::vector<achunk_header_t*> chunks;
+    std::vector<aint_t> sizes;
+    for (auto& i : inputs) {
+        std::cout << "bundling " << i << "\n";
+        bufs.push_back(read_file(i));
+        if (bufs.back().size() < sizeof(achunk_header_t)) {
+            error("bad chunk `%s`", i.c_str());
+        }
+    }
+    for (auto& b : bufs) {
+        chunks.push_back((achunk_header_t*)b.data());
+        sizes.push_back((aint_t)b.size());
+    }
+
+    auto sz = abundle_size(chunks.data(), sizes.data(), (aint_t)chunks.size());
+    std::vector<abundle_header_t> out;
+    out.resize((size_t)sz / sizeof(abundle_header_t));
+    abundle_write(
+        out.data(), chunks.data(), sizes.data(), (aint_t)chunks.size());
+
     std::ofstream os;
     os.open(o, std::fstream::out | std::fstream::binary | std::fstream::trunc);
-    os.write((const char*)a.chunk, a.chunk_size);
+    os.write((const char*)out.data(), sz);
     os.close();
-    aasm_cleanup(&a);
 
     std::cout << "    -> " << o << "\n";
 }
@@ -97,37 +447,34 @@ static void on_unresolved(const char* module, const char* name)
 
 static void execute(
     const std::string& module, const std::string& name,
-    int8_t idx_bits, int8_t gen_bits, aint_t cstack_sz,
+    int8_t idx_bits, int8_t gen_bits, aint_t cstack_sz, bool lazy,
     const std::vector<std::string>& chunks)
 {
+    aallocator_t al;
     ascheduler_t s;
     aerror_t ec;
 
-    ec = ascheduler_init(&s, idx_bits, gen_bits, &myalloc, NULL);
+    aallocator_init(&al, &myalloc, NULL);
+    ec = ascheduler_init(&s, idx_bits, gen_bits, &aallocator_alloc, &al);
     if (ec != AERR_NONE) {
         error("failed to init scheduler %d", ec);
     }
     ascheduler_on_panic(&s, &on_panic);
     aloader_on_unresolved(&s.loader, &on_unresolved);
+    aloader_lazy(&s.loader, lazy ? TRUE : FALSE);
 
     astd_lib_add_io(
         &s.loader, [](void*, const char* str) { std::cout << str; }, NULL);
 
     for (size_t i = 0; i < chunks.size(); ++i) {
         auto& c = chunks[i];
-        std::ifstream is;
-        is.open(c, std::fstream::in | std::fstream::binary);
-        if (!is.is_open()) {
+        std::cout << "add " << c << "\n";
+        ec = is_bundle(c)
+            ? aloader_add_bundle_file(&s.loader, c.c_str())
+            : aloader_add_chunk_file(&s.loader, c.c_str());
+        if (ec == AERR_IO) {
             error("failed to open `%s`", c.c_str());
         }
-        is.seekg(0, std::fstream::end);
-        auto sz = (size_t)is.tellg();
-        is.seekg(0, std::fstream::beg);
-        auto* chunk = (achunk_header_t*)myalloc(NULL, NULL, sz);
-        is.read((char*)chunk, sz);
-        is.close();
-        std::cout << "add " << c << "\n";
-        ec = aloader_add_chunk(&s.loader, chunk, sz, &myalloc, NULL);
         if (ec != AERR_NONE) {
             error("failed to add chunk %d", ec);
         }
@@ -154,6 +501,7 @@ static void execute(
     }
 
     ascheduler_cleanup(&s);
+    aallocator_cleanup(&al);
 }
 
 int main(int argc, char** argv)
@@ -178,11 +526,41 @@ int main(int argc, char** argv)
             .description("compile an AML source file")
             .type(po::string);
 
+        p["optimize"]
+            .abbreviation('O')
+            .description("optimization level, 1 strips NOPs and threads "
+                "jumps, 2 also removes dead code and folds loads")
+            .type(po::i32)
+            .fallback(0);
+
+        p["batch"]
+            .description("compile many AML source files in one run")
+            .type(po::void_);
+
+        p["jobs"]
+            .abbreviation('j')
+            .description("number of batch worker threads, 0 for one per core")
+            .type(po::i32)
+            .fallback(0);
+
+        p["cache"]
+            .description("reuse and store outputs in a cache directory")
+            .type(po::string);
+
+        p["bundle"]
+            .abbreviation('b')
+            .description("pack compiled chunks into a bundle (.avmb)")
+            .type(po::void_);
+
         p["execute"]
             .abbreviation('e')
             .description("run with entry point")
             .type(po::string);
 
+        p["lazy"]
+            .description("resolve imports on first use")
+            .type(po::void_);
+
         p["verbose"]
             .abbreviation('V')
             .description("display debugging log")
@@ -213,6 +591,11 @@ int main(int argc, char** argv)
         if (!p(argc, argv)) {
             return 1;
         } else {
+            const int32_t level = p["optimize"].get().i32;
+            std::string cache;
+            if (p["cache"].was_set()) {
+                cache = p["cache"].get().string;
+            }
             if (p["compile"].was_set()) {
                 auto i = p["compile"].get().string;
                 if (i.length() <= 0) {
@@ -224,7 +607,23 @@ int main(int argc, char** argv)
                 } else {
                     o = file_name_without_extension(i) + ".avmc";
                 }
-                compile(i, o, p["verbose"].available());
+                compile(i, o, cache, level, p["verbose"].available());
+            }
+            if (p["batch"].was_set()) {
+                std::string out_dir;
+                if (p["output"].was_set()) {
+                    out_dir = p["output"].get().string;
+                }
+                compile_batch(
+                    p[""].to_vector<po::string>(), out_dir, cache, level,
+                    p["jobs"].get().i32, p["verbose"].available());
+            }
+            if (p["bundle"].was_set()) {
+                if (!p["output"].was_set()) {
+                    error("output missing");
+                }
+                bundle(
+                    p[""].to_vector<po::string>(), p["output"].get().string);
             }
             if (p["execute"].was_set()) {
                 auto e = p["execute"].get().string;
@@ -245,6 +644,7 @@ int main(int argc, char** argv)
                     (int8_t)p["idx_bits"].get().i32,
                     (int8_t)p["gen_bits"].get().i32,
                     (aint_t)p["cstack_sz"].get().i32,
+                    p["lazy"].was_set(),
                     p[""].to_vector<po::string>());
             }
             return 0;